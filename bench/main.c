@@ -0,0 +1,601 @@
+/**
+ * @file main.c
+ * @brief The oe renderer benchmark.
+ *
+ * Drives the renderer headlessly through canonical sprite workloads
+ * and writes frame timings and renderer counters as JSON. Sprites
+ * are generated from a fixed seed, so every run draws the same
+ * frames.
+ */
+#define _POSIX_C_SOURCE 199309L
+
+#include <time.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include <oe.h>
+
+#define BENCH_TEXTURE_PATH "./bench_texture.ppm"
+#define BENCH_TEXTURE_SIZE 64
+#define BENCH_SEED         0x5eed1234u
+#define BENCH_MAX_SPRITES  15000
+#define BENCH_TILE_SIZE    16.0f
+#define BENCH_LAYER_COUNT  4
+
+typedef struct sprite {
+  vec2_t  pos;
+  vec2_t  vel;
+  color_t color;
+  u32     tex_id;
+  f32     rot;
+  f32     depth;
+} sprite_t;
+
+typedef struct workload {
+  const char *name;
+  void (*prepare)(u32 frame); // runs before draw_begin(), can be NULL
+  void (*frame)(u32 frame);
+} workload_t;
+
+typedef struct options {
+  u32         frames;
+  u32         warmup;
+  u32         sprites;
+  u16         resx, resy;
+  const char *workload;
+  const char *out;
+} options_t;
+
+typedef struct result {
+  const char *name;
+  f64        *frame_ms;
+  f64        *cpu_ms;
+  f64        *gpu_ms;
+  u32         gpu_count; // timings lag behind, so there might be fewer
+  u64         quads;
+  u64         draw_calls;
+  u64         bytes_uploaded;
+  u64         allocs;
+} result_t;
+
+static options_t s_opts = {
+  .frames   = 600,
+  .warmup   = 60,
+  .sprites  = 10000,
+  .resx     = 1280,
+  .resy     = 720,
+  .workload = NULL,
+  .out      = "bench.json",
+};
+
+static sprite_t s_sprites[BENCH_MAX_SPRITES];
+static u32 s_sprite_count;
+static u32 s_rand_state;
+static texture_t s_textures[2];
+static texture_t s_churn_tex;
+
+// +------------------------------------------------------------------+
+// |                           allocations                            |
+// +------------------------------------------------------------------+
+
+#ifdef OE_BENCH_COUNT_ALLOCS
+// NOTE: the linker redirects all the heap calls of oe and the bench
+//       here, see CMakeLists.txt
+static u64 s_alloc_count;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+void *__wrap_malloc(size_t size)
+{
+  __atomic_add_fetch(&s_alloc_count, 1, __ATOMIC_RELAXED);
+  return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t count, size_t size)
+{
+  __atomic_add_fetch(&s_alloc_count, 1, __ATOMIC_RELAXED);
+  return __real_calloc(count, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+  __atomic_add_fetch(&s_alloc_count, 1, __ATOMIC_RELAXED);
+  return __real_realloc(ptr, size);
+}
+
+static u64 _alloc_count(void)
+{
+  return __atomic_load_n(&s_alloc_count, __ATOMIC_RELAXED);
+}
+#else
+static u64 _alloc_count(void)
+{
+  return 0;
+}
+#endif
+
+// +------------------------------------------------------------------+
+// |                             utils                                |
+// +------------------------------------------------------------------+
+
+static f64 _now_ms(void)
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+
+  return t.tv_sec * 1000.0 + t.tv_nsec / 1000000.0;
+}
+
+static u32 _rand(void)
+{
+  // xorshift32, the same sequence on every platform
+  s_rand_state ^= s_rand_state << 13;
+  s_rand_state ^= s_rand_state >> 17;
+  s_rand_state ^= s_rand_state << 5;
+  return s_rand_state;
+}
+
+static f32 _randf(f32 min, f32 max)
+{
+  return min + (max - min) * (_rand() & 0xffffff) / (f32)0xffffff;
+}
+
+static int _cmp_f64(const void *a, const void *b)
+{
+  const f64 x = *(const f64*)a, y = *(const f64*)b;
+  return (x > y) - (x < y);
+}
+
+/**
+ * @brief Writes a checker texture, stb_image reads binary PPM.
+ */
+static int _texture_write(const char *path)
+{
+  FILE *fd = fopen(path, "wb");
+  if (!fd) return 0;
+
+  fprintf(fd, "P6\n%d %d\n255\n", BENCH_TEXTURE_SIZE, BENCH_TEXTURE_SIZE);
+
+  for (u32 y = 0; y < BENCH_TEXTURE_SIZE; ++y) {
+    for (u32 x = 0; x < BENCH_TEXTURE_SIZE; ++x) {
+      const u8 v = ((x / 8) ^ (y / 8)) & 1 ? 0xff : 0x40;
+      const u8 pixel[3] = { v, v, (u8)(x * 4) };
+      fwrite(pixel, sizeof(pixel), 1, fd);
+    }
+  }
+
+  fclose(fd);
+  return 1;
+}
+
+static void _sprites_generate(u32 count)
+{
+  s_rand_state = BENCH_SEED;
+  s_sprite_count = count;
+
+  for (u32 i = 0; i < count; ++i) {
+    s_sprites[i] = (sprite_t){
+      .pos    = { _randf(0.0f, s_opts.resx), _randf(0.0f, s_opts.resy) },
+      .vel    = { _randf(-2.0f, 2.0f), _randf(-2.0f, 2.0f) },
+      .color  = _rand() | 0xff,
+      .tex_id = _rand() % 2 ? 0 : DEFAULT_TEXTURE_IND,
+      .rot    = _randf(0.0f, 6.28f),
+      .depth  = _randf(0.0f, 1.0f),
+    };
+  }
+}
+
+static void _sprite_draw(const sprite_t *sprite, u32 tex_id, f32 rot)
+{
+  draw_texture_ext(
+    (rect_t){ sprite->pos.x, sprite->pos.y, 16.0f, 16.0f },
+    (rect_t){ 0.0f, 0.0f, 16.0f, 16.0f },
+    tex_id, sprite->color, rot, sprite->depth
+  );
+}
+
+static void _camera_set(vec2_t pos)
+{
+  camera_set((camera_t){
+    .pos      = pos,
+    .view     = { s_opts.resx, s_opts.resy },
+    .zoom     = 1.0f,
+    .rotation = 0.0f,
+  });
+}
+
+// +------------------------------------------------------------------+
+// |                           workloads                              |
+// +------------------------------------------------------------------+
+
+static void _static_frame(u32 frame)
+{
+  (void)frame;
+
+  _camera_set((vec2_t){ 0.0f, 0.0f });
+
+  for (u32 i = 0; i < s_sprite_count; ++i)
+    _sprite_draw(&s_sprites[i], 0, 0.0f);
+}
+
+static void _moving_chunk(u32 start, u32 end, void *data)
+{
+  (void)data;
+
+  draw_set_order(start);
+
+  for (u32 i = start; i < end; ++i) {
+    sprite_t *sprite = &s_sprites[i];
+    sprite->pos = vec2_add(sprite->pos, sprite->vel);
+
+    if (sprite->pos.x < 0.0f || sprite->pos.x > s_opts.resx)
+      sprite->vel.x = -sprite->vel.x;
+    if (sprite->pos.y < 0.0f || sprite->pos.y > s_opts.resy)
+      sprite->vel.y = -sprite->vel.y;
+
+    _sprite_draw(sprite, 0, 0.0f);
+  }
+}
+
+static void _moving_frame(u32 frame)
+{
+  (void)frame;
+
+  _camera_set((vec2_t){ 0.0f, 0.0f });
+
+  job_parallel_for(s_sprite_count, 0, _moving_chunk, NULL);
+  draw_set_order(0);
+}
+
+static void _tilemap_frame(u32 frame)
+{
+  const vec2_t cam = { frame * 1.5f, frame * 0.5f };
+  _camera_set(cam);
+
+  // only visible tiles are drawn, like the example tilemap does
+  const i32 first_x = (i32)(cam.x / BENCH_TILE_SIZE);
+  const i32 first_y = (i32)(cam.y / BENCH_TILE_SIZE);
+  const i32 width  = s_opts.resx / BENCH_TILE_SIZE + 2;
+  const i32 height = s_opts.resy / BENCH_TILE_SIZE + 2;
+
+  for (i32 y = first_y; y < first_y + height; ++y) {
+    for (i32 x = first_x; x < first_x + width; ++x) {
+      draw_texture_ext(
+        (rect_t){
+          x * BENCH_TILE_SIZE, y * BENCH_TILE_SIZE,
+          BENCH_TILE_SIZE, BENCH_TILE_SIZE
+        },
+        (rect_t){ (x & 3) * 16.0f, (y & 3) * 16.0f, 16.0f, 16.0f },
+        0, WHITE, 0.0f, 0.0f
+      );
+    }
+  }
+}
+
+static void _texture_churn_prepare(u32 frame)
+{
+  (void)frame;
+
+  texture_t tex = texture_load(BENCH_TEXTURE_PATH);
+  if (!tex)
+    fatal("failed to load bench texture");
+
+  // NOTE: descriptor sets of the frames in flight can't be updated
+  //       while they're used, so the rebinding waits for gpu
+  draw_wait();
+  texture_bind(tex, 1);
+
+  if (s_churn_tex)
+    texture_free(s_churn_tex);
+  s_churn_tex = tex;
+}
+
+static void _texture_churn_frame(u32 frame)
+{
+  (void)frame;
+
+  _camera_set((vec2_t){ 0.0f, 0.0f });
+
+  for (u32 i = 0; i < s_sprite_count / 10; ++i)
+    _sprite_draw(&s_sprites[i], 1, 0.0f);
+}
+
+static void _mixed_layer(u32 layer, void *data)
+{
+  (void)data;
+
+  for (u32 i = layer; i < s_sprite_count; i += BENCH_LAYER_COUNT) {
+    const sprite_t *sprite = &s_sprites[i];
+    _sprite_draw(sprite, sprite->tex_id, sprite->rot);
+  }
+}
+
+static void _mixed_frame(u32 frame)
+{
+  (void)frame;
+
+  _camera_set((vec2_t){ 0.0f, 0.0f });
+
+  draw_layers(BENCH_LAYER_COUNT, _mixed_layer, NULL);
+}
+
+static const workload_t s_workloads[] = {
+  { "static",        NULL,                   _static_frame        },
+  { "moving",        NULL,                   _moving_frame        },
+  { "tilemap",       NULL,                   _tilemap_frame       },
+  { "texture_churn", _texture_churn_prepare, _texture_churn_frame },
+  { "mixed",         NULL,                   _mixed_frame         },
+};
+
+#define WORKLOAD_COUNT (sizeof(s_workloads) / sizeof(s_workloads[0]))
+
+// +------------------------------------------------------------------+
+// |                             runner                               |
+// +------------------------------------------------------------------+
+
+static void _frame(const workload_t *workload, u32 frame, f64 *frame_ms,
+                   f64 *cpu_ms)
+{
+  const f64 start = _now_ms();
+
+  // resources can't be changed while the frame is recorded
+  if (workload->prepare)
+    workload->prepare(frame);
+  const f64 prepare_end = _now_ms();
+
+  // NOTE: draw_begin() waits for the frame in flight, so it's
+  //       excluded from the cpu time
+  draw_begin(0x101010ff);
+  const f64 begin_end = _now_ms();
+
+  workload->frame(frame);
+
+  draw_end();
+  const f64 end = _now_ms();
+
+  *frame_ms = end - start;
+  *cpu_ms   = (prepare_end - start) + (end - begin_end);
+}
+
+static void _workload_run(const workload_t *workload, result_t *result)
+{
+  _sprites_generate(s_opts.sprites);
+
+  f64 ignored_frame_ms, ignored_cpu_ms;
+  for (u32 i = 0; i < s_opts.warmup; ++i)
+    _frame(workload, i, &ignored_frame_ms, &ignored_cpu_ms);
+
+  draw_wait();
+
+  *result = (result_t){
+    .name     = workload->name,
+    .frame_ms = malloc(sizeof(f64) * s_opts.frames),
+    .cpu_ms   = malloc(sizeof(f64) * s_opts.frames),
+    .gpu_ms   = malloc(sizeof(f64) * s_opts.frames),
+  };
+
+  if (!result->frame_ms || !result->cpu_ms || !result->gpu_ms)
+    fatal("failed to allocate memory for frame timings");
+
+  const u64 allocs_start = _alloc_count();
+  u64 gpu_frame = gfx_gpu_stats_get().frame;
+
+  for (u32 i = 0; i < s_opts.frames; ++i) {
+    _frame(workload, s_opts.warmup + i, &result->frame_ms[i],
+           &result->cpu_ms[i]);
+
+    const gfx_frame_stats_t stats = gfx_frame_stats_get();
+    result->quads          += stats.quads;
+    result->draw_calls     += stats.draw_calls;
+    result->bytes_uploaded += stats.bytes_uploaded;
+
+    // NOTE: a frame is resolved only once its resources are reused
+    const gfx_gpu_stats_t gpu_stats = gfx_gpu_stats_get();
+    if (gpu_stats.frame != gpu_frame) {
+      result->gpu_ms[result->gpu_count++] = gpu_stats.frame_ms;
+      gpu_frame = gpu_stats.frame;
+    }
+  }
+
+  result->allocs = _alloc_count() - allocs_start;
+
+  draw_wait();
+
+  info("%s: done", workload->name);
+}
+
+static void _timings_write(FILE *fd, const char *name, f64 *ms, u32 count)
+{
+  f64 sum = 0.0;
+  for (u32 i = 0; i < count; ++i)
+    sum += ms[i];
+
+  qsort(ms, count, sizeof(f64), _cmp_f64);
+
+  fprintf(fd,
+          "      \"%s\": { \"mean\": %.4f, \"p50\": %.4f, "
+          "\"p99\": %.4f, \"max\": %.4f },\n",
+          name, sum / count, ms[count / 2], ms[count * 99 / 100],
+          ms[count - 1]);
+}
+
+static int _results_write(const char *path, result_t *results, u32 count)
+{
+  FILE *fd = fopen(path, "w");
+  if (!fd) return 0;
+
+  fprintf(fd, "{\n");
+  fprintf(fd, "  \"resolution\": [%u, %u],\n", s_opts.resx, s_opts.resy);
+  fprintf(fd, "  \"frames\": %u,\n", s_opts.frames);
+  fprintf(fd, "  \"warmup\": %u,\n", s_opts.warmup);
+  fprintf(fd, "  \"sprites\": %u,\n", s_opts.sprites);
+  fprintf(fd, "  \"threads\": %u,\n", job_thread_count());
+  fprintf(fd, "  \"workloads\": [\n");
+
+  for (u32 i = 0; i < count; ++i) {
+    result_t *result = &results[i];
+    const f64 frames = s_opts.frames;
+
+    f64 total_ms = 0.0;
+    for (u32 j = 0; j < s_opts.frames; ++j)
+      total_ms += result->frame_ms[j];
+
+    fprintf(fd, "    {\n");
+    fprintf(fd, "      \"name\": \"%s\",\n", result->name);
+
+    _timings_write(fd, "frame_ms", result->frame_ms, s_opts.frames);
+    _timings_write(fd, "cpu_ms", result->cpu_ms, s_opts.frames);
+
+    // NOTE: gpu might not support timestamp queries
+    if (result->gpu_count)
+      _timings_write(fd, "gpu_ms", result->gpu_ms, result->gpu_count);
+    else
+      fprintf(fd, "      \"gpu_ms\": null,\n");
+
+    fprintf(fd, "      \"sprites_per_sec\": %.1f,\n",
+            result->quads / (total_ms / 1000.0));
+    fprintf(fd, "      \"quads_per_frame\": %.1f,\n",
+            result->quads / frames);
+    fprintf(fd, "      \"draw_calls_per_frame\": %.2f,\n",
+            result->draw_calls / frames);
+    fprintf(fd, "      \"bytes_uploaded_per_frame\": %.1f,\n",
+            result->bytes_uploaded / frames);
+
+#ifdef OE_BENCH_COUNT_ALLOCS
+    fprintf(fd, "      \"allocations_per_frame\": %.2f\n",
+            result->allocs / frames);
+#else
+    fprintf(fd, "      \"allocations_per_frame\": null\n");
+#endif
+
+    fprintf(fd, "    }%s\n", i + 1 < count ? "," : "");
+  }
+
+  fprintf(fd, "  ]\n");
+  fprintf(fd, "}\n");
+
+  fclose(fd);
+  return 1;
+}
+
+static void _usage(void)
+{
+  printf(
+    "usage: oe_bench [options]\n"
+    "  --frames N       measured frames per workload (default 600)\n"
+    "  --warmup N       frames drawn before measuring (default 60)\n"
+    "  --sprites N      sprites per workload (default 10000)\n"
+    "  --res WxH        offscreen resolution (default 1280x720)\n"
+    "  --workload NAME  run a single workload\n"
+    "  --out PATH       JSON report path (default bench.json)\n"
+    "workloads: static, moving, tilemap, texture_churn, mixed\n"
+  );
+}
+
+static int _args_parse(int argc, char **argv)
+{
+  for (int i = 1; i < argc; ++i) {
+    const char *arg = argv[i];
+    const char *val = i + 1 < argc ? argv[i + 1] : NULL;
+
+    if (!strcmp(arg, "--help") || !strcmp(arg, "-h"))
+      return 0;
+
+    if (!val)
+      return 0;
+
+    if (!strcmp(arg, "--frames")) {
+      s_opts.frames = strtoul(val, NULL, 10);
+    } else if (!strcmp(arg, "--warmup")) {
+      s_opts.warmup = strtoul(val, NULL, 10);
+    } else if (!strcmp(arg, "--sprites")) {
+      s_opts.sprites = strtoul(val, NULL, 10);
+    } else if (!strcmp(arg, "--res")) {
+      unsigned x, y;
+      if (sscanf(val, "%ux%u", &x, &y) != 2)
+        return 0;
+      s_opts.resx = x;
+      s_opts.resy = y;
+    } else if (!strcmp(arg, "--workload")) {
+      s_opts.workload = val;
+    } else if (!strcmp(arg, "--out")) {
+      s_opts.out = val;
+    } else {
+      return 0;
+    }
+
+    ++i;
+  }
+
+  if (!s_opts.frames || !s_opts.resx || !s_opts.resy)
+    return 0;
+
+  if (s_opts.sprites > BENCH_MAX_SPRITES)
+    s_opts.sprites = BENCH_MAX_SPRITES;
+
+  return 1;
+}
+
+int main(int argc, char **argv)
+{
+  if (!_args_parse(argc, argv)) {
+    _usage();
+    return 1;
+  }
+
+  if (!_texture_write(BENCH_TEXTURE_PATH)) {
+    printf("failed to write %s\n", BENCH_TEXTURE_PATH);
+    return 1;
+  }
+
+  init_headless(s_opts.resx, s_opts.resy);
+
+  s_textures[0] = texture_load(BENCH_TEXTURE_PATH);
+  s_textures[1] = texture_load(BENCH_TEXTURE_PATH);
+  if (!s_textures[0] || !s_textures[1])
+    fatal("failed to load bench texture");
+
+  texture_bind(s_textures[0], 0);
+  texture_bind(s_textures[1], 1);
+  texture_bind(s_textures[0], DEFAULT_TEXTURE_IND);
+
+  result_t results[WORKLOAD_COUNT];
+  u32 result_count = 0;
+
+  for (u32 i = 0; i < WORKLOAD_COUNT; ++i) {
+    if (s_opts.workload && strcmp(s_opts.workload, s_workloads[i].name))
+      continue;
+
+    _workload_run(&s_workloads[i], &results[result_count++]);
+  }
+
+  if (!result_count) {
+    error("unknown workload: %s", s_opts.workload);
+  } else if (!_results_write(s_opts.out, results, result_count)) {
+    error("failed to write %s", s_opts.out);
+  } else {
+    info("results written to %s", s_opts.out);
+  }
+
+  for (u32 i = 0; i < result_count; ++i) {
+    free(results[i].frame_ms);
+    free(results[i].cpu_ms);
+    free(results[i].gpu_ms);
+  }
+
+  draw_wait();
+
+  if (s_churn_tex)
+    texture_free(s_churn_tex);
+  texture_free(s_textures[0]);
+  texture_free(s_textures[1]);
+
+  quit();
+
+  remove(BENCH_TEXTURE_PATH);
+
+  return result_count ? 0 : 1;
+}
@@ -1,5 +1,5 @@
-00000000: 0800 0000 0800 0000 1818 1818 1818 1818  ................
-00000010: 1811 1212 1212 1018 1811 0403 0303 1210  ................
-00000020: 1811 0008 0808 0510 1811 0008 0808 0710  ................
-00000030: 1811 0602 0207 1418 1818 1313 1313 1818  ................
-00000040: 1818 1818 1818 1818 0a                   .........
+00000000: 4f45 544d 0100 0100 0800 0000 0800 0000  OETM............
+00000010: 4000 0000 0100 0000 2000 0000 2e00 0000  @....... .......
+00000020: 8718 0011 8212 0410 1818 1104 8103 0412  ................
+00000030: 1018 1100 8108 0405 1018 1100 8108 0807  ................
+00000040: 1018 1106 0202 0714 8118 8213 8818       ..............
@@ -1,15 +1,44 @@
 #include <time.h>
+#include <string.h>
 #include <stdlib.h>
 
 #include <oe.h>
 
 #include "core/room.h"
 
-int main(void)
+int main(int argc, char **argv)
 {
-  init_ext(1280, 720, 320, 180, "oe application");
+  // -record <path> writes the session input to a file, -replay <path>
+  // plays it back headlessly and exits when it's over
+  const char *record = NULL;
+  const char *replay = NULL;
 
-  texture_t tex = texture_load("assets/textures/tilemap.png");
+  for (i32 i = 1; i + 1 < argc; i += 2) {
+    if (!strcmp(argv[i], "-record"))
+      record = argv[i + 1];
+    else if (!strcmp(argv[i], "-replay"))
+      replay = argv[i + 1];
+  }
+
+  if (replay)
+    init_headless(320, 180);
+  else
+    init_ext(1280, 720, 320, 180, "oe application");
+
+  if (replay && !input_replay_begin(replay)) {
+    quit();
+    return 1;
+  }
+
+  // tiles are 16 pixels, so the levels down to one pixel per tile
+  // don't blend neighbouring tiles of the atlas
+  const texture_params_t tex_params = {
+    .filter = TEXTURE_FILTER_NEAREST,
+    .mip    = TEXTURE_MIP_NEAREST,
+    .wrap   = TEXTURE_WRAP_CLAMP,
+  };
+  texture_t tex = texture_load_ext("assets/textures/tilemap.png",
+                                   tex_params);
   texture_t deftex = texture_load("assets/textures/default.png");
 
   texture_bind(tex, 0);
@@ -17,8 +46,24 @@ int main(void)
 
   room_init();
 
+  frame_timer_t timer;
+  frame_timer_init(&timer);
+
+  fixed_step_t step;
+  fixed_step_init(&step, ROOM_UPDATE_STEP, ROOM_MAX_UPDATES);
+
+  if (record)
+    input_record_begin(record);
+
   while (!should_close()) {
-    room_update(0.016f);
+    if (replay && !input_replay_active())
+      break;
+
+    // the room is simulated with the same step no matter the frame
+    // rate, so scripts behave the same on every machine
+    for (u32 i = fixed_step_advance(&step, frame_timer_tick(&timer));
+         i > 0; --i)
+      room_update(step.step);
 
     // frame draw
     draw_begin(0x010101ff);
@@ -28,6 +73,15 @@ int main(void)
 
   draw_wait();
 
+  if (replay)
+    info("replay frame time: p50 %.2f ms, p99 %.2f ms",
+         frame_timer_percentile(&timer, 50.0),
+         frame_timer_percentile(&timer, 99.0));
+
+#ifdef OE_PROFILE_BUILD
+  profile_dump("profile.json");
+#endif
+
   texture_free(tex);
   texture_free(deftex);
 
@@ -0,0 +1,290 @@
+#include <math.h>
+
+#include <oe.h>
+
+#include "core/collision.h"
+
+// rounding tolerance of collider edges lying on the cell borders
+#define COLLISION_EPSILON 0.0001f
+
+// colliders are stopped this far from the walls, so they don't end up
+// inside of them because of rounding
+#define COLLISION_SKIN 0.001f
+
+// the maximum number of surfaces a single move slides along
+#define COLLISION_MAX_SLIDES 3
+
+static int _cell_solid(const tilemap_t *tilemap, int x, int y)
+{
+  if (x < 0 || y < 0 || x >= tilemap->width || y >= tilemap->height)
+    return 1;
+
+  return ((unsigned char)tilemap->cells[y * tilemap->width + x] >> 4) !=
+         TILE_TYPE_FLOOR;
+}
+
+/**
+ * @brief Returns the bounds of the collider in the tile grid space.
+ */
+static rect_t _collider_bounds(vec2_t pos, collider_t collider)
+{
+  pos.x += collider.offset.x;
+  pos.y += collider.offset.y - TILEMAP_COLLISION_OFFSET;
+
+  // the offset of a circle points to its center
+  if (collider.type == COLLIDER_TYPE_CIRCLE) {
+    const float r = collider.bounds.radius;
+    return (rect_t){ pos.x - r, pos.y - r, r * 2.0f, r * 2.0f };
+  }
+
+  return (rect_t){
+    pos.x, pos.y, collider.bounds.size.x, collider.bounds.size.y
+  };
+}
+
+/**
+ * @brief Returns the first and the last cell the span overlaps, edges
+ *        lying on cell borders don't overlap the cells behind them.
+ */
+static void _span_cells(float min, float max, int *first, int *last)
+{
+  *first = (int)floorf((min + COLLISION_EPSILON) / TILEMAP_TILE_SIZE);
+  *last  = (int)ceilf((max - COLLISION_EPSILON) / TILEMAP_TILE_SIZE) - 1;
+}
+
+/**
+ * @brief Sweeps a circle against a single cell, which is a sweep of
+ *        the center against the cell rounded by the radius.
+ *
+ * Circles that already overlap the cell aren't stopped by it, so
+ * they can get out.
+ *
+ * @return Returns 1 if the contact happens before hit->time, and
+ *         updates the hit.
+ */
+static int _circle_cell_sweep(vec2_t c, float r, vec2_t d, int x, int y,
+                              tile_hit_t *hit)
+{
+  const float x0 = x * TILEMAP_TILE_SIZE, x1 = x0 + TILEMAP_TILE_SIZE;
+  const float y0 = y * TILEMAP_TILE_SIZE, y1 = y0 + TILEMAP_TILE_SIZE;
+
+  const float lo[2] = { x0 - r, y0 - r };
+  const float hi[2] = { x1 + r, y1 + r };
+  const float cc[2] = { c.x, c.y };
+  const float dd[2] = { d.x, d.y };
+
+  // slab test against the cell expanded by the radius
+  float enter = -INFINITY, exit = INFINITY;
+  int axis = 0;
+
+  for (int i = 0; i < 2; ++i) {
+    if (dd[i] == 0.0f) {
+      if (cc[i] <= lo[i] || cc[i] >= hi[i])
+        return 0;
+      continue;
+    }
+
+    float t1 = (lo[i] - cc[i]) / dd[i];
+    float t2 = (hi[i] - cc[i]) / dd[i];
+    if (t1 > t2) { const float t = t1; t1 = t2; t2 = t; }
+
+    if (t1 > enter) { enter = t1; axis = i; }
+    if (t2 < exit)  { exit = t2; }
+  }
+
+  if (enter >= exit || exit <= 0.0f || enter >= hit->time)
+    return 0;
+
+  const vec2_t p = vec2_add(c, vec2_scale(d, fmaxf(enter, 0.0f)));
+
+  // the corners are rounded, so near them the circle is swept against
+  // the corner point
+  if ((p.x < x0 || p.x > x1) && (p.y < y0 || p.y > y1)) {
+    const vec2_t k = { p.x < x0 ? x0 : x1, p.y < y0 ? y0 : y1 };
+    const vec2_t ck = vec2_sub(c, k);
+
+    const float a = vec2_dot(d, d);
+    const float b = vec2_dot(ck, d);
+    const float e = vec2_dot(ck, ck) - r * r;
+    const float disc = b * b - a * e;
+
+    if (e <= 0.0f || disc < 0.0f || b >= 0.0f)
+      return 0;
+
+    const float t = (-b - sqrtf(disc)) / a;
+    if (t >= hit->time)
+      return 0;
+
+    hit->time = fmaxf(t, 0.0f);
+    hit->normal = vec2_norm(vec2_add(ck, vec2_scale(d, t)));
+
+    return 1;
+  }
+
+  if (enter < 0.0f)
+    return 0;
+
+  hit->time = enter;
+  hit->normal = (vec2_t){ 0.0f, 0.0f };
+  if (axis == 0)
+    hit->normal.x = d.x > 0.0f ? -1.0f : 1.0f;
+  else
+    hit->normal.y = d.y > 0.0f ? -1.0f : 1.0f;
+
+  return 1;
+}
+
+/**
+ * @brief Tests the cells of a row or a column the bounds enter.
+ *
+ * Boxes stop at the first solid cell, circles are swept against every
+ * solid one.
+ */
+static int _cells_test(const tilemap_t *tilemap, collider_t collider,
+                       rect_t bounds, vec2_t d, int axis, int line,
+                       int first, int last, float time, tile_hit_t *hit)
+{
+  int res = 0;
+
+  for (int i = first; i <= last; ++i) {
+    const int x = axis == 0 ? line : i;
+    const int y = axis == 0 ? i : line;
+
+    if (!_cell_solid(tilemap, x, y))
+      continue;
+
+    if (collider.type == COLLIDER_TYPE_AABB) {
+      hit->time = time;
+      hit->normal = (vec2_t){ 0.0f, 0.0f };
+      if (axis == 0)
+        hit->normal.x = d.x > 0.0f ? -1.0f : 1.0f;
+      else
+        hit->normal.y = d.y > 0.0f ? -1.0f : 1.0f;
+
+      return 1;
+    }
+
+    res |= _circle_cell_sweep(rect_center(bounds), collider.bounds.radius,
+                              d, x, y, hit);
+  }
+
+  return res;
+}
+
+int tilemap_sweep(const tilemap_t *tilemap, vec2_t pos, vec2_t delta,
+                  collider_t collider, tile_hit_t *hit)
+{
+  const rect_t bounds = _collider_bounds(pos, collider);
+  const float d[2]  = { delta.x, delta.y };
+  const float lo[2] = { bounds.x, bounds.y };
+  const float hi[2] = { bounds.x + bounds.width, bounds.y + bounds.height };
+
+  tile_hit_t res = { .time = 1.0f };
+  int found = 0;
+
+  // a circle might touch the cells its bounds already overlap
+  if (collider.type == COLLIDER_TYPE_CIRCLE) {
+    int x0, x1, y0, y1;
+    _span_cells(lo[0], hi[0], &x0, &x1);
+    _span_cells(lo[1], hi[1], &y0, &y1);
+
+    for (int y = y0; y <= y1; ++y)
+      for (int x = x0; x <= x1; ++x)
+        if (_cell_solid(tilemap, x, y))
+          found |= _circle_cell_sweep(rect_center(bounds),
+                                      collider.bounds.radius, delta, x, y,
+                                      &res);
+  }
+
+  // the grid is traversed by the leading edges, every step enters
+  // a row or a column of cells
+  int   line[2];
+  int   step[2];
+  float next[2];
+  float span[2];
+
+  for (int i = 0; i < 2; ++i) {
+    if (d[i] > 0.0f) {
+      line[i] = (int)ceilf((hi[i] - COLLISION_EPSILON) / TILEMAP_TILE_SIZE);
+      next[i] = (line[i] * TILEMAP_TILE_SIZE - hi[i]) / d[i];
+      step[i] = 1;
+    } else if (d[i] < 0.0f) {
+      line[i] = (int)floorf((lo[i] + COLLISION_EPSILON) / TILEMAP_TILE_SIZE);
+      next[i] = (line[i] * TILEMAP_TILE_SIZE - lo[i]) / d[i];
+      line[i] -= 1;
+      step[i] = -1;
+    } else {
+      line[i] = 0;
+      next[i] = INFINITY;
+      step[i] = 0;
+    }
+
+    span[i] = d[i] != 0.0f ? TILEMAP_TILE_SIZE / fabsf(d[i]) : INFINITY;
+  }
+
+  for (;;) {
+    const int axis = next[0] <= next[1] ? 0 : 1;
+    const float time = fmaxf(next[axis], 0.0f);
+
+    if (time >= res.time || (found && collider.type == COLLIDER_TYPE_AABB))
+      break;
+
+    // the cells of the other axis the bounds overlap at that time
+    const int other = 1 - axis;
+    int first, last;
+    _span_cells(lo[other] + d[other] * time, hi[other] + d[other] * time,
+                &first, &last);
+
+    // the lines of the other axis crossed at the same time are already
+    // entered, so the diagonal cell isn't skipped
+    if (step[other] > 0 && last < line[other] - 1)
+      last = line[other] - 1;
+    else if (step[other] < 0 && first > line[other] + 1)
+      first = line[other] + 1;
+
+    found |= _cells_test(tilemap, collider, bounds, delta, axis,
+                         line[axis], first, last, time, &res);
+
+    line[axis] += step[axis];
+    next[axis] += span[axis];
+  }
+
+  if (found && hit)
+    *hit = res;
+
+  return found;
+}
+
+vec2_t tilemap_move(const tilemap_t *tilemap, vec2_t pos, vec2_t delta,
+                    collider_t collider)
+{
+  for (int i = 0; i < COLLISION_MAX_SLIDES; ++i) {
+    const float len = vec2_len(delta);
+    if (len <= COLLISION_SKIN)
+      break;
+
+    tile_hit_t hit;
+    if (!tilemap_sweep(tilemap, pos, delta, collider, &hit))
+      return vec2_add(pos, delta);
+
+    const float time = fmaxf(hit.time - COLLISION_SKIN / len, 0.0f);
+    pos = vec2_add(pos, vec2_scale(delta, time));
+
+    // the rest of the movement slides along the surface
+    delta = vec2_scale(delta, 1.0f - time);
+    delta = vec2_sub(delta, vec2_scale(hit.normal,
+                                       vec2_dot(delta, hit.normal)));
+  }
+
+  return pos;
+}
+
+void tilemap_move_batch(const tilemap_t *tilemap, tile_mover_t *movers,
+                        u32 count)
+{
+  for (u32 i = 0; i < count; ++i) {
+    tile_mover_t *mover = &movers[i];
+    mover->pos = tilemap_move(tilemap, mover->pos, mover->delta,
+                              mover->collider);
+  }
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <oe.h>
+
+#include "core/entity.h"
+#include "core/tilemap.h"
+
+/**
+ * @brief The result of a sweep against the tile grid.
+ *
+ * @var tile_hit_t::time
+ * The fraction of the movement done before the contact, in [0; 1].
+ *
+ * @var tile_hit_t::normal
+ * The normal of the touched surface, pointing away from it.
+ */
+typedef struct tile_hit {
+  float  time;
+  vec2_t normal;
+} tile_hit_t;
+
+/**
+ * @brief A collider moved by tilemap_move_batch().
+ *
+ * @var tile_mover_t::pos
+ * The position of the collider owner, receives the resolved one.
+ *
+ * @var tile_mover_t::delta
+ * The desired movement.
+ */
+typedef struct tile_mover {
+  vec2_t     pos;
+  vec2_t     delta;
+  collider_t collider;
+} tile_mover_t;
+
+/**
+ * @brief Sweeps a collider through the tile grid.
+ *
+ * Cells are visited in the order the collider enters them, so fast
+ * colliders can't pass through thin walls. Cells outside of the map
+ * are solid.
+ *
+ * @param pos      The position of the collider owner.
+ * @param delta    The movement.
+ * @param collider The collider, AABB or circle.
+ * @param hit      Receives the first contact, might be NULL.
+ *
+ * @return Returns 1 if the collider touches a solid cell on its way,
+ *         otherwise returns 0.
+ */
+int tilemap_sweep(const tilemap_t *tilemap, vec2_t pos, vec2_t delta,
+                  collider_t collider, tile_hit_t *hit);
+
+/**
+ * @brief Moves a collider, sliding along the walls it touches.
+ *
+ * @return Returns the resolved position of the collider owner.
+ */
+vec2_t tilemap_move(const tilemap_t *tilemap, vec2_t pos, vec2_t delta,
+                    collider_t collider);
+
+/**
+ * @brief Moves many colliders at once, see tilemap_move().
+ *
+ * Movers don't collide with each other, so disjoint ranges can be
+ * resolved by different jobs.
+ */
+void tilemap_move_batch(const tilemap_t *tilemap, tile_mover_t *movers,
+                        u32 count);
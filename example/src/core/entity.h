@@ -35,6 +35,12 @@ typedef struct collider {
 typedef void(*script_init_fn)(void);
 typedef void(*script_update_fn)(entity_t *self, float dt);
 
+typedef enum script_flag {
+  /* update_fn touches only its own entity and reads the room, so it
+     can be executed in parallel with the other local scripts */
+  SCRIPT_FLAG_LOCAL = 0x1,
+} script_flag_t;
+
 /**
  * @brief Script component.
  *
@@ -43,10 +49,14 @@ typedef void(*script_update_fn)(entity_t *self, float dt);
  *
  * @var script_t::update_fn
  * Function to be called on every frame.
+ *
+ * @var script_t::flags
+ * Combination of script_flag_t values.
  */
 typedef struct script {
   script_init_fn   init_fn;
   script_update_fn update_fn;
+  u32              flags;
 } script_t;
 
 struct entity {
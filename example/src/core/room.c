@@ -3,6 +3,7 @@
 #include "core/room.h"
 #include "core/entity.h"
 #include "core/tilemap.h"
+#include "core/collision.h"
 #include "core/scripting.h"
 
 #include "game/player.h"
@@ -10,7 +11,7 @@
 #include "entity.h"
 
 static entity_t s_entities[MAX_ENTITIES_COUNT] = {
-  (entity_t){
+  {
     .transform = {
       .pos   = { 48.0f, 64.0f },
       .rot   = 0,
@@ -19,8 +20,8 @@ static entity_t s_entities[MAX_ENTITIES_COUNT] = {
 
     .sprite = {
       .tex_id   = 0,
-      .src_rect = (rect_t){ 16.0f, 112.0f, 16.0f, 16.0f },
-      .anchor   = (vec2_t){ 8.0f, 16.0f },
+      .src_rect = { 16.0f, 112.0f, 16.0f, 16.0f },
+      .anchor   = { 8.0f, 16.0f },
       .depth    = 0.0f
     },
 
@@ -33,12 +34,13 @@ static entity_t s_entities[MAX_ENTITIES_COUNT] = {
     .script = {
       .init_fn   = NULL,
       .update_fn = player_update,
+      .flags     = SCRIPT_FLAG_LOCAL,
     }
   }
 };
 
 static u16 s_entity_count = 1;
-static entity_t *s_cur_entity = NULL;
+static __thread entity_t *s_cur_entity = NULL;
 static tilemap_t s_tilemap;
 
 static camera_t s_cam = {
@@ -52,24 +54,52 @@ void room_init(void)
   if (!tilemap_load("assets/tilemaps/test-room.tm", &s_tilemap))
     fatal("failed to load tilemap");
 
+  tilemap_calc_variants(&s_tilemap);
+
   info("room initialized");
 }
 
+static void _update_local_scripts(u32 start, u32 end, void *data)
+{
+  const float dt = *(const float*)data;
+
+  for (u32 i = start; i < end; ++i) {
+    if (!(s_entities[i].script.flags & SCRIPT_FLAG_LOCAL))
+      continue;
+
+    s_cur_entity = &s_entities[i];
+    s_cur_entity->script.update_fn(s_cur_entity, dt);
+  }
+}
+
 void room_update(float dt)
 {
+  profile_begin("room_update");
+
+  // local scripts don't touch each other, so they're updated in
+  // parallel chunks first
+  job_parallel_for(s_entity_count, ROOM_UPDATE_GRAIN,
+                   _update_local_scripts, &dt);
+
   for (u16 i = 0; i < s_entity_count; ++i) {
+    if (s_entities[i].script.flags & SCRIPT_FLAG_LOCAL)
+      continue;
+
     s_cur_entity = &s_entities[i];
     s_cur_entity->script.update_fn(s_cur_entity, dt);
   }
+
+  profile_end();
 }
 
-void room_draw(void)
+static void _draw_entities(u32 start, u32 end, void *data)
 {
-  camera_set(s_cam);
+  (void)data;
 
-  tilemap_draw(&s_tilemap, 0, s_cam);
+  // entities are drawn on top of the tilemap, chunks keep their order
+  draw_set_order(1 + start);
 
-  for (u16 i = 0; i < s_entity_count; ++i) {
+  for (u32 i = start; i < end; ++i) {
     const entity_t *ent = &s_entities[i];
 
     draw_texture_ext(
@@ -82,6 +112,17 @@ void room_draw(void)
       ent->sprite.src_rect, 0, WHITE, 0, ent->sprite.depth
     );
   }
+}
+
+void room_draw(void)
+{
+  camera_set(s_cam);
+
+  draw_set_order(0);
+  tilemap_draw(&s_tilemap, 0, s_cam);
+
+  job_parallel_for(s_entity_count, ROOM_DRAW_GRAIN, _draw_entities, NULL);
+  draw_set_order(0);
 
   camera_reset();
 }
@@ -92,6 +133,12 @@ void room_draw(void)
 
 i32 place_meeting(vec2_t pos)
 {
-  return tilemap_hit(s_tilemap, pos, s_cur_entity->collider);
+  return tilemap_hit(&s_tilemap, pos, s_cur_entity->collider);
+}
+
+vec2_t move_and_collide(vec2_t delta)
+{
+  return tilemap_move(&s_tilemap, s_cur_entity->transform.pos, delta,
+                      s_cur_entity->collider);
 }
 
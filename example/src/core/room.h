@@ -4,6 +4,18 @@
 
 #define MAX_ENTITIES_COUNT 128
 
+// the room is simulated in fixed steps, seconds
+#define ROOM_UPDATE_STEP (1.0 / 60.0)
+
+// the maximum number of steps simulated per frame
+#define ROOM_MAX_UPDATES 8
+
+// the number of entities updated by a single job
+#define ROOM_UPDATE_GRAIN 16
+
+// the number of entities drawn by a single job
+#define ROOM_DRAW_GRAIN 32
+
 extern void room_init(void);
 
 extern void room_update(float dt);
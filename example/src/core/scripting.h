@@ -4,3 +4,10 @@
 
 extern i32 place_meeting(vec2_t pos);
 
+/**
+ * @brief Moves the current entity by delta, sliding along the walls.
+ *
+ * @return Returns the resolved position of the entity.
+ */
+extern vec2_t move_and_collide(vec2_t delta);
+
@@ -5,9 +5,47 @@
 #include <oe.h>
 
 #include "core/tilemap.h"
+#include "core/tilemap_format.h"
 #include "core/entity.h"
 
-#define TILE_COLLISION_OFFSET 8.0f
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#endif
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+// the number of rows a single job computes variants of
+#define TILEMAP_VARIANT_BAND 64
+
+// neighbour mask bits, set if the neighbour is of another type
+#define NEIGHBOUR_LEFT  0x1
+#define NEIGHBOUR_RIGHT 0x2
+#define NEIGHBOUR_TOP   0x4
+#define NEIGHBOUR_BOT   0x8
+
+// variants of the neighbour masks, a strip one tile wide has no
+// variant of its own, so it's drawn as a center or an edge
+static const unsigned char s_variants[16] = {
+  TILE_VARIANT_CENTER, // none
+  TILE_VARIANT_LEFT,   // left
+  TILE_VARIANT_RIGHT,  // right
+  TILE_VARIANT_CENTER, // left, right
+  TILE_VARIANT_TOP,    // top
+  TILE_VARIANT_LTOP,   // left, top
+  TILE_VARIANT_RTOP,   // right, top
+  TILE_VARIANT_TOP,    // left, right, top
+  TILE_VARIANT_BOT,    // bot
+  TILE_VARIANT_LBOT,   // left, bot
+  TILE_VARIANT_RBOT,   // right, bot
+  TILE_VARIANT_BOT,    // left, right, bot
+  TILE_VARIANT_CENTER, // top, bot
+  TILE_VARIANT_LEFT,   // left, top, bot
+  TILE_VARIANT_RIGHT,  // right, top, bot
+  TILE_VARIANT_CENTER, // all
+};
 
 // this variable represents tile origins on texture
 static const struct { int x, y; }
@@ -36,29 +74,75 @@ static const struct { int x, y; }
   },
 };
 
+typedef struct _chunks_decode {
+  const u8                    *data;
+  const tilemap_file_header_t *header;
+  tilemap_t                   *tilemap;
+  i32                          failed;
+} _chunks_decode_t;
+
+static void _chunks_decode(u32 start, u32 end, void *data)
+{
+  _chunks_decode_t *decode = data;
+
+  for (u32 i = start; i < end; ++i) {
+    if (!tilemap_file_decode_chunk(decode->data, decode->header, i,
+                                   decode->tilemap))
+      __atomic_store_n(&decode->failed, 1, __ATOMIC_RELAXED);
+  }
+}
+
 int tilemap_load(const char *filename, tilemap_t *tilemap)
 {
   FILE *fd = fopen(filename, "rb");
-  if (!fd) return 0;
+  if (!fd) {
+    error("failed to open \"%s\" tilemap", filename);
+    return 0;
+  }
 
-  // read width and height of the map
-  fread(&tilemap->width,  sizeof(tilemap->width),  1, fd);
-  fread(&tilemap->height, sizeof(tilemap->height), 1, fd);
+  // the file is read at once, chunks are decoded from memory
+  fseek(fd, 0, SEEK_END);
+  const long size = ftell(fd);
+  fseek(fd, 0, SEEK_SET);
 
-  // allocate memory for cells
-  const int size = tilemap->width * tilemap->height;
+  u8 *data = size > 0 ? malloc(size) : NULL;
+  if (!data || fread(data, 1, size, fd) != (size_t)size) {
+    error("failed to read \"%s\" tilemap", filename);
+    free(data);
+    fclose(fd);
+    return 0;
+  }
+
+  fclose(fd);
+
+  tilemap_file_header_t header;
+  if (!tilemap_file_parse(data, (u32)size, &header)) {
+    error("\"%s\" isn't a tilemap of version %d, files of the original "
+          "format are converted with oe_tm_convert", filename,
+          TILEMAP_FILE_VERSION);
+    free(data);
+    return 0;
+  }
 
-  tilemap->cells = malloc(size * sizeof(tilemap->cells[0]));
+  tilemap->width = header.width;
+  tilemap->height = header.height;
+  tilemap->cells = malloc((size_t)header.width * header.height);
 
   if (!tilemap->cells) {
-    fclose(fd);
+    free(data);
     return 0;
   }
 
-  // read cells
-  fread(tilemap->cells, sizeof(tilemap->cells[0]), size, fd);
+  _chunks_decode_t decode = { data, &header, tilemap, 0 };
+  job_parallel_for(header.chunk_count, 1, _chunks_decode, &decode);
 
-  fclose(fd);
+  free(data);
+
+  if (decode.failed) {
+    error("\"%s\" tilemap is corrupted", filename);
+    tilemap_free(tilemap);
+    return 0;
+  }
 
   return 1;
 }
@@ -71,20 +155,22 @@ void tilemap_free(tilemap_t *tilemap)
 
 int tilemap_save(const char *filename, const tilemap_t *tilemap)
 {
-  FILE *fd = fopen(filename, "wb");
-  if (!fd) return 0;
-
-  // write width and height of the map
-  fwrite(&tilemap->width,  sizeof(tilemap->width),  1, fd);
-  fwrite(&tilemap->height, sizeof(tilemap->height), 1, fd);
+  u32 size;
+  u8 *data = tilemap_file_encode(tilemap, &size);
+  if (!data) return 0;
 
-  // wtite memory for cells
-  const int size = tilemap->width * tilemap->height;
+  FILE *fd = fopen(filename, "wb");
+  if (!fd) {
+    free(data);
+    return 0;
+  }
 
-  fwrite(tilemap->cells, sizeof(tilemap->cells[0]), size, fd);
+  const int res = fwrite(data, 1, size, fd) == size;
 
   fclose(fd);
-  return 1;
+  free(data);
+
+  return res;
 }
 
 void tilemap_draw(const tilemap_t *tilemap, u16 tex_id, camera_t cam)
@@ -121,33 +207,238 @@ void tilemap_draw(const tilemap_t *tilemap, u16 tex_id, camera_t cam)
   }
 }
 
-int tilemap_point_hit(tilemap_t tilemap, vec2_t pos)
+// +------------------------------------------------------------------+
+// |                           autotiling                             |
+// +------------------------------------------------------------------+
+
+/**
+ * @brief Computes variants of the cells [x0; x1) of a row.
+ *
+ * Neighbours outside of the map are of the same type as the cell.
+ * Only the variant nibbles are written, so rows can be computed in
+ * place while their neighbours are read.
+ */
+static void _variants_row(tilemap_t *tilemap, int y, int x0, int x1)
+{
+  const int w = tilemap->width;
+
+  unsigned char *row = (unsigned char*)tilemap->cells + y * w;
+  const unsigned char *up  = y > 0 ? row - w : row;
+  const unsigned char *bot = y < tilemap->height - 1 ? row + w : row;
+
+  int x = x0;
+
+  // the first and the last cells have no neighbours on one side, so
+  // vectors start and end inside the row
+  if (x == 0) {
+    const int t = row[0] >> 4;
+    const int mask =
+      (w > 1 && row[1] >> 4 != t ? NEIGHBOUR_RIGHT : 0) |
+      (up[0]  >> 4 != t ? NEIGHBOUR_TOP : 0) |
+      (bot[0] >> 4 != t ? NEIGHBOUR_BOT : 0);
+    row[0] = (row[0] & 0xf0) | s_variants[mask];
+    ++x;
+  }
+
+#if defined(__SSE2__)
+  const __m128i nibble = _mm_set1_epi8(0x0f);
+  const __m128i bits[4] = {
+    _mm_set1_epi8(NEIGHBOUR_LEFT), _mm_set1_epi8(NEIGHBOUR_RIGHT),
+    _mm_set1_epi8(NEIGHBOUR_TOP),  _mm_set1_epi8(NEIGHBOUR_BOT),
+  };
+#if defined(__SSSE3__)
+  const __m128i lut = _mm_loadu_si128((const __m128i*)s_variants);
+#endif
+
+#define TYPES(ptr) \
+  _mm_and_si128(_mm_srli_epi16(_mm_loadu_si128((const __m128i*)(ptr)), 4), \
+                nibble)
+
+  for (; x + 16 < w && x + 16 <= x1; x += 16) {
+    const __m128i cell = _mm_loadu_si128((const __m128i*)(row + x));
+    const __m128i t = _mm_and_si128(_mm_srli_epi16(cell, 4), nibble);
+
+    const __m128i nb[4] = {
+      TYPES(row + x - 1), TYPES(row + x + 1), TYPES(up + x), TYPES(bot + x),
+    };
+
+    __m128i mask = _mm_setzero_si128();
+    for (int i = 0; i < 4; ++i)
+      mask = _mm_or_si128(mask,
+                          _mm_andnot_si128(_mm_cmpeq_epi8(nb[i], t), bits[i]));
+
+#if defined(__SSSE3__)
+    const __m128i variant = _mm_shuffle_epi8(lut, mask);
+#else
+    // no byte shuffle in SSE2, so the table is looked up by compares,
+    // entries are stored as differences from the center
+    __m128i variant = _mm_setzero_si128();
+    for (int i = 1; i < 16; ++i) {
+      if (s_variants[i] == TILE_VARIANT_CENTER)
+        continue;
+
+      const __m128i eq = _mm_cmpeq_epi8(mask, _mm_set1_epi8(i));
+      variant = _mm_or_si128(variant, _mm_and_si128(
+        eq, _mm_set1_epi8(s_variants[i] ^ TILE_VARIANT_CENTER)
+      ));
+    }
+    variant = _mm_xor_si128(variant, _mm_set1_epi8(TILE_VARIANT_CENTER));
+#endif
+
+    const __m128i res = _mm_or_si128(_mm_andnot_si128(nibble, cell), variant);
+    _mm_storeu_si128((__m128i*)(row + x), res);
+  }
+
+#undef TYPES
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+  const uint8x16_t lut = vld1q_u8(s_variants);
+  const uint8x16_t bits[4] = {
+    vdupq_n_u8(NEIGHBOUR_LEFT), vdupq_n_u8(NEIGHBOUR_RIGHT),
+    vdupq_n_u8(NEIGHBOUR_TOP),  vdupq_n_u8(NEIGHBOUR_BOT),
+  };
+
+  for (; x + 16 < w && x + 16 <= x1; x += 16) {
+    const uint8x16_t cell = vld1q_u8(row + x);
+    const uint8x16_t t = vshrq_n_u8(cell, 4);
+
+    const uint8x16_t nb[4] = {
+      vshrq_n_u8(vld1q_u8(row + x - 1), 4),
+      vshrq_n_u8(vld1q_u8(row + x + 1), 4),
+      vshrq_n_u8(vld1q_u8(up + x), 4),
+      vshrq_n_u8(vld1q_u8(bot + x), 4),
+    };
+
+    uint8x16_t mask = vdupq_n_u8(0);
+    for (int i = 0; i < 4; ++i)
+      mask = vorrq_u8(mask, vbicq_u8(bits[i], vceqq_u8(nb[i], t)));
+
+    const uint8x16_t variant = vqtbl1q_u8(lut, mask);
+    vst1q_u8(row + x, vorrq_u8(vandq_u8(cell, vdupq_n_u8(0xf0)), variant));
+  }
+#endif
+
+  for (; x < x1; ++x) {
+    const int t = row[x] >> 4;
+    const int mask =
+      (row[x - 1] >> 4 != t ? NEIGHBOUR_LEFT : 0) |
+      (x + 1 < w && row[x + 1] >> 4 != t ? NEIGHBOUR_RIGHT : 0) |
+      (up[x]  >> 4 != t ? NEIGHBOUR_TOP : 0) |
+      (bot[x] >> 4 != t ? NEIGHBOUR_BOT : 0);
+    row[x] = (row[x] & 0xf0) | s_variants[mask];
+  }
+}
+
+typedef struct _variants_pass {
+  tilemap_t *tilemap;
+  int        parity;
+} _variants_pass_t;
+
+static void _variants_bands(u32 start, u32 end, void *data)
+{
+  const _variants_pass_t *pass = data;
+  tilemap_t *tilemap = pass->tilemap;
+
+  for (u32 i = start; i < end; ++i) {
+    const int y0 = (i * 2 + pass->parity) * TILEMAP_VARIANT_BAND;
+    const int y1 = y0 + TILEMAP_VARIANT_BAND < tilemap->height ?
+                   y0 + TILEMAP_VARIANT_BAND : tilemap->height;
+
+    for (int y = y0; y < y1; ++y)
+      _variants_row(tilemap, y, 0, tilemap->width);
+  }
+}
+
+void tilemap_calc_variants(tilemap_t *tilemap)
+{
+  profile_begin("tilemap_calc_variants");
+
+  const u32 band_count = (tilemap->height + TILEMAP_VARIANT_BAND - 1) /
+                         TILEMAP_VARIANT_BAND;
+
+  // NOTE: a band reads the border rows of its neighbours, so even and
+  //       odd bands are computed one after another, and no row is
+  //       written while it's read by another job
+  for (int parity = 0; parity < 2; ++parity) {
+    _variants_pass_t pass = { tilemap, parity };
+    job_parallel_for((band_count + 1 - parity) / 2, 1, _variants_bands,
+                     &pass);
+  }
+
+  profile_end();
+}
+
+void tilemap_update_variants(tilemap_t *tilemap, int x, int y)
 {
-  const int x = (int)pos.x / TILEMAP_TILE_SIZE;
-  const int y = (int)pos.y / TILEMAP_TILE_SIZE;
+  const int x0 = x > 0 ? x - 1 : 0;
+  const int x1 = x + 2 < tilemap->width ? x + 2 : tilemap->width;
 
-  return tilemap.cells[y * tilemap.width + x] >> 4;
+  for (int i = y > 0 ? y - 1 : 0; i <= y + 1 && i < tilemap->height; ++i)
+    _variants_row(tilemap, i, x0, x1);
 }
 
-int tilemap_hit(tilemap_t tilemap, vec2_t pos, collider_t collider)
+void tilemap_set_type(tilemap_t *tilemap, int x, int y, tile_type_t type)
+{
+  char *cell = &tilemap->cells[y * tilemap->width + x];
+  *cell = (char)((type << 4) | (*cell & 0x0f));
+
+  tilemap_update_variants(tilemap, x, y);
+}
+
+// +------------------------------------------------------------------+
+// |                            collision                             |
+// +------------------------------------------------------------------+
+
+// cells outside of the map are walls
+static int _cell_type(const tilemap_t *tilemap, int x, int y)
+{
+  if (x < 0 || y < 0 || x >= tilemap->width || y >= tilemap->height)
+    return TILE_TYPE_WALL;
+
+  return (unsigned char)tilemap->cells[y * tilemap->width + x] >> 4;
+}
+
+int tilemap_point_hit(const tilemap_t *tilemap, vec2_t pos)
+{
+  return _cell_type(tilemap, (int)floorf(pos.x / TILEMAP_TILE_SIZE),
+                    (int)floorf(pos.y / TILEMAP_TILE_SIZE));
+}
+
+int tilemap_hit(const tilemap_t *tilemap, vec2_t pos, collider_t collider)
 {
   pos.x += collider.offset.x;
-  pos.y += collider.offset.y - TILE_COLLISION_OFFSET;
-
-  assert(collider.type == COLLIDER_TYPE_AABB,
-         "unsupported collider type.");
-
-  int x1 = pos.x / TILEMAP_TILE_SIZE;
-  int y1 = pos.y / TILEMAP_TILE_SIZE;
-  int x2 = (pos.x + collider.bounds.size.x) / TILEMAP_TILE_SIZE;
-  int y2 = (pos.y + collider.bounds.size.y) / TILEMAP_TILE_SIZE;
-
-  if (
-    (tilemap.cells[x1 + y1 * tilemap.width] >> 4) ||
-    (tilemap.cells[x2 + y1 * tilemap.width] >> 4) ||
-    (tilemap.cells[x2 + y2 * tilemap.width] >> 4) ||
-    (tilemap.cells[x1 + y2 * tilemap.width] >> 4)
-  ) { return 1; }
+  pos.y += collider.offset.y - TILEMAP_COLLISION_OFFSET;
+
+  const float r = collider.bounds.radius;
+  const rect_t bounds = collider.type == COLLIDER_TYPE_CIRCLE ?
+    (rect_t){ pos.x - r, pos.y - r, r * 2.0f, r * 2.0f } :
+    (rect_t){ pos.x, pos.y, collider.bounds.size.x,
+              collider.bounds.size.y };
+
+  const int x1 = (int)floorf(bounds.x / TILEMAP_TILE_SIZE);
+  const int y1 = (int)floorf(bounds.y / TILEMAP_TILE_SIZE);
+  const int x2 = (int)floorf((bounds.x + bounds.width) / TILEMAP_TILE_SIZE);
+  const int y2 = (int)floorf((bounds.y + bounds.height) / TILEMAP_TILE_SIZE);
+
+  // every overlapped cell is tested, so colliders larger than a tile
+  // don't miss the walls between their corners
+  for (int y = y1; y <= y2; ++y) {
+    for (int x = x1; x <= x2; ++x) {
+      if (!_cell_type(tilemap, x, y))
+        continue;
+
+      if (collider.type == COLLIDER_TYPE_AABB)
+        return 1;
+
+      // the closest point of the cell to the circle center
+      const vec2_t cell = {
+        clamp(pos.x, x * TILEMAP_TILE_SIZE, (x + 1) * TILEMAP_TILE_SIZE),
+        clamp(pos.y, y * TILEMAP_TILE_SIZE, (y + 1) * TILEMAP_TILE_SIZE),
+      };
+
+      if (vec2_len_sq(vec2_sub(cell, pos)) < r * r)
+        return 1;
+    }
+  }
 
   return 0;
 }
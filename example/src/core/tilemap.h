@@ -6,6 +6,9 @@
 
 #define TILEMAP_TILE_SIZE 16
 
+// colliders are tested against the grid shifted up by this, in pixels
+#define TILEMAP_COLLISION_OFFSET 8.0f
+
 typedef enum tile_type {
   TILE_TYPE_FLOOR,
   TILE_TYPE_WALL,
@@ -35,17 +38,41 @@ typedef struct tilemap {
   char     *cells;
 } tilemap_t;
 
+/**
+ * @brief Loads a tilemap, see tilemap_format.h for the file format.
+ *
+ * Chunks of the file are decoded in parallel jobs.
+ *
+ * @return Returns 1 on success, otherwise returns 0.
+ */
 int  tilemap_load(const char *filename, tilemap_t *tilemap);
 int  tilemap_save(const char *filename, const tilemap_t *tilemap);
 void tilemap_free(tilemap_t *tilemap);
 
+/**
+ * @brief Computes variants of all the cells from their neighbours of
+ *        other types.
+ *
+ * Rows are computed in parallel jobs.
+ */
 void tilemap_calc_variants(tilemap_t *tilemap);
 
+/**
+ * @brief Recomputes variants of the cell and its neighbours, should
+ *        be called after the type of the cell is changed.
+ */
+void tilemap_update_variants(tilemap_t *tilemap, int x, int y);
+
+/**
+ * @brief Changes the type of the cell and updates the variants.
+ */
+void tilemap_set_type(tilemap_t *tilemap, int x, int y, tile_type_t type);
+
 void tilemap_draw(
   const tilemap_t *tilemap, u16 tex_id, camera_t cam
 );
 
-int tilemap_point_hit(tilemap_t tilemap, vec2_t pos);
+int tilemap_point_hit(const tilemap_t *tilemap, vec2_t pos);
 
-int tilemap_hit(tilemap_t tilemap, vec2_t pos, collider_t collider);
+int tilemap_hit(const tilemap_t *tilemap, vec2_t pos, collider_t collider);
 
@@ -0,0 +1,254 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <oe.h>
+
+#include "core/tilemap_format.h"
+
+// the longest RLE runs and literal sequences
+#define RLE_MAX_RUN     129
+#define RLE_MAX_LITERAL 128
+
+// the worst case is a literal token per RLE_MAX_LITERAL cells
+#define RLE_BOUND(size) ((size) + (size) / RLE_MAX_LITERAL + 1)
+
+static void _put_u16(u8 *dst, u16 val)
+{
+  dst[0] = val & 0xff;
+  dst[1] = val >> 8;
+}
+
+static void _put_u32(u8 *dst, u32 val)
+{
+  for (int i = 0; i < 4; ++i)
+    dst[i] = (val >> (i * 8)) & 0xff;
+}
+
+static u16 _get_u16(const u8 *src)
+{
+  return (u16)(src[0] | src[1] << 8);
+}
+
+static u32 _get_u32(const u8 *src)
+{
+  return (u32)src[0] | (u32)src[1] << 8 | (u32)src[2] << 16 |
+         (u32)src[3] << 24;
+}
+
+static u32 _chunk_rows(const tilemap_file_header_t *header, u32 ind)
+{
+  const u32 y = ind * header->chunk_rows;
+  return header->height - y < header->chunk_rows ? header->height - y :
+                                                   header->chunk_rows;
+}
+
+// +------------------------------------------------------------------+
+// |                              RLE                                 |
+// +------------------------------------------------------------------+
+
+static u32 _rle_encode(const u8 *src, u32 size, u8 *dst)
+{
+  u32 len = 0;
+  u32 i = 0;
+
+  while (i < size) {
+    u32 run = 1;
+    while (i + run < size && run < RLE_MAX_RUN && src[i + run] == src[i])
+      ++run;
+
+    if (run >= 3) {
+      dst[len++] = (u8)(run + 126);
+      dst[len++] = src[i];
+      i += run;
+      continue;
+    }
+
+    // literals go until the next run of 3 cells
+    u32 count = 0;
+    while (
+      i + count < size && count < RLE_MAX_LITERAL &&
+      !(i + count + 2 < size && src[i + count] == src[i + count + 1] &&
+        src[i + count] == src[i + count + 2])
+    )
+      ++count;
+
+    dst[len++] = (u8)(count - 1);
+    memcpy(dst + len, src + i, count);
+    len += count;
+    i += count;
+  }
+
+  return len;
+}
+
+static int _rle_decode(const u8 *src, u32 size, u8 *dst, u32 dst_size)
+{
+  u32 len = 0;
+  u32 i = 0;
+
+  while (i < size) {
+    const u8 t = src[i++];
+
+    if (t < 128) {
+      const u32 count = t + 1u;
+      if (i + count > size || len + count > dst_size)
+        return 0;
+
+      memcpy(dst + len, src + i, count);
+      i += count;
+      len += count;
+    } else {
+      const u32 count = t - 126u;
+      if (i >= size || len + count > dst_size)
+        return 0;
+
+      memset(dst + len, src[i++], count);
+      len += count;
+    }
+  }
+
+  return len == dst_size;
+}
+
+// +------------------------------------------------------------------+
+// |                             file                                 |
+// +------------------------------------------------------------------+
+
+u8 *tilemap_file_encode(const tilemap_t *tilemap, u32 *size)
+{
+  tilemap_file_header_t header = {
+    .version     = TILEMAP_FILE_VERSION,
+    .layer_count = 1,
+    .width       = tilemap->width,
+    .height      = tilemap->height,
+    .chunk_rows  = TILEMAP_FILE_CHUNK_ROWS,
+  };
+  header.chunk_count = (header.height + header.chunk_rows - 1) /
+                       header.chunk_rows;
+
+  const u32 cell_count = header.width * header.height;
+  const u32 table_size = header.chunk_count * 8;
+  const u32 capacity = TILEMAP_FILE_HEADER_SIZE + table_size +
+                       RLE_BOUND(cell_count) + header.chunk_count;
+
+  u8 *data = malloc(capacity);
+  if (!data)
+    return NULL;
+
+  memcpy(data, TILEMAP_FILE_MAGIC, 4);
+  _put_u16(data + 4, header.version);
+  _put_u16(data + 6, header.layer_count);
+  _put_u32(data + 8, header.width);
+  _put_u32(data + 12, header.height);
+  _put_u32(data + 16, header.chunk_rows);
+  _put_u32(data + 20, header.chunk_count);
+
+  u32 offset = TILEMAP_FILE_HEADER_SIZE + table_size;
+
+  for (u32 i = 0; i < header.chunk_count; ++i) {
+    const u8 *cells = (const u8*)tilemap->cells +
+                      i * header.chunk_rows * header.width;
+    const u32 chunk_size = _rle_encode(
+      cells, _chunk_rows(&header, i) * header.width, data + offset
+    );
+
+    u8 *entry = data + TILEMAP_FILE_HEADER_SIZE + i * 8;
+    _put_u32(entry, offset);
+    _put_u32(entry + 4, chunk_size);
+
+    offset += chunk_size;
+  }
+
+  *size = offset;
+
+  return data;
+}
+
+int tilemap_file_parse(const u8 *data, u32 size,
+                       tilemap_file_header_t *header)
+{
+  if (size < TILEMAP_FILE_HEADER_SIZE || memcmp(data, TILEMAP_FILE_MAGIC, 4))
+    return 0;
+
+  header->version     = _get_u16(data + 4);
+  header->layer_count = _get_u16(data + 6);
+  header->width       = _get_u32(data + 8);
+  header->height      = _get_u32(data + 12);
+  header->chunk_rows  = _get_u32(data + 16);
+  header->chunk_count = _get_u32(data + 20);
+
+  // NOTE: the chunk count is computed in 64 bits, so large chunk rows
+  //       don't wrap it around, a file written for a map shorter than
+  //       a chunk still has one chunk
+  if (
+    header->version != TILEMAP_FILE_VERSION ||
+    header->layer_count != 1 ||
+    !header->width || header->width > TILEMAP_FILE_MAX_SIZE ||
+    !header->height || header->height > TILEMAP_FILE_MAX_SIZE ||
+    !header->chunk_rows || !header->chunk_count ||
+    header->chunk_count != ((u64)header->height + header->chunk_rows - 1) /
+                           header->chunk_rows
+  )
+    return 0;
+
+  const u32 table_end = TILEMAP_FILE_HEADER_SIZE + header->chunk_count * 8;
+  if (table_end > size)
+    return 0;
+
+  for (u32 i = 0; i < header->chunk_count; ++i) {
+    const u8 *entry = data + TILEMAP_FILE_HEADER_SIZE + i * 8;
+    const u32 offset = _get_u32(entry);
+    const u32 chunk_size = _get_u32(entry + 4);
+
+    if (offset < table_end || offset > size || chunk_size > size - offset)
+      return 0;
+  }
+
+  return 1;
+}
+
+int tilemap_file_decode_chunk(const u8 *data,
+                              const tilemap_file_header_t *header,
+                              u32 ind, tilemap_t *tilemap)
+{
+  const u8 *entry = data + TILEMAP_FILE_HEADER_SIZE + ind * 8;
+  u8 *cells = (u8*)tilemap->cells + ind * header->chunk_rows * header->width;
+
+  return _rle_decode(data + _get_u32(entry), _get_u32(entry + 4), cells,
+                     _chunk_rows(header, ind) * header->width);
+}
+
+int tilemap_file_load_legacy(const char *filename, tilemap_t *tilemap)
+{
+  FILE *fd = fopen(filename, "rb");
+  if (!fd) return 0;
+
+  int width, height;
+  if (
+    fread(&width, sizeof(width), 1, fd) != 1 ||
+    fread(&height, sizeof(height), 1, fd) != 1 ||
+    width <= 0 || width > TILEMAP_FILE_MAX_SIZE ||
+    height <= 0 || height > TILEMAP_FILE_MAX_SIZE
+  ) {
+    fclose(fd);
+    return 0;
+  }
+
+  const size_t size = (size_t)width * height;
+  char *cells = malloc(size);
+
+  if (!cells || fread(cells, 1, size, fd) != size) {
+    free(cells);
+    fclose(fd);
+    return 0;
+  }
+
+  fclose(fd);
+
+  tilemap->width = width;
+  tilemap->height = height;
+  tilemap->cells = cells;
+
+  return 1;
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <oe.h>
+
+#include "core/tilemap.h"
+
+/*
+ * Tilemap file layout, all the fields are little endian:
+ *
+ *   char magic[4]     "OETM"
+ *   u16  version      TILEMAP_FILE_VERSION
+ *   u16  layer_count  only 1 is supported for now
+ *   u32  width
+ *   u32  height
+ *   u32  chunk_rows   the number of rows in a chunk
+ *   u32  chunk_count  layer_count * ceil(height / chunk_rows)
+ *   { u32 offset, u32 size } chunks[chunk_count]
+ *   chunk payloads
+ *
+ * A chunk keeps the cells of chunk_rows rows compressed with RLE, so
+ * chunks can be decoded in parallel. The payload is a sequence of
+ * tokens: a byte t < 128 is followed by t + 1 literal cells, a byte
+ * t >= 128 is followed by a single cell repeated t - 126 times.
+ */
+
+#define TILEMAP_FILE_MAGIC       "OETM"
+#define TILEMAP_FILE_VERSION     1
+#define TILEMAP_FILE_HEADER_SIZE 24
+#define TILEMAP_FILE_CHUNK_ROWS  64
+#define TILEMAP_FILE_MAX_SIZE    16384 // maximum width and height
+
+typedef struct tilemap_file_header {
+  u32 version;
+  u32 layer_count;
+  u32 width;
+  u32 height;
+  u32 chunk_rows;
+  u32 chunk_count;
+} tilemap_file_header_t;
+
+/**
+ * @brief Encodes the tilemap into a file image.
+ *
+ * @param size Receives the size of the image.
+ *
+ * @return Returns the image to be freed with free(), or NULL if
+ *         there is not enough memory.
+ */
+u8 *tilemap_file_encode(const tilemap_t *tilemap, u32 *size);
+
+/**
+ * @brief Validates the header and the chunk table of a file image.
+ *
+ * @return Returns 1 if chunks can be decoded, otherwise returns 0.
+ */
+int tilemap_file_parse(const u8 *data, u32 size,
+                       tilemap_file_header_t *header);
+
+/**
+ * @brief Decodes a single chunk into the tilemap cells.
+ *
+ * The tilemap should have the size from the header and allocated
+ * cells. Different chunks can be decoded by different threads.
+ *
+ * @return Returns 1 on success, or 0 if the chunk is corrupted.
+ */
+int tilemap_file_decode_chunk(const u8 *data,
+                              const tilemap_file_header_t *header,
+                              u32 ind, tilemap_t *tilemap);
+
+/**
+ * @brief Loads a tilemap of the original format, int width and height
+ *        in the host byte order followed by raw cells.
+ *
+ * @return Returns 1 on success, otherwise returns 0.
+ */
+int tilemap_file_load_legacy(const char *filename, tilemap_t *tilemap);
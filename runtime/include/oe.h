@@ -30,19 +30,7 @@ typedef double f64;
 // |                              math                                |
 // +------------------------------------------------------------------+
 
-/**
- * @brief 2 dimensional vector.
- */
-typedef struct vec2 { f32 x, y; } vec2_t;
-
-extern vec2_t vec2_add(vec2_t v1, vec2_t v2);
-
-extern vec2_t vec2_sub(vec2_t v1, vec2_t v2);
-
-/**
- * @brief 2 dimensional vector.
- */
-typedef struct vec3 { f32 x, y, z; } vec3_t;
+#include "oe_math.h"
 
 // +------------------------------------------------------------------+
 // |                        initialization                            |
@@ -66,6 +54,11 @@ extern void init(u16 width, u16 height, const char *title);
  * Initializes oe subsystems, opens window and creates surface for
  * rendering graphics.
  *
+ * Frames of an explicit resolution are rendered into a target of
+ * that size, which is upscaled to the window by the largest integer
+ * factor that fits, so pixel art stays crisp and only the target
+ * pixels are filled by sprites.
+ *
  * @param width  The width of the window.
  * @param heitgh The height of the window.
  * @param resx   Horizontal resolution. Leave as 0 to fit the
@@ -77,6 +70,19 @@ extern void init(u16 width, u16 height, const char *title);
 extern void init_ext(u16 width, u16 height, u16 resx, u16 resy,
                      const char *title);
 
+/**
+ * @brief Initializes oe in the headless mode.
+ *
+ * Initializes oe subsystems without opening a window. Frames are
+ * rendered into offscreen images, which can be read back with
+ * read_frame(). should_close() always returns 0 in this mode and
+ * input functions report no input.
+ *
+ * @param resx Horizontal resolution.
+ * @param resy Vertical resolution.
+ */
+extern void init_headless(u16 resx, u16 resy);
+
 /**
  * @brief Terminares oe.
  *
@@ -259,6 +265,99 @@ typedef enum btn {
   BTN_MIDDLE,
 } btn_t;
 
+/**
+ * @brief Input event type.
+ */
+typedef enum input_event_type {
+  INPUT_EVENT_KEY_DOWN,
+  INPUT_EVENT_KEY_UP,
+  INPUT_EVENT_BTN_DOWN,
+  INPUT_EVENT_BTN_UP,
+  INPUT_EVENT_WHEEL,
+  INPUT_EVENT_MOTION,
+} input_event_type_t;
+
+/**
+ * @brief Input event.
+ *
+ * Only the field matching the event type is set.
+ */
+typedef struct input_event {
+  u64                time; // get_time_ns() when the change was sampled
+  input_event_type_t type;
+  key_t              key;
+  btn_t              btn;
+  float              wheel;
+  vec2_t             pos;
+} input_event_t;
+
+/**
+ * @brief Samples input right away.
+ *
+ * should_close() samples input once a frame, changes between two
+ * samples are seen as simultaneous. Calling this function in the
+ * middle of a long frame gives events more precise timestamps and
+ * catches presses that are shorter than a frame. In headless mode
+ * only replayed input is sampled.
+ */
+extern void input_poll(void);
+
+/**
+ * @brief Pops the oldest input event of this frame.
+ *
+ * Events are kept until the next should_close() call, the ones that
+ * weren't popped by then are discarded.
+ *
+ * @param event Receives the event.
+ *
+ * @return Returns 1 if an event was popped, or 0 if there are no
+ *         events left.
+ */
+extern i32 input_event_next(input_event_t *event);
+
+/**
+ * @brief Starts recording input to a file.
+ *
+ * Every input sample is written starting from the next frame, along
+ * with the delta time returned by frame_timer_tick(). Should be
+ * called outside of a frame, e.g. right before the main loop.
+ *
+ * @param path The path to the file, it's overwritten.
+ *
+ * @return Returns 1 on success, otherwise returns 0.
+ */
+extern i32 input_record_begin(const char *path);
+
+/**
+ * @brief Finishes input recording. Called by quit() as well.
+ */
+extern void input_record_end(void);
+
+/**
+ * @brief Starts replaying input from a recording.
+ *
+ * Starting from the next frame, input comes from the recording
+ * instead of the window, and frame_timer_tick() returns the recorded
+ * delta time, so the app receives the same input on the same frames
+ * as it did while recording. Works in headless mode as well. The
+ * replay ends on its own after the last recorded frame.
+ *
+ * @param path The path to the recording.
+ *
+ * @return Returns 1 on success, otherwise returns 0.
+ */
+extern i32 input_replay_begin(const char *path);
+
+/**
+ * @brief Finishes input replay. Called by quit() as well.
+ */
+extern void input_replay_end(void);
+
+/**
+ * @brief Returns whether input is being replayed or not.
+ */
+extern i32 input_replay_active(void);
+
 /**
  * @brief Returns whether the key was just pressed this frame or not.
  */
@@ -320,17 +419,49 @@ extern float mouse_wheel(void);
 typedef u32 color_t;
 
 /**
- * @brief Rectangle.
+ * @brief Texture handle.
  */
-typedef struct rect {
-  f32 x, y;
-  f32 width, height;
-} rect_t;
+typedef struct texture* texture_t;
 
 /**
- * @brief Texture handle.
+ * @brief Texture filtering within a mip level.
  */
-typedef struct texture* texture_t;
+typedef enum texture_filter {
+  TEXTURE_FILTER_NEAREST, // crisp pixels
+  TEXTURE_FILTER_LINEAR,  // bilinear
+  TEXTURE_FILTER_MAX
+} texture_filter_t;
+
+/**
+ * @brief Texture mip chain and filtering between its levels.
+ */
+typedef enum texture_mip {
+  TEXTURE_MIP_NONE,    // only the full resolution level
+  TEXTURE_MIP_NEAREST, // the closest level is sampled
+  TEXTURE_MIP_LINEAR,  // two closest levels are blended
+  TEXTURE_MIP_MAX
+} texture_mip_t;
+
+/**
+ * @brief Texture coordinates handling outside of [0; 1].
+ */
+typedef enum texture_wrap {
+  TEXTURE_WRAP_REPEAT,
+  TEXTURE_WRAP_CLAMP,
+  TEXTURE_WRAP_MAX
+} texture_wrap_t;
+
+/**
+ * @brief Texture sampling parameters.
+ *
+ * Zero initialized parameters are nearest filtered, repeated and
+ * without mips, as textures loaded by texture_load().
+ */
+typedef struct texture_params {
+  texture_filter_t filter;
+  texture_mip_t    mip;
+  texture_wrap_t   wrap;
+} texture_params_t;
 
 /**
  * @brief Camera.
@@ -349,6 +480,48 @@ typedef struct camera {
  */
 extern void draw_begin(color_t color);
 
+/**
+ * @brief Layer drawing function.
+ *
+ * @param layer The index of the layer.
+ * @param data  User data passed to draw_layers().
+ */
+typedef void (*draw_layer_fn)(u32 layer, void *data);
+
+/**
+ * @brief Draws layers in parallel.
+ *
+ * Calls fn for every layer on the job system threads. Sprites drawn
+ * by the function are recorded into the layer's own secondary
+ * command buffer. Layers are drawn in the index order on top of
+ * everything drawn before the call.
+ *
+ * Should be called between draw_begin() and draw_end().
+ *
+ * @param count The number of layers.
+ * @param fn    The layer drawing function.
+ * @param data  User data passed to the function.
+ */
+extern void draw_layers(u32 count, draw_layer_fn fn, void *data);
+
+/**
+ * @brief Sets the draw order key of the calling thread.
+ *
+ * Sprites can be drawn from the main thread and from jobs, every
+ * thread fills its own queue, other threads can't draw. Queues are
+ * merged at draw_layers() and draw_end() calls by the order key, so
+ * sprites with lower keys are drawn first. Sprites with equal keys
+ * from the same thread keep their drawing order.
+ *
+ * The key is thread-local and persists between frames, so every job
+ * that draws should set its own. Give parallel jobs distinct keys
+ * for an order independent of scheduling. Jobs have to be finished
+ * before the next draw_layers() or draw_end() call.
+ *
+ * @param order The order key, 0 by default.
+ */
+extern void draw_set_order(u32 order);
+
 /**
  * @brief Ends frame drawing and presents drawn frame.
  */
@@ -359,6 +532,138 @@ extern void draw_end(void);
  */
 extern void draw_wait(void);
 
+/**
+ * @brief Statistics of a drawn frame.
+ *
+ * Work done between draw_end() calls is counted in the next frame,
+ * e.g. textures loaded between frames.
+ */
+typedef struct gfx_frame_stats {
+  u32 quads;          // the number of submitted quads
+  u32 draw_calls;
+  u32 pipeline_binds;
+  u32 texture_binds;  // the number of texture_bind() calls
+  u64 bytes_uploaded; // vertex and uniform data written for gpu
+  u32 staging_allocs; // the number of created staging buffers
+  f64 fence_wait_ms;  // waiting for the frame's resources to be free
+  f64 acquire_ms;     // acquiring a swapchain image
+  f64 present_ms;
+} gfx_frame_stats_t;
+
+#define GFX_FRAME_STATS_WINDOW 64
+
+/**
+ * @brief Statistics averaged over the last GFX_FRAME_STATS_WINDOW
+ *        drawn frames.
+ */
+typedef struct gfx_frame_stats_avg {
+  u32 frame_count; // the number of frames averaged
+  f64 quads;
+  f64 draw_calls;
+  f64 pipeline_binds;
+  f64 texture_binds;
+  f64 bytes_uploaded;
+  f64 staging_allocs;
+  f64 fence_wait_ms;
+  f64 acquire_ms;
+  f64 present_ms;
+} gfx_frame_stats_avg_t;
+
+/**
+ * @brief Returns statistics of the last frame finished with
+ *        draw_end().
+ */
+extern gfx_frame_stats_t gfx_frame_stats_get(void);
+
+/**
+ * @brief Returns rolling averages of the frame statistics.
+ */
+extern gfx_frame_stats_avg_t gfx_frame_stats_avg_get(void);
+
+#define GFX_MAX_TIMED_PASSES 64
+
+/**
+ * @brief Gpu timings of a drawn frame.
+ *
+ * A pass is a batch of sprites drawn outside of layers, or a single
+ * layer of draw_layers(), passes that had nothing to draw aren't
+ * counted.
+ */
+typedef struct gfx_gpu_stats {
+  u64 frame;      // the number of the frame, 0 if nothing is measured
+  f64 frame_ms;   // time the whole frame took on gpu
+  u32 pass_count;
+  f64 pass_ms[GFX_MAX_TIMED_PASSES];
+} gfx_gpu_stats_t;
+
+/**
+ * @brief Returns gpu timings of the last resolved frame.
+ *
+ * Timings are resolved without stalling when the frame's resources
+ * are reused, so they lag behind by the number of frames in flight.
+ * All the fields are zeros if gpu doesn't support timestamps.
+ */
+extern gfx_gpu_stats_t gfx_gpu_stats_get(void);
+
+/**
+ * @brief Logs gpu timings every interval frames.
+ *
+ * @param interval The number of frames between logs, 0 disables
+ *                 logging.
+ */
+extern void gfx_gpu_stats_log(u32 interval);
+
+/**
+ * @brief Dynamic resolution settings.
+ */
+typedef struct gfx_dynres {
+  f64 target_ms; // gpu frame time budget
+  f32 min_scale; // the lowest render scale, e.g. 0.5
+  f32 max_scale; // the highest render scale, at most 1
+} gfx_dynres_t;
+
+/**
+ * @brief Enables dynamic resolution.
+ *
+ * Frames are drawn to the part of the target scaled by the render
+ * scale, which follows the measured gpu frame time: it goes down
+ * quickly when frames are over the budget, and up slowly when they
+ * have enough headroom. The frame is upscaled to the same place on
+ * the screen anyway.
+ *
+ * Requires explicit resolution, see init_ext(), pass the window size
+ * to scale native resolution frames. Requires gpu timestamps.
+ *
+ * @param dynres The settings, the current scale is kept within the
+ *               new bounds if it's already enabled.
+ */
+extern void gfx_dynres_enable(gfx_dynres_t dynres);
+
+/**
+ * @brief Disables dynamic resolution, frames are drawn to the whole
+ *        target.
+ */
+extern void gfx_dynres_disable(void);
+
+/**
+ * @brief Returns the current render scale, 1 if dynamic resolution
+ *        is disabled.
+ */
+extern f32 gfx_render_scale_get(void);
+
+/**
+ * @brief Reads the last drawn frame back to the host memory.
+ *
+ * Waits for gpu to finish the frame. Supported only in the headless
+ * mode.
+ *
+ * @param pixels The buffer of resx * resy * 4 bytes, receives RGBA
+ *               pixels row by row from the top.
+ *
+ * @return Returns 1 on success, or 0 if there is no frame drawn yet.
+ */
+extern i32 read_frame(u8 *pixels);
+
 /**
  * @brief Sets camera.
  */
@@ -371,9 +676,77 @@ extern void camera_reset(void);
 
 /**
  * @brief Sets window resolution.
+ *
+ * Sets the target resolution if oe is initialized with an explicit
+ * one, see init_ext(). If called during a frame, the resolution is
+ * applied from the next one.
  */
 extern void set_resolution(u16 x, u16 y);
 
+/**
+ * @brief Swapchain present mode.
+ */
+typedef enum present_mode {
+  PRESENT_MODE_FIFO,         // vsync, always supported
+  PRESENT_MODE_FIFO_RELAXED, // vsync, tears if frame is late
+  PRESENT_MODE_MAILBOX,      // no tearing, the latest frame is shown
+  PRESENT_MODE_IMMEDIATE,    // no vsync, tears
+  PRESENT_MODE_MAX
+} present_mode_t;
+
+/**
+ * @brief Returns whether the window surface supports present mode.
+ *
+ * Should be called after init(), returns 0 for all modes except
+ * PRESENT_MODE_FIFO otherwise.
+ */
+extern i32 is_present_mode_supported(present_mode_t mode);
+
+/**
+ * @brief Sets present mode.
+ *
+ * Can be called before init(). If the mode isn't supported by the
+ * surface, PRESENT_MODE_FIFO is used instead. PRESENT_MODE_MAILBOX
+ * is used by default. If called during a frame, the mode is applied
+ * from the next one.
+ *
+ * @param mode The present mode.
+ */
+extern void set_present_mode(present_mode_t mode);
+
+/**
+ * @brief Returns requested present mode.
+ */
+extern present_mode_t get_present_mode(void);
+
+/**
+ * @brief Latency mode, the number of frames CPU can prepare ahead
+ *        of GPU.
+ */
+typedef enum latency_mode {
+  LATENCY_MODE_LOW        = 1, // the lowest input latency
+  LATENCY_MODE_BALANCED   = 2,
+  LATENCY_MODE_THROUGHPUT = 3, // the highest frame rate
+} latency_mode_t;
+
+/**
+ * @brief Sets latency mode.
+ *
+ * The number of frames in flight doesn't depend on the number of
+ * swapchain images. Can be called before init(), otherwise should
+ * be called outside of draw_begin() and draw_end(), as it waits
+ * for GPU to finish all the frames. LATENCY_MODE_BALANCED is used
+ * by default.
+ *
+ * @param mode The latency mode.
+ */
+extern void set_latency_mode(latency_mode_t mode);
+
+/**
+ * @brief Returns current latency mode.
+ */
+extern latency_mode_t get_latency_mode(void);
+
 /**
  * @brief Draws colored rectangle.
  */
@@ -406,6 +779,23 @@ extern void draw_texture_ext(rect_t dst_rect, rect_t src_rect, u32 tex_ind,
  */
 extern texture_t texture_load(const char *path);
 
+/**
+ * @brief Loads texture with the sampling parameters.
+ *
+ * Textures with mips get the full chain generated on the GPU at load
+ * time, so zoomed out views sample smaller levels instead of the full
+ * resolution. Samplers are shared between textures with the same
+ * parameters.
+ *
+ * @param path   The path to the texture file.
+ * @param params The sampling parameters.
+ *
+ * @return Returns an oe texture handle on success, otherwise
+ *         returns OE_NULL_HANDLE.
+ */
+extern texture_t texture_load_ext(const char *path,
+                                  texture_params_t params);
+
 /**
  * @brief Frees texture.
  *
@@ -418,12 +808,431 @@ extern void texture_free(texture_t texture);
  */
 extern void texture_bind(texture_t texture, u32 ind);
 
+// +------------------------------------------------------------------+
+// |                            text                                  |
+// +------------------------------------------------------------------+
+
+/**
+ * @brief Font handle.
+ */
+typedef struct font* font_t;
+
+/**
+ * @brief Loads a bitmap font.
+ *
+ * Fonts are loaded from BMFont text descriptions with a single page,
+ * the page texture path is relative to the description. Glyphs of the
+ * first 256 code points are looked up directly, the others and the
+ * kerning pairs by binary search.
+ *
+ * @param path The path to the .fnt file.
+ *
+ * @return Returns an oe font handle on success, otherwise returns
+ *         OE_NULL_HANDLE.
+ */
+extern font_t font_load(const char *path);
+
+/**
+ * @brief Frees font and its page texture.
+ */
+extern void font_free(font_t font);
+
+/**
+ * @brief Binds the font page texture to the sampler, text is drawn
+ *        with the texture of the last binding.
+ */
+extern void font_bind(font_t font, u32 ind);
+
+/**
+ * @brief Returns the distance between lines of the font in pixels.
+ */
+extern f32 font_line_height(font_t font);
+
+/**
+ * @brief Returns the size of the text laid out by draw_text_ext().
+ */
+extern vec2_t text_measure(font_t font, const char *text, f32 scale);
+
+/**
+ * @brief Draws UTF-8 text, the position is the top left corner.
+ */
+extern void draw_text(font_t font, vec2_t pos, const char *text,
+                      color_t color);
+
+/**
+ * @brief Draws UTF-8 text.
+ *
+ * Glyphs are laid out with kerning, '\n' starts a new line. All the
+ * glyph sprites are reserved and written at once, so the text costs
+ * about as much as copying its vertices. Glyphs missing in the font
+ * are skipped.
+ *
+ * @param font  The font, should be bound with font_bind().
+ * @param pos   The top left corner of the text.
+ * @param text  The text.
+ * @param scale The scale of the glyphs.
+ * @param color The color glyphs are multiplied by.
+ * @param depth The depth of the sprites.
+ */
+extern void draw_text_ext(font_t font, vec2_t pos, const char *text,
+                          f32 scale, color_t color, f32 depth);
+
+// +------------------------------------------------------------------+
+// |                          particles                               |
+// +------------------------------------------------------------------+
+
+#define PARTICLES_MAX_EMITTERS 16
+
+typedef struct particles* particles_t;
+
+/**
+ * @brief Particle emitter settings.
+ *
+ * Particles are spawned uniformly in the area around the position with
+ * a random velocity and lifetime from the ranges. The size and the
+ * color are interpolated from the start to the end values over the
+ * particle life.
+ *
+ * @var particle_emitter_t::pos
+ * The center of the emission area.
+ *
+ * @var particle_emitter_t::area
+ * The size of the emission area.
+ *
+ * @var particle_emitter_t::gravity
+ * The acceleration in pixels per second squared.
+ *
+ * @var particle_emitter_t::life_min
+ * The minimum lifetime in seconds.
+ *
+ * @var particle_emitter_t::src
+ * The rectangle of the particle sprite on the texture.
+ */
+typedef struct particle_emitter {
+  vec2_t  pos;
+  vec2_t  area;
+  vec2_t  vel_min;
+  vec2_t  vel_max;
+  vec2_t  gravity;
+  f32     life_min;
+  f32     life_max;
+  f32     size_start;
+  f32     size_end;
+  color_t color_start;
+  color_t color_end;
+  rect_t  src;
+  u32     tex_id;
+  f32     depth;
+} particle_emitter_t;
+
+/**
+ * @brief Creates a particle system.
+ *
+ * Particles are spawned, simulated and compacted by a compute shader,
+ * which writes their sprites right into a vertex buffer drawn with
+ * indirect draws, so the cpu never touches particles. The system
+ * needs "particles-comp.spv" and "particles-args-comp.spv" shaders.
+ *
+ * @param capacity The maximum number of live particles, particles
+ *                 spawned over it are dropped.
+ *
+ * @return Returns an oe particle system handle on success, otherwise
+ *         returns OE_NULL_HANDLE.
+ */
+extern particles_t particles_create(u32 capacity);
+
+/**
+ * @brief Frees particle system, waits for the gpu to finish using it.
+ *
+ * A system drawn in the current frame shouldn't be freed before
+ * draw_end().
+ */
+extern void particles_free(particles_t particles);
+
+/**
+ * @brief Sets emitter settings.
+ *
+ * Settings are read by the live particles as well, so changes of the
+ * gravity or the colors affect the particles already emitted.
+ *
+ * @param ind The index of the emitter, less than
+ *            PARTICLES_MAX_EMITTERS.
+ */
+extern void particles_emitter_set(particles_t particles, u32 ind,
+                                  const particle_emitter_t *emitter);
+
+/**
+ * @brief Spawns particles with the next simulation step.
+ */
+extern void particles_emit(particles_t particles, u32 ind, u32 count);
+
+/**
+ * @brief Advances the simulation with the next frame.
+ *
+ * Steps and emissions are dispatched at the beginning of the frame, so
+ * they should be done before draw_begin(). Steps of the skipped frames
+ * add up.
+ *
+ * @param dt The time step in seconds.
+ */
+extern void particles_simulate(particles_t particles, f32 dt);
+
+/**
+ * @brief Draws particles, must be called from the main thread.
+ *
+ * Sprites drawn before are flushed, so particles are drawn over them
+ * unless the depth says otherwise.
+ */
+extern void draw_particles(particles_t particles);
+
 // +------------------------------------------------------------------+
 // |                           utils                                  |
 // +------------------------------------------------------------------+
 
+/**
+ * @brief Returns monotonic time in milliseconds.
+ */
 extern double get_time(void);
 
+/**
+ * @brief Returns monotonic time in nanoseconds.
+ *
+ * The time isn't affected by system clock adjustments, only the
+ * difference between two calls is meaningful.
+ */
+extern u64 get_time_ns(void);
+
+#define FRAME_TIMER_SAMPLES 256
+
+/**
+ * @brief Measures time between frames.
+ *
+ * Should be initialized with frame_timer_init().
+ */
+typedef struct frame_timer {
+  u64 last;      // time of the last tick, ns
+  f64 dt;        // the last frame time, seconds
+  f64 smooth_dt; // exponentially smoothed frame time, seconds
+  u32 sample_count;
+  u32 next_sample;
+  f32 samples[FRAME_TIMER_SAMPLES]; // the latest frame times, ms
+} frame_timer_t;
+
+/**
+ * @brief Initializes frame timer, the first frame starts now.
+ */
+extern void frame_timer_init(frame_timer_t *timer);
+
+/**
+ * @brief Ends the current frame and starts the next one.
+ *
+ * Should be called once per frame. While input is replayed, the
+ * recorded frame time is returned, percentiles still measure the
+ * real one.
+ *
+ * @return Returns the frame time in seconds.
+ */
+extern f64 frame_timer_tick(frame_timer_t *timer);
+
+/**
+ * @brief Returns the percentile of the latest FRAME_TIMER_SAMPLES
+ *        frame times.
+ *
+ * @param percentile The percentile in [0; 100].
+ *
+ * @return Returns the frame time in milliseconds, or 0 if there are
+ *         no frames measured yet.
+ */
+extern f64 frame_timer_percentile(const frame_timer_t *timer,
+                                  f64 percentile);
+
+/**
+ * @brief Splits variable frame time into fixed simulation steps.
+ *
+ * Should be initialized with fixed_step_init().
+ */
+typedef struct fixed_step {
+  f64 step;        // seconds
+  f64 accumulator; // time not simulated yet, seconds
+  u32 max_steps;   // the maximum number of steps per frame
+} fixed_step_t;
+
+/**
+ * @brief Initializes fixed step accumulator.
+ *
+ * @param step      The simulation step in seconds.
+ * @param max_steps The maximum number of steps per frame, the rest
+ *                  of the time is dropped so a slow frame doesn't
+ *                  make the next ones even slower. 0 means no limit.
+ */
+extern void fixed_step_init(fixed_step_t *fs, f64 step, u32 max_steps);
+
+/**
+ * @brief Accumulates frame time.
+ *
+ * @param dt The frame time in seconds.
+ *
+ * @return Returns the number of steps to simulate this frame.
+ */
+extern u32 fixed_step_advance(fixed_step_t *fs, f64 dt);
+
+/**
+ * @brief Returns the interpolation factor in [0; 1) between the last
+ *        two simulated states for rendering.
+ */
+extern f64 fixed_step_alpha(const fixed_step_t *fs);
+
+// +------------------------------------------------------------------+
+// |                            jobs                                  |
+// +------------------------------------------------------------------+
+
+#define JOB_MAX_THREADS 32
+
+/**
+ * @brief Initializer for the job counter.
+ */
+#define JOB_COUNTER_INIT { 0, 0, NULL }
+
+/**
+ * @brief Job function.
+ */
+typedef void (*job_fn)(void *data);
+
+/**
+ * @brief Range job function, processes elements [start; end).
+ */
+typedef void (*job_range_fn)(u32 start, u32 end, void *data);
+
+/**
+ * @brief Job dependency counter.
+ *
+ * Counter is incremented on every job submitted with it and
+ * decremented when the job finishes. Should be initialized with
+ * JOB_COUNTER_INIT and must outlive all the jobs using it.
+ */
+typedef struct job_counter {
+  i32          value;
+  i32          lock;
+  struct _job *waiters;
+} job_counter_t;
+
+/**
+ * @brief Submits a job to the job system.
+ *
+ * Jobs can be submitted only from the thread which called init() and
+ * from the jobs themselves. Other threads can only wait on counters.
+ *
+ * @param fn      The job function.
+ * @param data    User data passed to the job function.
+ * @param counter Counter to signal on job completion, can be NULL.
+ */
+extern void job_run(job_fn fn, void *data, job_counter_t *counter);
+
+/**
+ * @brief Submits a job, that starts only after the dependency
+ *        counter reaches zero.
+ *
+ * @param dependency Counter to wait for, can be NULL.
+ * @param fn         The job function.
+ * @param data       User data passed to the job function.
+ * @param counter    Counter to signal on job completion, can be NULL.
+ */
+extern void job_run_after(job_counter_t *dependency, job_fn fn,
+                          void *data, job_counter_t *counter);
+
+/**
+ * @brief Waits until the counter reaches zero.
+ *
+ * The main thread and the jobs execute pending jobs while waiting,
+ * other threads only yield.
+ */
+extern void job_wait(job_counter_t *counter);
+
+/**
+ * @brief Splits [0; count) into chunks and processes them in parallel.
+ *
+ * Returns only after all the chunks are processed.
+ *
+ * @param count The number of elements.
+ * @param grain The number of elements in a chunk. Leave as 0 to let
+ *              the job system pick it.
+ * @param fn    The range function.
+ * @param data  User data passed to the range function.
+ */
+extern void job_parallel_for(u32 count, u32 grain, job_range_fn fn,
+                             void *data);
+
+/**
+ * @brief Returns the number of threads executing jobs, including
+ *        the main thread.
+ */
+extern u32 job_thread_count(void);
+
+/**
+ * @brief job_thread_ind() of threads not created by the job system,
+ *        except the main thread.
+ */
+#define JOB_THREAD_NONE UINT32_MAX
+
+/**
+ * @brief Returns the index of the calling thread in
+ *        [0; job_thread_count()). The main thread has index 0, other
+ *        threads not created by the job system get JOB_THREAD_NONE.
+ */
+extern u32 job_thread_ind(void);
+
+// +------------------------------------------------------------------+
+// |                          profiling                               |
+// +------------------------------------------------------------------+
+
+/**
+ * @brief Opens a profiler scope on the calling thread.
+ *
+ * Use profile_begin() macro instead, so the scope is compiled out
+ * when profiling is disabled.
+ *
+ * @param name A pointer to the c-string that outlives the profiler,
+ *             usually a string literal.
+ */
+extern void profile_scope_begin(const char *name);
+
+/**
+ * @brief Closes the last opened profiler scope of the calling thread.
+ */
+extern void profile_scope_end(void);
+
+/**
+ * @brief Writes recorded scopes of all the threads to a Chrome trace
+ *        JSON file, which can be opened with Perfetto as well.
+ *
+ * Should be called while no job is running.
+ *
+ * @param path The path to the file to write.
+ *
+ * @return Returns 1 on success, otherwise returns 0.
+ */
+extern i32 profile_dump(const char *path);
+
+/**
+ * @def profile_begin
+ * @brief Opens a profiler scope, every scope must be closed with
+ *        profile_end() on the same thread.
+ *
+ * @param name A string literal with the scope name.
+ */
+
+/**
+ * @def profile_end
+ * @brief Closes the last opened profiler scope.
+ */
+#ifdef OE_PROFILE_BUILD
+  #define profile_begin(name) profile_scope_begin(name)
+  #define profile_end()       profile_scope_end()
+#else
+  #define profile_begin(name)
+  #define profile_end()
+#endif
+
 // +------------------------------------------------------------------+
 // |                         debugging                                |
 // +------------------------------------------------------------------+
@@ -437,6 +1246,27 @@ typedef enum log_level {
   LOG_LEVEL_FATAL
 } log_level_t;
 
+/**
+ * @def OE_LOG_LEVEL
+ * @brief The minimum log level compiled in, messages of the lower
+ *        levels are removed by the preprocessor along with their
+ *        arguments. Fatal messages are never removed.
+ */
+#ifndef OE_LOG_LEVEL
+  #ifdef OE_DEBUG_BUILD
+    #define OE_LOG_LEVEL 0 // LOG_LEVEL_TRACE
+  #else
+    #define OE_LOG_LEVEL 2 // LOG_LEVEL_INFO
+  #endif
+#endif
+
+/**
+ * @brief The minimum log level at runtime, checked by the logging
+ *        macros before the arguments are evaluated. Use
+ *        log_set_level() to change it.
+ */
+extern log_level_t _log_level;
+
 /**
  * @brief Ptrints a log message with the given log level.
  *
@@ -449,6 +1279,58 @@ typedef enum log_level {
  */
 extern void log_msg(log_level_t level, const char *msg, ...);
 
+/**
+ * @brief Sets the minimum log level at runtime.
+ *
+ * Levels removed at compile time by OE_LOG_LEVEL can't be enabled.
+ */
+extern void log_set_level(log_level_t level);
+
+/**
+ * @brief Returns the minimum log level at runtime.
+ */
+extern log_level_t log_get_level(void);
+
+/**
+ * @brief Starts writing log messages to a binary file.
+ *
+ * Messages are written with their raw arguments and are rendered to
+ * text later with the oe_log_decode tool. While the file is open,
+ * only warnings and errors are also written as text.
+ *
+ * @param path The path to the file, it's overwritten.
+ *
+ * @return Returns 1 on success, otherwise returns 0.
+ */
+extern i32 log_binary_open(const char *path);
+
+/**
+ * @brief Stops writing the binary log, if there is one open.
+ */
+extern void log_binary_close(void);
+
+/**
+ * @def log_if
+ * @brief Logs a message if the level passes the runtime filter,
+ *        arguments are evaluated only if it does.
+ */
+#define log_if(level, ...) \
+  ((level) >= _log_level ? log_msg(level, __VA_ARGS__) : (void)0)
+
+/**
+ * @def _log_func
+ * @brief Logs a message prefixed with the calling function name.
+ *
+ * Callers append an empty string argument, it's consumed by the
+ * trailing "%s", so the message always has a variadic argument and
+ * the macros stay valid ISO C99 without the ##__VA_ARGS__ extension.
+ */
+#define _log_func(level, msg, ...) \
+  log_msg(level, "%s(): " msg "%s", __func__, __VA_ARGS__)
+
+#define _log_if_func(level, msg, ...) \
+  log_if(level, "%s(): " msg "%s", __func__, __VA_ARGS__)
+
 /**
  * @def trace
  * @brief Prints trace log message.
@@ -464,12 +1346,16 @@ extern void log_msg(log_level_t level, const char *msg, ...);
  * @param msg A message to log.
  * @param ... Variadic arguments.
  */
-#ifdef OE_DEBUG_BUILD
-  #define trace(...) log_msg(LOG_LEVEL_TRACE, __VA_ARGS__)
-  #define debug(...) log_msg(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#if OE_LOG_LEVEL <= 0
+  #define trace(...) log_if(LOG_LEVEL_TRACE, __VA_ARGS__)
+#else
+  #define trace(...) ((void)0)
+#endif
+
+#if OE_LOG_LEVEL <= 1
+  #define debug(...) log_if(LOG_LEVEL_DEBUG, __VA_ARGS__)
 #else
-  #define trace(...)
-  #define debug(...)
+  #define debug(...) ((void)0)
 #endif
 
 /**
@@ -478,7 +1364,11 @@ extern void log_msg(log_level_t level, const char *msg, ...);
  * @param msg A message to log.
  * @param ... Variadic arguments.
  */
-#define info(...) log_msg(LOG_LEVEL_INFO, __VA_ARGS__)
+#if OE_LOG_LEVEL <= 2
+  #define info(...) log_if(LOG_LEVEL_INFO, __VA_ARGS__)
+#else
+  #define info(...) ((void)0)
+#endif
 
 /**
  * @brief Prints warn log message.
@@ -486,8 +1376,11 @@ extern void log_msg(log_level_t level, const char *msg, ...);
  * @param msg A message to log.
  * @param ... Variadic arguments.
  */
-#define warn(msg, ...) \
-  log_msg(LOG_LEVEL_WARN, "%s(): " msg, __func__, ##__VA_ARGS__)
+#if OE_LOG_LEVEL <= 3
+  #define warn(...) _log_if_func(LOG_LEVEL_WARN, __VA_ARGS__, "")
+#else
+  #define warn(...) ((void)0)
+#endif
 
 /**
  * @brief Prints error log message.
@@ -498,8 +1391,11 @@ extern void log_msg(log_level_t level, const char *msg, ...);
  * @param msg A message to log.
  * @param ... Variadic arguments.
  */
-#define error(msg, ...) \
-  log_msg(LOG_LEVEL_ERROR, "%s(): " msg, __func__, ##__VA_ARGS__)
+#if OE_LOG_LEVEL <= 4
+  #define error(...) _log_if_func(LOG_LEVEL_ERROR, __VA_ARGS__, "")
+#else
+  #define error(...) ((void)0)
+#endif
 
 /**
  * @brief Prints fatal log message.
@@ -510,9 +1406,9 @@ extern void log_msg(log_level_t level, const char *msg, ...);
  * @param msg A message to log.
  * @param ... Variadic arguments.
  */
-#define fatal(msg, ...) \
+#define fatal(...) \
 { \
-  log_msg(LOG_LEVEL_FATAL, "%s(): " msg, __func__, ##__VA_ARGS__); \
+  _log_func(LOG_LEVEL_FATAL, __VA_ARGS__, ""); \
   exit(1); \
 }
 
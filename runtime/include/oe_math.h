@@ -0,0 +1,389 @@
+/**
+ * @file oe_math.h
+ * @brief The math part of the oe library.
+ *
+ * Included by oe.h, shouldn't be included on its own. Operations on
+ * single values are inline, so they compile down to a few
+ * instructions at the call site. Operations on arrays are out of line
+ * and use SSE2 or NEON when available.
+ */
+#pragma once
+
+#include <math.h>
+
+/**
+ * @brief 2 dimensional vector.
+ */
+typedef struct vec2 { f32 x, y; } vec2_t;
+
+/**
+ * @brief 3 dimensional vector.
+ */
+typedef struct vec3 { f32 x, y, z; } vec3_t;
+
+/**
+ * @brief 4 dimensional vector.
+ */
+typedef struct vec4 { f32 x, y, z, w; } vec4_t;
+
+/**
+ * @brief Rectangle.
+ */
+typedef struct rect {
+  f32 x, y;
+  f32 width, height;
+} rect_t;
+
+/**
+ * @brief 2D affine transform.
+ *
+ * Row major, the last row is always { 0, 0, 1 }, so it isn't stored.
+ * A point is transformed as:
+ *   x' = m[0][0] * x + m[0][1] * y + m[0][2]
+ *   y' = m[1][0] * x + m[1][1] * y + m[1][2]
+ */
+typedef struct mat3 { f32 m[2][3]; } mat3_t;
+
+// +------------------------------------------------------------------+
+// |                             scalar                               |
+// +------------------------------------------------------------------+
+
+static inline f32 lerp(f32 a, f32 b, f32 t)
+{
+  return a + (b - a) * t;
+}
+
+static inline f32 clamp(f32 x, f32 min, f32 max)
+{
+  return x < min ? min : (x > max ? max : x);
+}
+
+// +------------------------------------------------------------------+
+// |                              vec2                                |
+// +------------------------------------------------------------------+
+
+static inline vec2_t vec2_add(vec2_t v1, vec2_t v2)
+{
+  return (vec2_t){ v1.x + v2.x, v1.y + v2.y };
+}
+
+static inline vec2_t vec2_sub(vec2_t v1, vec2_t v2)
+{
+  return (vec2_t){ v1.x - v2.x, v1.y - v2.y };
+}
+
+static inline vec2_t vec2_mul(vec2_t v1, vec2_t v2)
+{
+  return (vec2_t){ v1.x * v2.x, v1.y * v2.y };
+}
+
+static inline vec2_t vec2_scale(vec2_t v, f32 s)
+{
+  return (vec2_t){ v.x * s, v.y * s };
+}
+
+static inline f32 vec2_dot(vec2_t v1, vec2_t v2)
+{
+  return v1.x * v2.x + v1.y * v2.y;
+}
+
+static inline f32 vec2_len_sq(vec2_t v)
+{
+  return vec2_dot(v, v);
+}
+
+static inline f32 vec2_len(vec2_t v)
+{
+  return sqrtf(vec2_dot(v, v));
+}
+
+/**
+ * @brief Returns the vector of length 1, or a zero vector as it is.
+ */
+static inline vec2_t vec2_norm(vec2_t v)
+{
+  const f32 len = vec2_len(v);
+  return len > 0.0f ? vec2_scale(v, 1.0f / len) : v;
+}
+
+static inline vec2_t vec2_min(vec2_t v1, vec2_t v2)
+{
+  return (vec2_t){ v1.x < v2.x ? v1.x : v2.x, v1.y < v2.y ? v1.y : v2.y };
+}
+
+static inline vec2_t vec2_max(vec2_t v1, vec2_t v2)
+{
+  return (vec2_t){ v1.x > v2.x ? v1.x : v2.x, v1.y > v2.y ? v1.y : v2.y };
+}
+
+static inline vec2_t vec2_lerp(vec2_t v1, vec2_t v2, f32 t)
+{
+  return (vec2_t){ lerp(v1.x, v2.x, t), lerp(v1.y, v2.y, t) };
+}
+
+static inline vec2_t vec2_clamp(vec2_t v, vec2_t min, vec2_t max)
+{
+  return (vec2_t){ clamp(v.x, min.x, max.x), clamp(v.y, min.y, max.y) };
+}
+
+// +------------------------------------------------------------------+
+// |                              vec3                                |
+// +------------------------------------------------------------------+
+
+static inline vec3_t vec3_add(vec3_t v1, vec3_t v2)
+{
+  return (vec3_t){ v1.x + v2.x, v1.y + v2.y, v1.z + v2.z };
+}
+
+static inline vec3_t vec3_sub(vec3_t v1, vec3_t v2)
+{
+  return (vec3_t){ v1.x - v2.x, v1.y - v2.y, v1.z - v2.z };
+}
+
+static inline vec3_t vec3_scale(vec3_t v, f32 s)
+{
+  return (vec3_t){ v.x * s, v.y * s, v.z * s };
+}
+
+static inline f32 vec3_dot(vec3_t v1, vec3_t v2)
+{
+  return v1.x * v2.x + v1.y * v2.y + v1.z * v2.z;
+}
+
+static inline vec3_t vec3_cross(vec3_t v1, vec3_t v2)
+{
+  return (vec3_t){
+    v1.y * v2.z - v1.z * v2.y,
+    v1.z * v2.x - v1.x * v2.z,
+    v1.x * v2.y - v1.y * v2.x,
+  };
+}
+
+static inline f32 vec3_len(vec3_t v)
+{
+  return sqrtf(vec3_dot(v, v));
+}
+
+static inline vec3_t vec3_lerp(vec3_t v1, vec3_t v2, f32 t)
+{
+  return (vec3_t){
+    lerp(v1.x, v2.x, t), lerp(v1.y, v2.y, t), lerp(v1.z, v2.z, t),
+  };
+}
+
+// +------------------------------------------------------------------+
+// |                              vec4                                |
+// +------------------------------------------------------------------+
+
+static inline vec4_t vec4_add(vec4_t v1, vec4_t v2)
+{
+  return (vec4_t){ v1.x + v2.x, v1.y + v2.y, v1.z + v2.z, v1.w + v2.w };
+}
+
+static inline vec4_t vec4_sub(vec4_t v1, vec4_t v2)
+{
+  return (vec4_t){ v1.x - v2.x, v1.y - v2.y, v1.z - v2.z, v1.w - v2.w };
+}
+
+static inline vec4_t vec4_scale(vec4_t v, f32 s)
+{
+  return (vec4_t){ v.x * s, v.y * s, v.z * s, v.w * s };
+}
+
+static inline f32 vec4_dot(vec4_t v1, vec4_t v2)
+{
+  return v1.x * v2.x + v1.y * v2.y + v1.z * v2.z + v1.w * v2.w;
+}
+
+static inline vec4_t vec4_lerp(vec4_t v1, vec4_t v2, f32 t)
+{
+  return (vec4_t){
+    lerp(v1.x, v2.x, t), lerp(v1.y, v2.y, t),
+    lerp(v1.z, v2.z, t), lerp(v1.w, v2.w, t),
+  };
+}
+
+// +------------------------------------------------------------------+
+// |                              rect                                |
+// +------------------------------------------------------------------+
+
+static inline vec2_t rect_center(rect_t r)
+{
+  return (vec2_t){ r.x + r.width * 0.5f, r.y + r.height * 0.5f };
+}
+
+static inline rect_t rect_translate(rect_t r, vec2_t offset)
+{
+  return (rect_t){ r.x + offset.x, r.y + offset.y, r.width, r.height };
+}
+
+/**
+ * @brief Returns whether the point is inside the rectangle or not,
+ *        the right and bottom edges are outside.
+ */
+static inline i32 rect_contains(rect_t r, vec2_t p)
+{
+  return p.x >= r.x && p.x < r.x + r.width &&
+         p.y >= r.y && p.y < r.y + r.height;
+}
+
+/**
+ * @brief Returns whether the rectangles overlap or not, touching
+ *        edges don't.
+ */
+static inline i32 rect_overlaps(rect_t r1, rect_t r2)
+{
+  return r1.x < r2.x + r2.width  && r2.x < r1.x + r1.width &&
+         r1.y < r2.y + r2.height && r2.y < r1.y + r1.height;
+}
+
+/**
+ * @brief Returns the intersection of the rectangles, it has zero size
+ *        if they don't overlap.
+ */
+static inline rect_t rect_intersect(rect_t r1, rect_t r2)
+{
+  const f32 x1 = fmaxf(r1.x, r2.x);
+  const f32 y1 = fmaxf(r1.y, r2.y);
+  const f32 x2 = fminf(r1.x + r1.width, r2.x + r2.width);
+  const f32 y2 = fminf(r1.y + r1.height, r2.y + r2.height);
+
+  return (rect_t){ x1, y1, x2 > x1 ? x2 - x1 : 0.0f,
+                   y2 > y1 ? y2 - y1 : 0.0f };
+}
+
+/**
+ * @brief Returns the smallest rectangle containing both.
+ */
+static inline rect_t rect_union(rect_t r1, rect_t r2)
+{
+  const f32 x1 = fminf(r1.x, r2.x);
+  const f32 y1 = fminf(r1.y, r2.y);
+  const f32 x2 = fmaxf(r1.x + r1.width, r2.x + r2.width);
+  const f32 y2 = fmaxf(r1.y + r1.height, r2.y + r2.height);
+
+  return (rect_t){ x1, y1, x2 - x1, y2 - y1 };
+}
+
+// +------------------------------------------------------------------+
+// |                              mat3                                |
+// +------------------------------------------------------------------+
+
+static inline mat3_t mat3_identity(void)
+{
+  return (mat3_t){ { { 1.0f, 0.0f, 0.0f }, { 0.0f, 1.0f, 0.0f } } };
+}
+
+static inline mat3_t mat3_translate(vec2_t offset)
+{
+  return (mat3_t){ { { 1.0f, 0.0f, offset.x }, { 0.0f, 1.0f, offset.y } } };
+}
+
+static inline mat3_t mat3_scale(vec2_t scale)
+{
+  return (mat3_t){ { { scale.x, 0.0f, 0.0f }, { 0.0f, scale.y, 0.0f } } };
+}
+
+/**
+ * @param angle Counterclockwise in radians, clockwise on the screen
+ *              as y points down.
+ */
+static inline mat3_t mat3_rotate(f32 angle)
+{
+  const f32 c = cosf(angle);
+  const f32 s = sinf(angle);
+
+  return (mat3_t){ { { c, -s, 0.0f }, { s, c, 0.0f } } };
+}
+
+/**
+ * @brief Returns the transform applying m2 first, then m1.
+ */
+static inline mat3_t mat3_mul(mat3_t m1, mat3_t m2)
+{
+  mat3_t res;
+
+  for (i32 i = 0; i < 2; ++i) {
+    res.m[i][0] = m1.m[i][0] * m2.m[0][0] + m1.m[i][1] * m2.m[1][0];
+    res.m[i][1] = m1.m[i][0] * m2.m[0][1] + m1.m[i][1] * m2.m[1][1];
+    res.m[i][2] = m1.m[i][0] * m2.m[0][2] + m1.m[i][1] * m2.m[1][2] +
+                  m1.m[i][2];
+  }
+
+  return res;
+}
+
+/**
+ * @brief Returns the inverse transform, or the identity if the
+ *        transform is degenerate.
+ */
+static inline mat3_t mat3_inverse(mat3_t m)
+{
+  const f32 det = m.m[0][0] * m.m[1][1] - m.m[0][1] * m.m[1][0];
+  if (det == 0.0f)
+    return mat3_identity();
+
+  const f32 inv = 1.0f / det;
+  const f32 a =  m.m[1][1] * inv;
+  const f32 b = -m.m[0][1] * inv;
+  const f32 c = -m.m[1][0] * inv;
+  const f32 d =  m.m[0][0] * inv;
+
+  return (mat3_t){ {
+    { a, b, -(a * m.m[0][2] + b * m.m[1][2]) },
+    { c, d, -(c * m.m[0][2] + d * m.m[1][2]) },
+  } };
+}
+
+/**
+ * @brief Transforms a point.
+ */
+static inline vec2_t mat3_transform(mat3_t m, vec2_t p)
+{
+  return (vec2_t){
+    m.m[0][0] * p.x + m.m[0][1] * p.y + m.m[0][2],
+    m.m[1][0] * p.x + m.m[1][1] * p.y + m.m[1][2],
+  };
+}
+
+/**
+ * @brief Transforms a direction, translation isn't applied.
+ */
+static inline vec2_t mat3_transform_dir(mat3_t m, vec2_t v)
+{
+  return (vec2_t){
+    m.m[0][0] * v.x + m.m[0][1] * v.y,
+    m.m[1][0] * v.x + m.m[1][1] * v.y,
+  };
+}
+
+// +------------------------------------------------------------------+
+// |                             batch                                |
+// +------------------------------------------------------------------+
+
+/**
+ * @brief Transforms an array of points.
+ *
+ * @param dst Receives the points, might be the same array as src.
+ */
+extern void vec2_transform_batch(const mat3_t *m, const vec2_t *src,
+                                 vec2_t *dst, u32 count);
+
+/**
+ * @brief Moves an array of points, pos[i] += vel[i] * t.
+ *
+ * Typically used to integrate positions with velocities.
+ */
+extern void vec2_madd_batch(vec2_t *pos, const vec2_t *vel, f32 t,
+                            u32 count);
+
+/**
+ * @brief Transforms an array of rectangles.
+ *
+ * Every rectangle is replaced with the bounding rectangle of its
+ * transformed corners, so rotations make them larger.
+ *
+ * @param dst Receives the rectangles, might be the same array as src.
+ */
+extern void rect_transform_batch(const mat3_t *m, const rect_t *src,
+                                 rect_t *dst, u32 count);
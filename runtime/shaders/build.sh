@@ -1,10 +1,21 @@
 #!/bin/bash
 
+set -e
+
 glslc main.vert -o main-vert.spv
 glslc main.frag -o main-frag.spv
+glslc particles.comp -o particles-comp.spv
+glslc particles-args.comp -o particles-args-comp.spv
+
+spirv-val main-vert.spv
+spirv-val main-frag.spv
+spirv-val particles-comp.spv
+spirv-val particles-args-comp.spv
 
 rm -rf ../../build/example/shaders
 mkdir ../../build/example/shaders
 
 cp main-vert.spv ../../build/example/shaders
 cp main-frag.spv ../../build/example/shaders
+cp particles-comp.spv ../../build/example/shaders
+cp particles-args-comp.spv ../../build/example/shaders
@@ -3,6 +3,7 @@
 #include <string.h>
 #include <stdint.h>
 #include <limits.h>
+#include <math.h>
 
 #define OPL_INCLUDE_VULKAN
 #include <opl.h>
@@ -14,24 +15,172 @@
 #include "oe.h"
 #include "internal.h"
 
-#define MAX_FRAMES_COUNT     3
+#define MAX_FRAMES_IN_FLIGHT 3
+#define MAX_SWAPCHAIN_IMAGES 8
 #define RESERVED_VERTS_COUNT 64000
 #define MAX_TEXTURE_PATH 128
 
+// sprite queues reserve vertices from the frame vertex buffer in chunks
+#define QUEUE_CHUNK_VERTS 1024
+#define MAX_QUEUE_SPANS   1024
+#define MAX_MERGED_SPANS  (RESERVED_VERTS_COUNT / 4)
+
+#define MAX_THREAD_CMDBUFS    64
+#define MAX_SECONDARY_CMDBUFS 256
+
+// the render pass begin and end, then begin and end of every pass
+#define QUERIES_PER_FRAME (2 + 2 * GFX_MAX_TIMED_PASSES)
+
 #define CUR_GRAPHICS_CMDBUF \
   s_cmdbufs[QUEUE_INDEX_GRAPHICS][s_cur_frame_ind]
 
 #define CUR_TRANSFER_CMDBUF \
   s_cmdbufs[QUEUE_INDEX_TRANSFER][s_cur_frame_ind]
 
+// the weight of a new gpu frame time in the smoothed one
+#define DYNRES_SMOOTHING 0.1
+
+// the scale goes up only if frames take less than this part of the
+// budget, so it doesn't flip back and forth around the budget
+#define DYNRES_HEADROOM 0.85
+
+// the number of frames over or under the budget that change the scale
+#define DYNRES_DOWN_FRAMES 3
+#define DYNRES_UP_FRAMES   30
+
+// the scale goes up slowly, the step down depends on the overrun
+#define DYNRES_UP_STEP 0.05f
+
+// frames in flight are still rendered at the previous scale when
+// it changes, their timings are skipped
+#define DYNRES_COOLDOWN_FRAMES (MAX_FRAMES_IN_FLIGHT + 2)
+
+// particle sprites are drawn in chunks addressable by 16-bit indices
+#define PARTICLES_CHUNK_QUADS (RESERVED_VERTS_COUNT / 4)
+#define PARTICLES_GROUP_SIZE  64 // local_size_x of particle shaders
+#define MAX_PARTICLE_SYSTEMS  32
+
 struct texture {
   VkImage image;
   VkDeviceMemory mem;
   VkImageView view;
+  VkSampler sampler;
+  u32 mip_levels;
   int width, height;
   char path[MAX_TEXTURE_PATH];
 };
 
+/**
+ * @brief Continuous range of vertices in the frame vertex buffer.
+ */
+typedef struct _span {
+  u32 first;
+  u32 count;
+  u32 order; // draw order key of the sprites in the span
+} _span_t;
+
+/**
+ * @brief Sprites drawn by a single thread, not yet recorded into
+ *        a command buffer.
+ */
+typedef struct _sprite_queue {
+  u32     chunk_first; // first vertex of the current chunk
+  u32     chunk_used;  // the number of used vertices in the chunk
+  u32     span_count;
+  _span_t spans[MAX_QUEUE_SPANS];
+} _sprite_queue_t;
+
+typedef struct _layers_ctx {
+  draw_layer_fn fn;
+  void         *data;
+  u32           base; // index of the first layer's secondary slot
+} _layers_ctx_t;
+
+/**
+ * @brief Dynamic resolution controller state.
+ */
+typedef struct _dynres {
+  i32          enabled;
+  gfx_dynres_t settings;
+  f32          scale;
+  f64          avg_ms;   // smoothed gpu frame time, 0 if restarted
+  u32          over;     // consecutive frames over the budget
+  u32          under;    // consecutive frames with the headroom
+  u32          cooldown; // frames to skip after the scale change
+} _dynres_t;
+
+/**
+ * @brief Particle state, mirrors Particle of particles.comp.
+ */
+typedef struct _particle {
+  vec2_t pos;
+  vec2_t vel;
+  f32    age;
+  f32    life;
+  u32    emitter;
+  u32    pad;
+} _particle_t;
+
+/**
+ * @brief Emitter settings in the std140 layout of particles.comp.
+ */
+typedef struct _particle_emitter_gpu {
+  f32 pos[2];
+  f32 area[2];
+  f32 vel_min[2];
+  f32 vel_max[2];
+  f32 gravity[2];
+  f32 life[2];
+  f32 size[2];
+  u32 color_start;
+  u32 color_end;
+  f32 src[4];
+  u32 tex_id;
+  f32 depth;
+  u32 emit_first; // the first spawn thread of the emitter
+  u32 emit_count;
+} _particle_emitter_gpu_t;
+
+/**
+ * @brief Simulation step parameters, mirrors Frame of particles.comp.
+ */
+typedef struct _particles_frame {
+  f32                     dt;
+  u32                     seed;
+  u32                     emit_total;
+  u32                     capacity;
+  _particle_emitter_gpu_t emitters[PARTICLES_MAX_EMITTERS];
+} _particles_frame_t;
+
+typedef struct _particles_push {
+  u32 src;
+  u32 capacity;
+  u32 chunk_quads;
+  u32 chunk_count;
+} _particles_push_t;
+
+struct particles {
+  u32                 capacity;
+  u32                 chunk_count;
+  u32                 src;  // the half of the state buffer to simulate
+  u32                 seed;
+  f32                 dt;   // the pending simulation step
+  u32                 emit_counts[PARTICLES_MAX_EMITTERS];
+  particle_emitter_t  emitters[PARTICLES_MAX_EMITTERS];
+  VkBuffer            state_buf; // two halves of capacity particles
+  VkDeviceMemory      state_mem;
+  VkBuffer            count_buf; // the number of particles in halves
+  VkDeviceMemory      count_mem;
+  VkBuffer            vert_buf;
+  VkDeviceMemory      vert_mem;
+  VkBuffer            args_buf;  // indirect draw per chunk
+  VkDeviceMemory      args_mem;
+  VkBuffer            frame_bufs[MAX_FRAMES_IN_FLIGHT];
+  VkDeviceMemory      frame_mems[MAX_FRAMES_IN_FLIGHT];
+  _particles_frame_t *frame_ptrs[MAX_FRAMES_IN_FLIGHT];
+  VkDescriptorSet     sets[MAX_FRAMES_IN_FLIGHT];
+};
+
 enum queue_index {
   QUEUE_INDEX_GRAPHICS,
   QUEUE_INDEX_TRANSFER,
@@ -39,6 +188,13 @@ enum queue_index {
   QUEUE_INDEX_MAX
 };
 
+static const VkPresentModeKHR s_vk_present_modes[PRESENT_MODE_MAX] = {
+  [PRESENT_MODE_FIFO]         = VK_PRESENT_MODE_FIFO_KHR,
+  [PRESENT_MODE_FIFO_RELAXED] = VK_PRESENT_MODE_FIFO_RELAXED_KHR,
+  [PRESENT_MODE_MAILBOX]      = VK_PRESENT_MODE_MAILBOX_KHR,
+  [PRESENT_MODE_IMMEDIATE]    = VK_PRESENT_MODE_IMMEDIATE_KHR,
+};
+
 static const char* s_device_ext_names[] = {
 #ifdef OE_PLATFORM_MACOS
 #define DEVICE_EXT_COUNT 2
@@ -56,37 +212,92 @@ static VkDevice s_device;
 static uint32_t s_queue_families[QUEUE_INDEX_MAX];
 static VkQueue s_queues[QUEUE_INDEX_MAX];
 static VkSurfaceKHR s_surface;
-static uint32_t s_frames_count;
+static uint32_t s_image_count;
+static u32 s_frames_in_flight = LATENCY_MODE_BALANCED;
 static VkSwapchainKHR s_swapchain;
 static VkExtent2D s_swapchain_extent;
-static VkImage s_swapchain_images[MAX_FRAMES_COUNT];
-static VkImageView s_swapchain_views[MAX_FRAMES_COUNT];
+static VkExtent2D s_window_extent; // used if the surface has no extent
+static VkExtent2D s_render_extent; // the extent sprites are rendered at
+static VkExtent2D s_frame_extent; // the part of it the frame is drawn to
+static _dynres_t s_dynres;
+static i32 s_upscaled; // frames are rendered into targets and upscaled
+static VkImage s_targets[MAX_FRAMES_IN_FLIGHT];
+static VkDeviceMemory s_target_mems[MAX_FRAMES_IN_FLIGHT];
+static VkImageView s_target_views[MAX_FRAMES_IN_FLIGHT];
+static VkSurfaceFormatKHR s_surface_format;
+static present_mode_t s_present_mode = PRESENT_MODE_MAILBOX;
+static u16 s_resx, s_resy;
+static i32 s_swapchain_dirty;
+static i32 s_frame_skipped;
+static i32 s_frame_open; // between draw_begin() and the frame submit
+static i32 s_headless;
+static VkDeviceMemory s_offscreen_mems[MAX_FRAMES_IN_FLIGHT];
+static VkBuffer s_readback_buf;
+static VkDeviceMemory s_readback_mem;
+static void *s_readback_ptr;
+static i32 s_last_frame_ind = -1;
+static gfx_frame_stats_t s_frame_stats;
+static gfx_frame_stats_t s_last_frame_stats;
+static gfx_frame_stats_t s_frame_stats_history[GFX_FRAME_STATS_WINDOW];
+static u32 s_frame_stats_count; // the number of frames ever finished
+static VkQueryPool s_query_pools[MAX_FRAMES_IN_FLIGHT];
+static i32 s_timestamps_supported;
+static f64 s_timestamp_period; // nanoseconds per timestamp tick
+static u64 s_timestamp_mask;
+static u64 s_frame_counter;
+static u64 s_query_frames[MAX_FRAMES_IN_FLIGHT]; // 0 if not pending
+static i32 s_pass_timed[MAX_FRAMES_IN_FLIGHT][GFX_MAX_TIMED_PASSES];
+static gfx_gpu_stats_t s_gpu_stats;
+static u32 s_gpu_stats_log_interval;
+static VkImage s_swapchain_images[MAX_SWAPCHAIN_IMAGES];
+static VkImageView s_swapchain_views[MAX_SWAPCHAIN_IMAGES];
 static VkImage s_depth_image;
 static VkDeviceMemory s_depth_image_mem;
 static VkImageView s_depth_image_view;
 static VkRenderPass s_render_pass;
 static VkDescriptorSetLayout s_descriptor_set_layout;
 static VkDescriptorPool s_descriptor_pool;
-static VkDescriptorSet s_descriptor_sets[MAX_FRAMES_COUNT];
+static VkDescriptorSet s_descriptor_sets[MAX_FRAMES_IN_FLIGHT];
 static VkPipelineLayout s_pipeline_layout;
 static VkPipeline s_pipeline;
-static VkFramebuffer s_framebufs[MAX_FRAMES_COUNT];
+static VkFramebuffer s_framebufs[MAX_SWAPCHAIN_IMAGES];
+static u32 s_framebuf_count;
 static VkCommandPool s_cmd_pools[QUEUE_INDEX_MAX];
-static VkCommandBuffer s_cmdbufs[QUEUE_INDEX_MAX][MAX_FRAMES_COUNT];
-static VkBuffer s_vert_buf;
-static VkDeviceMemory s_vert_buf_mem;
-static _vert_t s_verts[RESERVED_VERTS_COUNT];
-static i32 s_vert_count = 0;
+static VkCommandBuffer s_cmdbufs[QUEUE_INDEX_MAX][MAX_FRAMES_IN_FLIGHT];
+static VkCommandPool s_thread_cmd_pools[MAX_FRAMES_IN_FLIGHT][JOB_MAX_THREADS];
+static VkCommandBuffer
+  s_thread_cmdbufs[MAX_FRAMES_IN_FLIGHT][JOB_MAX_THREADS][MAX_THREAD_CMDBUFS];
+static u32 s_thread_cmdbuf_counts[MAX_FRAMES_IN_FLIGHT][JOB_MAX_THREADS];
+static u32 s_thread_cmdbufs_used[JOB_MAX_THREADS];
+static VkCommandBuffer s_secondaries[MAX_SECONDARY_CMDBUFS];
+static u32 s_secondary_count;
+static VkBuffer s_vert_bufs[MAX_FRAMES_IN_FLIGHT];
+static VkDeviceMemory s_vert_buf_mems[MAX_FRAMES_IN_FLIGHT];
+static _vert_t *s_vert_ptrs[MAX_FRAMES_IN_FLIGHT];
+static u32 s_vert_count = 0;
+static _sprite_queue_t s_thread_queues[JOB_MAX_THREADS];
+static _span_t s_merged_spans[MAX_MERGED_SPANS];
+static __thread _sprite_queue_t *t_queue;
+static __thread u32 t_order;
 static VkBuffer s_ind_buf;
 static VkDeviceMemory s_ind_buf_mem;
-static VkBuffer s_ubufs[MAX_FRAMES_COUNT];
-static VkSampler s_sampler;
-static VkDeviceMemory s_ubuf_mems[MAX_FRAMES_COUNT];
-static VkSemaphore s_image_available_semaphores[MAX_FRAMES_COUNT];
-static VkSemaphore s_renderer_finished_semaphores[MAX_FRAMES_COUNT];
-static VkFence s_in_flight_fences[MAX_FRAMES_COUNT];
+static VkBuffer s_ubufs[MAX_FRAMES_IN_FLIGHT];
+static VkSampler
+  s_samplers[TEXTURE_FILTER_MAX][TEXTURE_MIP_MAX][TEXTURE_WRAP_MAX];
+static VkDeviceMemory s_ubuf_mems[MAX_FRAMES_IN_FLIGHT];
+static void *s_ubuf_ptrs[MAX_FRAMES_IN_FLIGHT];
+static VkSemaphore s_image_available_semaphores[MAX_FRAMES_IN_FLIGHT];
+static VkSemaphore s_renderer_finished_semaphores[MAX_SWAPCHAIN_IMAGES];
+static VkFence s_in_flight_fences[MAX_FRAMES_IN_FLIGHT];
+static VkFence s_image_fences[MAX_SWAPCHAIN_IMAGES];
 static i32 s_cur_frame_ind = 0;
 static uint32_t s_cur_image_ind;
+static VkDescriptorSetLayout s_particles_set_layout;
+static VkDescriptorPool s_particles_descriptor_pool;
+static VkPipelineLayout s_particles_pipeline_layout;
+static VkPipeline s_particles_pipeline; // spawn, simulation, compaction
+static VkPipeline s_particles_args_pipeline; // indirect draws
+static struct particles *s_particle_systems[MAX_PARTICLE_SYSTEMS];
 
 // +------------------------------------------------------------------+
 // |                         initialization                           |
@@ -103,16 +314,26 @@ inline static void _device_create(void);
 inline static void _obtain_queues(void);
 
 inline static void _check_device_exts(void);
+inline static void _surface_format_select(void);
 inline static void _swapchain_create(u16 resx, u16 resy,
                                      VkSwapchainKHR old_swapchain);
 inline static void _swapchain_get_images(void);
 inline static void _swapchain_image_views_create(void);
-inline static void _swapchain_recreate(u16 resx, u16 resy);
+inline static i32 _swapchain_recreate(u16 resx, u16 resy);
+
+inline static void _offscreen_create(u16 resx, u16 resy);
+inline static void _offscreen_destroy(void);
+inline static i32 _offscreen_recreate(u16 resx, u16 resy);
+
+inline static void _targets_create(u16 resx, u16 resy);
+inline static void _targets_destroy(void);
 
 inline static void _cmd_pools_create(void);
 inline static void _cmdbufs_allocate(void);
+inline static void _thread_cmd_pools_create(void);
 
 inline static void _depth_resources_create(void);
+inline static void _depth_resources_destroy(void);
 inline static void _render_pass_create(void);
 inline static void _descriptor_set_layout_create(void);
 inline static void _descriptor_pool_create(void);
@@ -121,46 +342,93 @@ inline static void _pipeline_layout_create(void);
 inline static void _pipeline_create(void);
 
 inline static void _framebufs_create(void);
+inline static void _framebufs_destroy(void);
 
 inline static void _vert_buf_create(void);
 inline static void _ind_buf_create(void);
 inline static void _ubuf_create(void);
-inline static void _sampler_create(void);
 
 inline static void _sync_objects_create(void);
+inline static void _query_pools_create(void);
 
 // +------------------------------------------------------------------+
 // |                            images                                |
 // +------------------------------------------------------------------+
 
 inline static void _image_create(
-  uint32_t width, uint32_t height, VkFormat format,
+  uint32_t width, uint32_t height, uint32_t mip_levels, VkFormat format,
   VkImageUsageFlags usage, VkMemoryPropertyFlags mem_props,
   VkImage *image, VkDeviceMemory *mem);
 
 
 inline static VkImageView _image_view_create(
-  VkImage image, VkFormat format, VkImageAspectFlags aspectFlags);
+  VkImage image, VkFormat format, VkImageAspectFlags aspectFlags,
+  uint32_t mip_levels);
 
 inline static void _trans_image_layout(VkImage image, VkImageLayout old,
-                                       VkImageLayout new);
+                                       VkImageLayout new,
+                                       uint32_t mip_levels);
+
+inline static void _mipmaps_generate(VkImage image, int width, int height,
+                                     uint32_t mip_levels);
 
-void _gfx_init(opl_window_t window, i16 resx, i16 resy)
+// +------------------------------------------------------------------+
+// |                           samplers                               |
+// +------------------------------------------------------------------+
+
+inline static VkSampler _sampler_get(texture_params_t params);
+
+// +------------------------------------------------------------------+
+// |                           particles                              |
+// +------------------------------------------------------------------+
+
+inline static void _particles_dispatch(VkCommandBuffer cmdbuf);
+inline static void _particles_quit(void);
+
+void _gfx_init(opl_window_t window, u16 width, u16 height,
+               i16 resx, i16 resy)
 {
+  s_headless = window == NULL;
+
+  if (s_headless && (resx <= 0 || resy <= 0))
+    fatal("headless mode requires explicit resolution: %dx%d",
+          resx, resy);
+
+  // headless frames are already rendered at the resolution
+  s_upscaled = !s_headless && resx > 0 && resy > 0;
+  s_window_extent = (VkExtent2D){ width, height };
+
   _instance_create();
   _select_gpu();
-  _surface_create(window);
+
+  if (!s_headless)
+    _surface_create(window);
+
   _find_queue_families();
+  _check_device_exts();
   _device_create();
   _obtain_queues();
 
-  _check_device_exts();
-  _swapchain_create(resx, resy, VK_NULL_HANDLE);
-  _swapchain_get_images();
-  _swapchain_image_views_create();
+  s_resx = resx;
+  s_resy = resy;
+
+  if (s_headless) {
+    _offscreen_create(resx, resy);
+  } else {
+    _surface_format_select();
+    _swapchain_create(resx, resy, VK_NULL_HANDLE);
+    _swapchain_get_images();
+    _swapchain_image_views_create();
+
+    if (s_upscaled)
+      _targets_create(resx, resy);
+    else
+      s_render_extent = s_swapchain_extent;
+  }
 
   _cmd_pools_create();
   _cmdbufs_allocate();
+  _thread_cmd_pools_create();
 
   _depth_resources_create();
   _render_pass_create();
@@ -174,8 +442,8 @@ void _gfx_init(opl_window_t window, i16 resx, i16 resy)
   _vert_buf_create();
   _ind_buf_create();
   _ubuf_create();
-  _sampler_create();
   _sync_objects_create();
+  _query_pools_create();
 
   trace("gfx initialized");
 }
@@ -186,22 +454,44 @@ void _gfx_quit(void)
 
   trace("destroying Vulkan objects...");
 
+  // query pools
+  for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
+    if (s_query_pools[i] != VK_NULL_HANDLE)
+      vkDestroyQueryPool(s_device, s_query_pools[i], NULL);
+
+    s_query_pools[i] = VK_NULL_HANDLE;
+    s_query_frames[i] = 0;
+  }
+
+  _particles_quit();
+
   // sync objects
-  for (uint32_t i = 0; i < s_frames_count; ++i) {
+  for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
     vkDestroyFence(s_device, s_in_flight_fences[i], NULL);
 
-    vkDestroySemaphore(s_device, s_renderer_finished_semaphores[i],
-                       NULL);
-
     vkDestroySemaphore(s_device, s_image_available_semaphores[i],
                        NULL);
   }
 
-  // sampler
-  vkDestroySampler(s_device, s_sampler, NULL);
+  for (uint32_t i = 0; i < MAX_SWAPCHAIN_IMAGES; ++i)
+    vkDestroySemaphore(s_device, s_renderer_finished_semaphores[i],
+                       NULL);
+
+  // samplers
+  for (u32 i = 0; i < TEXTURE_FILTER_MAX; ++i) {
+    for (u32 j = 0; j < TEXTURE_MIP_MAX; ++j) {
+      for (u32 k = 0; k < TEXTURE_WRAP_MAX; ++k) {
+        if (s_samplers[i][j][k] != VK_NULL_HANDLE)
+          vkDestroySampler(s_device, s_samplers[i][j][k], NULL);
+
+        s_samplers[i][j][k] = VK_NULL_HANDLE;
+      }
+    }
+  }
 
   // uniform buffers
-  for (uint32_t i = 0; i < s_frames_count; ++i) {
+  for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
+    vkUnmapMemory(s_device, s_ubuf_mems[i]);
     vkFreeMemory(s_device, s_ubuf_mems[i], NULL);
     vkDestroyBuffer(s_device, s_ubufs[i], NULL);
   }
@@ -210,17 +500,24 @@ void _gfx_quit(void)
   vkFreeMemory(s_device, s_ind_buf_mem, NULL);
   vkDestroyBuffer(s_device, s_ind_buf, NULL);
 
-  // vertex buffer
-  vkFreeMemory(s_device, s_vert_buf_mem, NULL);
-  vkDestroyBuffer(s_device, s_vert_buf, NULL);
+  // vertex buffers
+  for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
+    vkUnmapMemory(s_device, s_vert_buf_mems[i]);
+    vkFreeMemory(s_device, s_vert_buf_mems[i], NULL);
+    vkDestroyBuffer(s_device, s_vert_bufs[i], NULL);
+  }
 
   // command pools
+  // NOTE: command buffers are freed with their pools
+  for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
+    for (u32 j = 0; j < job_thread_count(); ++j)
+      vkDestroyCommandPool(s_device, s_thread_cmd_pools[i][j], NULL);
+  }
+
   for (i32 i = 0; i < QUEUE_INDEX_MAX; ++i)
     vkDestroyCommandPool(s_device, s_cmd_pools[i], NULL);
 
-  // framebufs
-  for (uint32_t i = 0; i < s_frames_count; ++i)
-    vkDestroyFramebuffer(s_device, s_framebufs[i], NULL);
+  _framebufs_destroy();
 
   // graphics pipeline
   vkDestroyPipeline(s_device, s_pipeline, NULL);
@@ -234,15 +531,32 @@ void _gfx_quit(void)
   vkDestroyRenderPass(s_device, s_render_pass, NULL);
 
   // swapchain
-  for (uint32_t i = 0; i < s_frames_count; ++i)
+  for (uint32_t i = 0; i < s_image_count; ++i)
     vkDestroyImageView(s_device, s_swapchain_views[i], NULL);
-  vkDestroySwapchainKHR(s_device, s_swapchain, NULL);
+
+  if (s_headless)
+    _offscreen_destroy();
+  else
+    vkDestroySwapchainKHR(s_device, s_swapchain, NULL);
+
+  if (s_upscaled)
+    _targets_destroy();
+
+  _depth_resources_destroy();
 
   // main objects
   vkDestroyDevice(s_device, NULL);
-  vkDestroySurfaceKHR(s_instance, s_surface, NULL);
+
+  if (!s_headless)
+    vkDestroySurfaceKHR(s_instance, s_surface, NULL);
+
   vkDestroyInstance(s_instance, NULL);
 
+  s_swapchain = VK_NULL_HANDLE;
+  s_surface = VK_NULL_HANDLE;
+  s_device = VK_NULL_HANDLE;
+  s_last_frame_ind = -1;
+
   trace("gfx terminated");
 }
 
@@ -262,29 +576,41 @@ void _find_queue_families(void)
     if (
       s_queue_families[QUEUE_INDEX_GRAPHICS] == UINT32_MAX &&
       props[i].queueFlags & VK_QUEUE_GRAPHICS_BIT
-    ) {
+    )
       s_queue_families[QUEUE_INDEX_GRAPHICS] = i;
-      continue;
-    }
 
-    // transfer family
+    // transfer family, a dedicated one is preferred
     if (
       s_queue_families[QUEUE_INDEX_TRANSFER] == UINT32_MAX &&
-      props[i].queueFlags & VK_QUEUE_TRANSFER_BIT
-    ) {
+      props[i].queueFlags & VK_QUEUE_TRANSFER_BIT &&
+      !(props[i].queueFlags & VK_QUEUE_GRAPHICS_BIT)
+    )
       s_queue_families[QUEUE_INDEX_TRANSFER] = i;
-      continue;
-    }
+  }
 
-    // present family
-    VkBool32 support_present = 0;
-    vkGetPhysicalDeviceSurfaceSupportKHR(s_gpu, i, s_surface,
-                                         &support_present);
-    if (
-      s_queue_families[QUEUE_INDEX_PRESENT] == UINT32_MAX &&
-      support_present
-    )
-      s_queue_families[QUEUE_INDEX_PRESENT] = i;
+  // NOTE: graphics queues always support transfer operations
+  if (s_queue_families[QUEUE_INDEX_TRANSFER] == UINT32_MAX)
+    s_queue_families[QUEUE_INDEX_TRANSFER] =
+      s_queue_families[QUEUE_INDEX_GRAPHICS];
+
+  // present family, the graphics one is preferred, there is nothing
+  // to present to in the headless mode
+  if (s_headless) {
+    s_queue_families[QUEUE_INDEX_PRESENT] =
+      s_queue_families[QUEUE_INDEX_GRAPHICS];
+  } else {
+    for (uint32_t i = 0; i < count; ++i) {
+      const uint32_t family =
+        (s_queue_families[QUEUE_INDEX_GRAPHICS] + i) % count;
+
+      VkBool32 support_present = 0;
+      vkGetPhysicalDeviceSurfaceSupportKHR(s_gpu, family, s_surface,
+                                           &support_present);
+      if (support_present) {
+        s_queue_families[QUEUE_INDEX_PRESENT] = family;
+        break;
+      }
+    }
   }
 
   for (i32 i = 0; i < QUEUE_INDEX_MAX; ++i) {
@@ -308,7 +634,9 @@ void _check_device_exts(void)
   VkExtensionProperties props[count];
   vkEnumerateDeviceExtensionProperties(s_gpu, NULL, &count, props);
 
-  for (i32 i = 0; i < DEVICE_EXT_COUNT; ++i) {
+  // NOTE: the swapchain extension goes first, it isn't needed in
+  //       the headless mode
+  for (i32 i = s_headless; i < DEVICE_EXT_COUNT; ++i) {
     i32 available = 0;
 
     for (uint32_t j = 0; j < count; ++j) {
@@ -381,8 +709,10 @@ inline static void _onetime_cmdbuf_end(VkCommandBuffer cmdbuf)
                          1, &cmdbuf);
 }
 
-inline static i32 _buf_create(VkBufferUsageFlags usage, VkDeviceSize size,
-                              VkBuffer *buf, VkDeviceMemory *mem)
+inline static i32 _buf_create_ext(VkBufferUsageFlags usage,
+                                  VkDeviceSize size,
+                                  VkMemoryPropertyFlags props,
+                                  VkBuffer *buf, VkDeviceMemory *mem)
 {
   // create buffer
   const VkBufferCreateInfo buf_info = {
@@ -408,8 +738,7 @@ inline static i32 _buf_create(VkBufferUsageFlags usage, VkDeviceSize size,
 
   // get the requirements and find suitable memory type
   uint32_t mem_type_ind = _find_mem_type(
-    mem_requirements.memoryTypeBits,
-    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
+    mem_requirements.memoryTypeBits, props
   );
 
   if (mem_type_ind == UINT32_MAX) {
@@ -436,6 +765,16 @@ inline static i32 _buf_create(VkBufferUsageFlags usage, VkDeviceSize size,
   return 1;
 }
 
+inline static i32 _buf_create(VkBufferUsageFlags usage, VkDeviceSize size,
+                              VkBuffer *buf, VkDeviceMemory *mem)
+{
+  return _buf_create_ext(
+    usage, size,
+    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+    buf, mem
+  );
+}
+
 inline static void _buf_copy(VkBuffer src, VkBuffer dst, VkDeviceSize size)
 {
   VkCommandBuffer cmdbuf;
@@ -459,6 +798,7 @@ inline static void _fill_memory(const void *data, VkDeviceSize size,
 
   _buf_create(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, size, &staging_buf,
               &stagin_buf_mem);
+  ++s_frame_stats.staging_allocs;
 
   void *stagind_buf_mem_ptr;
   vkMapMemory(s_device, stagin_buf_mem, 0, size, 0, &stagind_buf_mem_ptr);
@@ -492,12 +832,16 @@ void _instance_create(void)
     .ppEnabledLayerNames = 0,
   };
 
-  i32 ext_count;
-  opl_vk_device_extensions(&ext_count, NULL);
+  // NOTE: there is no window, and so no surface extensions, in the
+  //       headless mode
+  i32 ext_count = 0;
+  if (!s_headless)
+    opl_vk_device_extensions(&ext_count, NULL);
 
   // +2 for the portability and debug extension names
   const char *ext_names[ext_count + 2];
-  opl_vk_device_extensions(&ext_count, ext_names);
+  if (!s_headless)
+    opl_vk_device_extensions(&ext_count, ext_names);
 
 #ifdef OE_PLATFORM_MACOS
   ext_names[ext_count++] = VK_KHR_PORTABILITY_ENUMERATION_EXTENSION_NAME;
@@ -553,9 +897,18 @@ void _device_create(void)
   const float queue_priorities[] = { 1.0f };
 
   VkDeviceQueueCreateInfo queue_infos[QUEUE_INDEX_MAX];
+  u32 queue_info_count = 0;
 
   for (i32 i = 0; i < QUEUE_INDEX_MAX; ++i) {
-    queue_infos[i] = (VkDeviceQueueCreateInfo){
+    // every family can be requested only once
+    i32 duplicate = 0;
+    for (u32 j = 0; j < queue_info_count; ++j)
+      duplicate |= queue_infos[j].queueFamilyIndex == s_queue_families[i];
+
+    if (duplicate)
+      continue;
+
+    queue_infos[queue_info_count++] = (VkDeviceQueueCreateInfo){
       .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
       .flags = 0,
       .pNext = NULL,
@@ -569,9 +922,9 @@ void _device_create(void)
     .sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
     .flags = 0,
     .pNext = NULL,
-    .enabledExtensionCount = DEVICE_EXT_COUNT,
-    .ppEnabledExtensionNames = s_device_ext_names,
-    .queueCreateInfoCount = QUEUE_INDEX_MAX,
+    .enabledExtensionCount = DEVICE_EXT_COUNT - s_headless,
+    .ppEnabledExtensionNames = s_device_ext_names + s_headless,
+    .queueCreateInfoCount = queue_info_count,
     .pQueueCreateInfos = queue_infos,
   };
 
@@ -596,37 +949,96 @@ void _surface_create(opl_window_t window)
   trace("Vulkan surface created");
 }
 
+void _surface_format_select(void)
+{
+  u32 count;
+  vkGetPhysicalDeviceSurfaceFormatsKHR(s_gpu, s_surface, &count, NULL);
+
+  if (!count)
+    fatal("surface doesn't support any format");
+
+  VkSurfaceFormatKHR formats[count];
+  vkGetPhysicalDeviceSurfaceFormatsKHR(s_gpu, s_surface, &count, formats);
+
+  static const VkFormat preferred[] = {
+    VK_FORMAT_B8G8R8A8_SRGB,
+    VK_FORMAT_R8G8B8A8_SRGB,
+  };
+
+  for (u32 i = 0; i < sizeof(preferred) / sizeof(preferred[0]); ++i) {
+    for (u32 j = 0; j < count; ++j) {
+      if (
+        formats[j].format == preferred[i] &&
+        formats[j].colorSpace == VK_COLOR_SPACE_SRGB_NONLINEAR_KHR
+      ) {
+        s_surface_format = formats[j];
+        debug("surface format selected: %d", s_surface_format.format);
+        return;
+      }
+    }
+  }
+
+  // NOTE: colors will be off without sRGB conversion, but it's still
+  //       better than refusing to run
+  s_surface_format = formats[0];
+  error("surface doesn't support sRGB formats, using %d format",
+        s_surface_format.format);
+}
+
+/**
+ * @brief Returns the requested present mode if the surface supports
+ *        it, otherwise returns FIFO mode, which is always supported.
+ */
+inline static VkPresentModeKHR _present_mode_select(present_mode_t mode)
+{
+  if (is_present_mode_supported(mode))
+    return s_vk_present_modes[mode];
+
+  error("present mode %d is not supported, falling back to FIFO", mode);
+  return VK_PRESENT_MODE_FIFO_KHR;
+}
+
 void _swapchain_create(u16 resx, u16 resy, VkSwapchainKHR old_swapchain)
 {
   VkSurfaceCapabilitiesKHR capabs;
   vkGetPhysicalDeviceSurfaceCapabilitiesKHR(s_gpu, s_surface, &capabs);
 
-  s_swapchain_extent = capabs.currentExtent;
+  // NOTE: some platforms let the swapchain define the surface size,
+  //       keep the previous extent in that case
+  if (capabs.currentExtent.width != UINT32_MAX)
+    s_swapchain_extent = capabs.currentExtent;
+  else if (!s_swapchain_extent.width || !s_swapchain_extent.height)
+    s_swapchain_extent = s_window_extent;
+
+  // one image more than the minimum, so the acquisition doesn't wait
+  // for the presentation engine to release an image
+  u32 image_count = capabs.minImageCount + 1;
+  if (capabs.maxImageCount && image_count > capabs.maxImageCount)
+    image_count = capabs.maxImageCount;
+  if (image_count > MAX_SWAPCHAIN_IMAGES)
+    image_count = MAX_SWAPCHAIN_IMAGES;
 
   assert(
-    capabs.minImageCount <= MAX_FRAMES_COUNT,
-    "minimal image count for the surface is %u, which is bigger than"
-    "MAX_FRAMES_COUNT macro", capabs.minImageCount
+    capabs.minImageCount <= MAX_SWAPCHAIN_IMAGES,
+    "minimal image count for the surface is %u, which is bigger than "
+    "MAX_SWAPCHAIN_IMAGES macro", capabs.minImageCount
   );
 
-  if (resx > 0) { s_swapchain_extent.width  = resx; }
-  if (resy > 0) { s_swapchain_extent.height = resy; }
+  // upscaled frames are presented at the window size
+  if (!s_upscaled) {
+    if (resx > 0) { s_swapchain_extent.width  = resx; }
+    if (resy > 0) { s_swapchain_extent.height = resy; }
+  }
 
   VkSwapchainCreateInfoKHR info = {
     .sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR,
     .flags = 0,
     .pNext = 0,
     .surface = s_surface,
-    .minImageCount = capabs.minImageCount,
-
-    // NOTE: assert for now that all hardware we gonna ship our games
-    //       on supports this format
-    .imageFormat = VK_FORMAT_B8G8R8A8_SRGB,
+    .minImageCount = image_count,
 
-
-    // NOTE: assert for now that all hardware we gonna ship our games
-    //       on supports this color space 
-    .imageColorSpace = VK_COLOR_SPACE_SRGB_NONLINEAR_KHR,
+    .imageFormat = s_surface_format.format,
+    .imageColorSpace = s_surface_format.colorSpace,
 
     .imageExtent = s_swapchain_extent,
     .imageArrayLayers = 1,
@@ -635,9 +1047,7 @@ void _swapchain_create(u16 resx, u16 resy, VkSwapchainKHR old_swapchain)
     .preTransform = capabs.currentTransform,
     .compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR,
 
-    // NOTE: assert for now that all hardware we gonna ship our games
-    //       on supports this present mode
-    .presentMode = VK_PRESENT_MODE_MAILBOX_KHR,
+    .presentMode = _present_mode_select(s_present_mode),
 
     .clipped = VK_TRUE,
     .oldSwapchain = old_swapchain
@@ -661,23 +1071,30 @@ void _swapchain_create(u16 resx, u16 resy, VkSwapchainKHR old_swapchain)
     info.pQueueFamilyIndices = NULL;
   }
 
-  s_frames_count = capabs.minImageCount;
-
   const VkResult res = vkCreateSwapchainKHR(s_device, &info, NULL,
                                             &s_swapchain);
   if (res != VK_SUCCESS)
     fatal("failed to create Vulkan swapchain: %d", res);
   debug("Vulkan swapchain created: %ux%u",
-        capabs.currentExtent.width,
-        capabs.currentExtent.height);
+        s_swapchain_extent.width,
+        s_swapchain_extent.height);
 }
 
 void _swapchain_get_images(void)
 {
-  vkGetSwapchainImagesKHR(s_device, s_swapchain, &s_frames_count,
+  vkGetSwapchainImagesKHR(s_device, s_swapchain, &s_image_count, NULL);
+
+  if (s_image_count > MAX_SWAPCHAIN_IMAGES)
+    fatal("swapchain has %u images, which is bigger than "
+          "MAX_SWAPCHAIN_IMAGES macro", s_image_count);
+
+  vkGetSwapchainImagesKHR(s_device, s_swapchain, &s_image_count,
                           s_swapchain_images);
-  debug("obtained %u swapchain image%c", s_frames_count,
-        s_frames_count > 1 ? 's' : '\0');
+
+  for (uint32_t i = 0; i < s_image_count; ++i)
+    s_image_fences[i] = VK_NULL_HANDLE;
+  debug("obtained %u swapchain image%c", s_image_count,
+        s_image_count > 1 ? 's' : '\0');
 }
 
 void _swapchain_image_views_create(void)
@@ -686,7 +1103,7 @@ void _swapchain_image_views_create(void)
     .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
     .flags = 0,
     .pNext = NULL,
-    .format = VK_FORMAT_B8G8R8A8_SRGB,
+    .format = s_surface_format.format,
     .viewType = VK_IMAGE_VIEW_TYPE_2D,
     .components = {
       .r = VK_COMPONENT_SWIZZLE_IDENTITY,
@@ -703,7 +1120,7 @@ void _swapchain_image_views_create(void)
     },
   };
 
-  for (uint32_t i = 0; i < s_frames_count; ++i) {
+  for (uint32_t i = 0; i < s_image_count; ++i) {
     info.image = s_swapchain_images[i];
 
     const VkResult res = vkCreateImageView(s_device, &info, NULL,
@@ -715,35 +1132,197 @@ void _swapchain_image_views_create(void)
   trace("Vulkan swapchain image views created");
 }
 
-void _swapchain_recreate(u16 resx, u16 resy)
+/**
+ * @brief Recreates swapchain and resources that depend on its size.
+ *
+ * @return Returns 1 on success, or 0 if the surface has zero size
+ *         (e.g. the window is minimized), the swapchain is kept in
+ *         this case.
+ */
+i32 _swapchain_recreate(u16 resx, u16 resy)
 {
-  // framebufs
-  for (uint32_t i = 0; i < s_frames_count; ++i)
-    vkDestroyFramebuffer(s_device, s_framebufs[i], NULL);
+  if (s_headless)
+    return _offscreen_recreate(resx, resy);
+
+  VkSurfaceCapabilitiesKHR capabs;
+  vkGetPhysicalDeviceSurfaceCapabilitiesKHR(s_gpu, s_surface, &capabs);
+
+  if (!capabs.currentExtent.width || !capabs.currentExtent.height)
+    return 0;
+
+  // NOTE: old images are used only by frames in flight, so there is
+  //       no need to wait for the whole device to idle
+  vkWaitForFences(s_device, MAX_FRAMES_IN_FLIGHT, s_in_flight_fences,
+                  VK_TRUE, UINT64_MAX);
+
+  _framebufs_destroy();
 
   // swapchain
-  for (uint32_t i = 0; i < s_frames_count; ++i)
+  for (uint32_t i = 0; i < s_image_count; ++i)
     vkDestroyImageView(s_device, s_swapchain_views[i], NULL);
-  vkDestroySwapchainKHR(s_device, s_swapchain, NULL);
 
-  _swapchain_create(resx, resy, s_swapchain);
+  // the old swapchain is passed to the new one, so the presentation
+  // engine can reuse its resources and finish presenting in flight
+  // images, it's destroyed right after
+  const VkSwapchainKHR old_swapchain = s_swapchain;
+  const VkExtent2D old_extent = s_render_extent;
+
+  _swapchain_create(resx, resy, old_swapchain);
+  vkDestroySwapchainKHR(s_device, old_swapchain, NULL);
+
   _swapchain_get_images();
   _swapchain_image_views_create();
+
+  // targets keep the resolution no matter the window size
+  if (!s_upscaled) {
+    s_render_extent = s_swapchain_extent;
+  } else if (old_extent.width != resx || old_extent.height != resy) {
+    _targets_destroy();
+    _targets_create(resx, resy);
+  }
+
+  if (
+    old_extent.width != s_render_extent.width ||
+    old_extent.height != s_render_extent.height
+  ) {
+    _depth_resources_destroy();
+    _depth_resources_create();
+  }
+
   _framebufs_create();
+
+  s_swapchain_dirty = 0;
+  return 1;
 }
 
 void _depth_resources_create(void) {
-  _image_create(s_swapchain_extent.width, s_swapchain_extent.height,
+  _image_create(s_render_extent.width, s_render_extent.height, 1,
                 VK_FORMAT_D32_SFLOAT,
                 VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &s_depth_image,
                 &s_depth_image_mem);
 
   s_depth_image_view = _image_view_create(
-    s_depth_image, VK_FORMAT_D32_SFLOAT, VK_IMAGE_ASPECT_DEPTH_BIT);
+    s_depth_image, VK_FORMAT_D32_SFLOAT, VK_IMAGE_ASPECT_DEPTH_BIT, 1);
 
   _trans_image_layout(s_depth_image, VK_IMAGE_LAYOUT_UNDEFINED,
-                      VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
+                      VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, 1);
+}
+
+void _depth_resources_destroy(void)
+{
+  vkDestroyImageView(s_device, s_depth_image_view, NULL);
+  vkFreeMemory(s_device, s_depth_image_mem, NULL);
+  vkDestroyImage(s_device, s_depth_image, NULL);
+}
+
+// +------------------------------------------------------------------+
+// |                           offscreen                              |
+// +------------------------------------------------------------------+
+
+void _offscreen_create(u16 resx, u16 resy)
+{
+  // NOTE: every frame in flight gets its own image, just like
+  //       swapchain images, so frames don't wait for each other
+  s_surface_format = (VkSurfaceFormatKHR){
+    .format = VK_FORMAT_R8G8B8A8_SRGB,
+    .colorSpace = VK_COLOR_SPACE_SRGB_NONLINEAR_KHR,
+  };
+  s_swapchain_extent = (VkExtent2D){ resx, resy };
+  s_render_extent = s_swapchain_extent;
+  s_image_count = MAX_FRAMES_IN_FLIGHT;
+
+  for (uint32_t i = 0; i < s_image_count; ++i) {
+    _image_create(resx, resy, 1, s_surface_format.format,
+                  VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
+                  VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+                  VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                  &s_swapchain_images[i], &s_offscreen_mems[i]);
+
+    s_swapchain_views[i] = _image_view_create(
+      s_swapchain_images[i], s_surface_format.format,
+      VK_IMAGE_ASPECT_COLOR_BIT, 1);
+  }
+
+  const VkDeviceSize size = (VkDeviceSize)resx * resy * 4;
+
+  if (!_buf_create(VK_BUFFER_USAGE_TRANSFER_DST_BIT, size,
+                   &s_readback_buf, &s_readback_mem))
+    fatal("failed to create readback buffer");
+
+  vkMapMemory(s_device, s_readback_mem, 0, size, 0, &s_readback_ptr);
+
+  debug("offscreen images created: %ux%u", resx, resy);
+}
+
+void _offscreen_destroy(void)
+{
+  for (uint32_t i = 0; i < s_image_count; ++i) {
+    vkFreeMemory(s_device, s_offscreen_mems[i], NULL);
+    vkDestroyImage(s_device, s_swapchain_images[i], NULL);
+  }
+
+  vkUnmapMemory(s_device, s_readback_mem);
+  vkFreeMemory(s_device, s_readback_mem, NULL);
+  vkDestroyBuffer(s_device, s_readback_buf, NULL);
+}
+
+i32 _offscreen_recreate(u16 resx, u16 resy)
+{
+  if (!resx || !resy)
+    return 0;
+
+  vkWaitForFences(s_device, MAX_FRAMES_IN_FLIGHT, s_in_flight_fences,
+                  VK_TRUE, UINT64_MAX);
+
+  _framebufs_destroy();
+
+  for (uint32_t i = 0; i < s_image_count; ++i)
+    vkDestroyImageView(s_device, s_swapchain_views[i], NULL);
+
+  _offscreen_destroy();
+  _offscreen_create(resx, resy);
+
+  _depth_resources_destroy();
+  _depth_resources_create();
+
+  _framebufs_create();
+
+  s_last_frame_ind = -1;
+  return 1;
+}
+
+// +------------------------------------------------------------------+
+// |                            targets                               |
+// +------------------------------------------------------------------+
+
+void _targets_create(u16 resx, u16 resy)
+{
+  // NOTE: every frame in flight gets its own target, so the next frame
+  //       can be rendered while the previous one is upscaled
+  for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
+    _image_create(resx, resy, 1, s_surface_format.format,
+                  VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
+                  VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+                  VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                  &s_targets[i], &s_target_mems[i]);
+
+    s_target_views[i] = _image_view_create(
+      s_targets[i], s_surface_format.format, VK_IMAGE_ASPECT_COLOR_BIT, 1);
+  }
+
+  s_render_extent = (VkExtent2D){ resx, resy };
+
+  debug("render targets created: %ux%u", resx, resy);
+}
+
+void _targets_destroy(void)
+{
+  for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
+    vkDestroyImageView(s_device, s_target_views[i], NULL);
+    vkFreeMemory(s_device, s_target_mems[i], NULL);
+    vkDestroyImage(s_device, s_targets[i], NULL);
+  }
 }
 
 void _render_pass_create(void)
@@ -751,14 +1330,19 @@ void _render_pass_create(void)
   const VkAttachmentDescription attachment_descs[2] = {
     (VkAttachmentDescription){ // color attachment
       .flags = 0,
-      .format = VK_FORMAT_B8G8R8A8_SRGB,
+      .format = s_surface_format.format,
       .samples = VK_SAMPLE_COUNT_1_BIT,
       .loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
       .storeOp = VK_ATTACHMENT_STORE_OP_STORE,
       .stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
       .stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
       .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
-      .finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+
+      // NOTE: offscreen images are read back and targets are blitted
+      //       to the swapchain instead of presenting
+      .finalLayout = s_headless || s_upscaled ?
+                     VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL :
+                     VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
     },
     (VkAttachmentDescription){ // depth attachment
       .flags = 0,
@@ -769,7 +1353,7 @@ void _render_pass_create(void)
       .stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
       .stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
       .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
-      .finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+      .finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
     }
   };
 
@@ -865,11 +1449,11 @@ void _descriptor_pool_create(void) {
   const VkDescriptorPoolSize sizes[2] = {
     {
       .type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-      .descriptorCount = s_frames_count
+      .descriptorCount = MAX_FRAMES_IN_FLIGHT
     },
     {
       .type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-      .descriptorCount = MAX_TEXTURE_COUNT * s_frames_count
+      .descriptorCount = MAX_TEXTURE_COUNT * MAX_FRAMES_IN_FLIGHT
     }
   };
 
@@ -877,7 +1461,7 @@ void _descriptor_pool_create(void) {
     .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
     .flags = 0,
     .pNext = NULL,
-    .maxSets = s_frames_count,
+    .maxSets = MAX_FRAMES_IN_FLIGHT,
     .poolSizeCount = 2,
     .pPoolSizes = sizes
   };
@@ -890,14 +1474,14 @@ void _descriptor_pool_create(void) {
 }
 
 void _descriptor_sets_allocate(void) {
-  VkDescriptorSetLayout layouts[s_frames_count];
-  for (uint32_t i = 0; i < s_frames_count; ++i)
+  VkDescriptorSetLayout layouts[MAX_FRAMES_IN_FLIGHT];
+  for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i)
     layouts[i] = s_descriptor_set_layout;
 
   const VkDescriptorSetAllocateInfo info = {
     .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
     .pNext = NULL,
-    .descriptorSetCount = s_frames_count,
+    .descriptorSetCount = MAX_FRAMES_IN_FLIGHT,
     .pSetLayouts = layouts,
     .descriptorPool = s_descriptor_pool
   };
@@ -1046,15 +1630,15 @@ void _pipeline_create(void)
   const VkViewport viewport = {
     .x = 0.0f,
     .y = 0.0f,
-    .width = s_swapchain_extent.width,
-    .height = s_swapchain_extent.height,
+    .width = s_render_extent.width,
+    .height = s_render_extent.height,
     .minDepth = 0.0f,
     .maxDepth = 1.0f,
   };
 
   const VkRect2D scissor = {
     .offset = {0, 0},
-    .extent = s_swapchain_extent,
+    .extent = s_render_extent,
   };
 
   const VkPipelineViewportStateCreateInfo viewport_state = {
@@ -1191,16 +1775,20 @@ void _framebufs_create(void)
     .sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO,
     .flags = 0,
     .pNext = NULL,
-    .width = s_swapchain_extent.width,
-    .height = s_swapchain_extent.height,
+    .width = s_render_extent.width,
+    .height = s_render_extent.height,
     .layers = 1,
     .renderPass = s_render_pass,
     .attachmentCount = 2,
     .pAttachments = attachments
   };
 
-  for (uint32_t i = 0; i < s_frames_count; i++) {
-    attachments[0] = s_swapchain_views[i];
+  // upscaled frames are rendered into the target of the frame index,
+  // the others right into the swapchain image
+  s_framebuf_count = s_upscaled ? MAX_FRAMES_IN_FLIGHT : s_image_count;
+
+  for (uint32_t i = 0; i < s_framebuf_count; i++) {
+    attachments[0] = s_upscaled ? s_target_views[i] : s_swapchain_views[i];
 
     const VkResult res = vkCreateFramebuffer(s_device, &info, NULL,
                                              &s_framebufs[i]);
@@ -1211,6 +1799,14 @@ void _framebufs_create(void)
   trace("Vulkan framebuffer created");
 }
 
+void _framebufs_destroy(void)
+{
+  for (uint32_t i = 0; i < s_framebuf_count; ++i)
+    vkDestroyFramebuffer(s_device, s_framebufs[i], NULL);
+
+  s_framebuf_count = 0;
+}
+
 void _cmd_pools_create(void)
 {
   VkCommandPoolCreateInfo info = {
@@ -1237,7 +1833,7 @@ void _cmdbufs_allocate(void)
     .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
     .pNext = NULL,
     .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
-    .commandBufferCount = s_frames_count,
+    .commandBufferCount = MAX_FRAMES_IN_FLIGHT,
   };
 
   for (i32 i = 0; i < QUEUE_INDEX_MAX; ++i) {
@@ -1251,33 +1847,86 @@ void _cmdbufs_allocate(void)
   trace("Vulkan command buffers allocated");
 }
 
+void _thread_cmd_pools_create(void)
+{
+  const VkCommandPoolCreateInfo info = {
+    .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+    .flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+    .pNext = NULL,
+    .queueFamilyIndex = s_queue_families[QUEUE_INDEX_GRAPHICS],
+  };
+
+  for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
+    for (u32 j = 0; j < job_thread_count(); ++j) {
+      const VkResult res = vkCreateCommandPool(
+        s_device, &info, NULL, &s_thread_cmd_pools[i][j]);
+
+      if (res != VK_SUCCESS)
+        fatal("failed to create command pool for %u thread: %d", j, res);
+
+      s_thread_cmdbuf_counts[i][j] = 0;
+    }
+  }
+  trace("Vulkan per-thread command pools created");
+}
+
 void _vert_buf_create(void)
 {
-  if (!_buf_create(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-                   sizeof(_vert_t) * RESERVED_VERTS_COUNT,
-                   &s_vert_buf, &s_vert_buf_mem))
-    fatal("failed to create buffer");
-  trace("Vulkan vertex buffer created");
+  for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
+    if (!_buf_create(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+                     sizeof(_vert_t) * RESERVED_VERTS_COUNT,
+                     &s_vert_bufs[i], &s_vert_buf_mems[i]))
+      fatal("failed to create buffer");
+
+    // NOTE: vertex buffers are host coherent and stay mapped for
+    //       the whole lifetime, sprites are written right into them
+    vkMapMemory(s_device, s_vert_buf_mems[i], 0,
+                sizeof(_vert_t) * RESERVED_VERTS_COUNT, 0,
+                (void**)&s_vert_ptrs[i]);
+  }
+  trace("Vulkan vertex buffers created");
 }
 
 void _ind_buf_create(void)
 {
-  if (!_buf_create(VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
-                   sizeof(uint16_t) * RESERVED_VERTS_COUNT * 1.5f,
+  const VkDeviceSize size =
+    sizeof(uint16_t) * RESERVED_VERTS_COUNT / 4 * 6;
+
+  if (!_buf_create(VK_BUFFER_USAGE_INDEX_BUFFER_BIT, size,
                    &s_ind_buf, &s_ind_buf_mem))
     fatal("failed to create buffer");
+
+  // every sprite is a quad, so indices are the same for all frames
+  // and are written only once
+  uint16_t *inds;
+  vkMapMemory(s_device, s_ind_buf_mem, 0, size, 0, (void**)&inds);
+
+  for (i32 i = 0; i < RESERVED_VERTS_COUNT / 4; ++i) {
+    inds[i * 6 + 0] = i * 4 + 0;
+    inds[i * 6 + 1] = i * 4 + 1;
+    inds[i * 6 + 2] = i * 4 + 2;
+    inds[i * 6 + 3] = i * 4 + 2;
+    inds[i * 6 + 4] = i * 4 + 3;
+    inds[i * 6 + 5] = i * 4 + 0;
+  }
+
+  vkUnmapMemory(s_device, s_ind_buf_mem);
+
   trace("Vulkan index buffer created");
 }
 
 void _ubuf_create(void) {
-  VkDescriptorBufferInfo buf_infos[s_frames_count];
-  VkWriteDescriptorSet writes[s_frames_count];
+  VkDescriptorBufferInfo buf_infos[MAX_FRAMES_IN_FLIGHT];
+  VkWriteDescriptorSet writes[MAX_FRAMES_IN_FLIGHT];
 
-  for (uint32_t i = 0; i < s_frames_count; ++i) {
+  for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
     if (!_buf_create(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, sizeof(_ubo_t),
                      &s_ubufs[i], &s_ubuf_mems[i]))
       fatal("failed to create Vulkan uniform buffer");
 
+    vkMapMemory(s_device, s_ubuf_mems[i], 0, sizeof(_ubo_t), 0,
+                &s_ubuf_ptrs[i]);
+
     buf_infos[i] = (VkDescriptorBufferInfo){
       .range = sizeof(_ubo_t),
       .buffer = s_ubufs[i],
@@ -1298,38 +1947,55 @@ void _ubuf_create(void) {
     };
   }
 
-  vkUpdateDescriptorSets(s_device, s_frames_count, writes, 0, NULL);
+  vkUpdateDescriptorSets(s_device, MAX_FRAMES_IN_FLIGHT, writes, 0, NULL);
 
   trace("Vulkan uniform buffers created");
 }
 
-void _sampler_create(void) {
-  VkPhysicalDeviceProperties props;
-  vkGetPhysicalDeviceProperties(s_gpu, &props);
+VkSampler _sampler_get(texture_params_t params)
+{
+  assert(params.filter < TEXTURE_FILTER_MAX, "invalid texture filter");
+  assert(params.mip < TEXTURE_MIP_MAX, "invalid texture mip mode");
+  assert(params.wrap < TEXTURE_WRAP_MAX, "invalid texture wrap mode");
+
+  VkSampler *sampler = &s_samplers[params.filter][params.mip][params.wrap];
+  if (*sampler != VK_NULL_HANDLE)
+    return *sampler;
+
+  const VkFilter filter = params.filter == TEXTURE_FILTER_LINEAR ?
+                          VK_FILTER_LINEAR : VK_FILTER_NEAREST;
+  const VkSamplerAddressMode wrap = params.wrap == TEXTURE_WRAP_CLAMP ?
+                                    VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE :
+                                    VK_SAMPLER_ADDRESS_MODE_REPEAT;
 
   const VkSamplerCreateInfo info = {
     .sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
-    .magFilter = VK_FILTER_NEAREST,
-    .minFilter = VK_FILTER_NEAREST,
-    .addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT,
-    .addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT,
-    .addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT,
+    .magFilter = filter,
+    .minFilter = filter,
+    .addressModeU = wrap,
+    .addressModeV = wrap,
+    .addressModeW = wrap,
     .anisotropyEnable = VK_FALSE,
-    // samplerInfo.maxAnisotropy
     .borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK,
     .unnormalizedCoordinates = VK_FALSE,
     .compareEnable = VK_FALSE,
     .compareOp = VK_COMPARE_OP_ALWAYS,
-    .mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR,
+    .mipmapMode = params.mip == TEXTURE_MIP_LINEAR ?
+                  VK_SAMPLER_MIPMAP_MODE_LINEAR :
+                  VK_SAMPLER_MIPMAP_MODE_NEAREST,
     .mipLodBias = 0.0f,
     .minLod = 0.0f,
-    .maxLod = 0.0f,
+    // textures without mips only have the base level anyway
+    .maxLod = params.mip == TEXTURE_MIP_NONE ? 0.0f : VK_LOD_CLAMP_NONE,
   };
 
-  VkResult res = vkCreateSampler(s_device, &info, NULL, &s_sampler);
+  VkResult res = vkCreateSampler(s_device, &info, NULL, sampler);
   if (res != VK_SUCCESS)
     fatal("failed to create Vulkan sampler");
-  trace("Vulkan sampler created");
+  trace("Vulkan sampler created: filter %d, mip %d, wrap %d",
+        params.filter, params.mip, params.wrap);
+
+  return *sampler;
 }
 
 void _sync_objects_create(void)
@@ -1346,56 +2012,914 @@ void _sync_objects_create(void)
     .pNext = NULL,
   };
 
-  for (uint32_t i = 0; i < s_frames_count; ++i) {
+  // NOTE: sync objects are created for the maximum number of frames
+  //       in flight, so the latency mode can be changed at any time
+  for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
     const VkResult res1 = vkCreateSemaphore(
       s_device, &semaphore_info, NULL,
       &s_image_available_semaphores[i]);
 
-    const VkResult res2 = vkCreateSemaphore(
-      s_device, &semaphore_info, NULL, 
-      &s_renderer_finished_semaphores[i]);
-
-    const VkResult res3 = vkCreateFence(
+    const VkResult res2 = vkCreateFence(
       s_device, &fence_info, NULL,
       &s_in_flight_fences[i]);
 
-    if (res1 != VK_SUCCESS || res2 != VK_SUCCESS || res3 != VK_SUCCESS)
-      fatal("failed to create sync objecsts: %d;%d;%d",
-            res1, res2, res3);
+    if (res1 != VK_SUCCESS || res2 != VK_SUCCESS)
+      fatal("failed to create sync objecsts: %d;%d", res1, res2);
+  }
+
+  // presentation waits on the image's semaphore, as the image might
+  // be still presented when the frame that rendered it is finished
+  for (uint32_t i = 0; i < MAX_SWAPCHAIN_IMAGES; ++i) {
+    const VkResult res = vkCreateSemaphore(
+      s_device, &semaphore_info, NULL,
+      &s_renderer_finished_semaphores[i]);
+
+    if (res != VK_SUCCESS)
+      fatal("failed to create sync objecsts: %d", res);
+
+    s_image_fences[i] = VK_NULL_HANDLE;
   }
   trace("Vulkan sync objects created");
 }
 
-void draw_begin(color_t color)
+void _query_pools_create(void)
 {
-  vkWaitForFences(s_device, 1, &s_in_flight_fences[s_cur_frame_ind],
-                  VK_TRUE, UINT64_MAX);
-  vkResetFences(s_device, 1, &s_in_flight_fences[s_cur_frame_ind]);
+  uint32_t count;
+  vkGetPhysicalDeviceQueueFamilyProperties(s_gpu, &count, NULL);
 
-  vkAcquireNextImageKHR(s_device, s_swapchain, UINT64_MAX,
-                        s_image_available_semaphores[s_cur_frame_ind],
-                        VK_NULL_HANDLE, &s_cur_image_ind);
+  VkQueueFamilyProperties props[count];
+  vkGetPhysicalDeviceQueueFamilyProperties(s_gpu, &count, props);
 
-  vkResetCommandBuffer(CUR_GRAPHICS_CMDBUF, 0 /* reset flags */);
+  const u32 valid_bits =
+    props[s_queue_families[QUEUE_INDEX_GRAPHICS]].timestampValidBits;
 
-  static const VkCommandBufferBeginInfo cmdbuf_begin_info = {
-    .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
-    .flags = 0,
+  // NOTE: gpu timings are optional, drawing works the same without
+  if (!valid_bits) {
+    s_timestamps_supported = 0;
+    debug("graphics queue doesn't support timestamps, "
+          "gpu timings are disabled");
+    return;
+  }
+
+  VkPhysicalDeviceProperties gpu_props;
+  vkGetPhysicalDeviceProperties(s_gpu, &gpu_props);
+
+  s_timestamp_period = gpu_props.limits.timestampPeriod;
+  s_timestamp_mask = valid_bits >= 64 ? UINT64_MAX
+                                      : ((u64)1 << valid_bits) - 1;
+
+  const VkQueryPoolCreateInfo info = {
+    .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
     .pNext = NULL,
-    .pInheritanceInfo = NULL,
+    .flags = 0,
+    .queryType = VK_QUERY_TYPE_TIMESTAMP,
+    .queryCount = QUERIES_PER_FRAME,
+    .pipelineStatistics = 0,
   };
 
-  vkBeginCommandBuffer(CUR_GRAPHICS_CMDBUF, &cmdbuf_begin_info);
+  for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
+    const VkResult res = vkCreateQueryPool(s_device, &info, NULL,
+                                           &s_query_pools[i]);
+    if (res != VK_SUCCESS)
+      fatal("failed to create query pool: %d", res);
+  }
 
-  const VkClearValue clear_values[2] = {
-    (VkClearValue){
-      .color = {{
-        (color >> 24) / 255.0f,
-        (color >> 16 & 0xff) / 255.0f,
-        (color >> 8 & 0xff) / 255.0f,
-        (color & 0xff) / 255.0f
-      }}
-    },
+  s_timestamps_supported = 1;
+  trace("Vulkan query pools created");
+}
+
+// +------------------------------------------------------------------+
+// |                          sprite queues                           |
+// +------------------------------------------------------------------+
+
+inline static void _queue_reset(_sprite_queue_t *queue)
+{
+  queue->chunk_first = 0;
+  queue->chunk_used  = QUEUE_CHUNK_VERTS; // forces chunk reservation
+  queue->span_count  = 0;
+}
+
+/**
+ * @brief Reserves vertices for up to count sprites in the queue,
+ *        a reservation never crosses chunks.
+ *
+ * @param reserved Receives the number of reserved sprites.
+ *
+ * @return Returns a pointer to the reserved vertices in the mapped
+ *         vertex buffer, or NULL if the buffer is exhausted.
+ */
+inline static _vert_t *_queue_reserve(_sprite_queue_t *queue, u32 count,
+                                      u32 *reserved)
+{
+  if (queue->chunk_used == QUEUE_CHUNK_VERTS) {
+    const u32 first = __atomic_fetch_add(&s_vert_count, QUEUE_CHUNK_VERTS,
+                                         __ATOMIC_RELAXED);
+
+    if (first + QUEUE_CHUNK_VERTS > RESERVED_VERTS_COUNT)
+      return NULL;
+
+    queue->chunk_first = first;
+    queue->chunk_used  = 0;
+  }
+
+  const u32 vert = queue->chunk_first + queue->chunk_used;
+  _span_t *span = queue->span_count ?
+                  &queue->spans[queue->span_count - 1] : NULL;
+
+  // continue the last span if the vertex follows it in the same order
+  if (
+    !span ||
+    span->first + span->count != vert ||
+    span->order != t_order
+  ) {
+    if (queue->span_count == MAX_QUEUE_SPANS)
+      return NULL;
+
+    span = &queue->spans[queue->span_count++];
+    *span = (_span_t){ vert, 0, t_order };
+  }
+
+  const u32 free_count = (QUEUE_CHUNK_VERTS - queue->chunk_used) / 4;
+  *reserved = count < free_count ? count : free_count;
+
+  span->count += *reserved * 4;
+  queue->chunk_used += *reserved * 4;
+
+  return &s_vert_ptrs[s_cur_frame_ind][vert];
+}
+
+_vert_t *_sprites_reserve(u32 count, u32 *reserved)
+{
+  if (t_queue)
+    return _queue_reserve(t_queue, count, reserved);
+
+  // queues are unsynchronized, every thread needs its own
+  const u32 thread = job_thread_ind();
+  assert(thread != JOB_THREAD_NONE,
+         "sprites can be drawn only from the main thread and jobs");
+  if (thread == JOB_THREAD_NONE)
+    return NULL;
+
+  return _queue_reserve(&s_thread_queues[thread], count, reserved);
+}
+
+/**
+ * @brief Returns an unused secondary command buffer of the calling
+ *        thread.
+ *
+ * @return Returns the command buffer, or VK_NULL_HANDLE if the thread
+ *         isn't a job system thread.
+ */
+inline static VkCommandBuffer _secondary_cmdbuf_get(void)
+{
+  // command pools are unsynchronized, every thread needs its own
+  const u32 thread = job_thread_ind();
+  assert(thread != JOB_THREAD_NONE,
+         "sprites can be recorded only by the main thread and jobs");
+  if (thread == JOB_THREAD_NONE)
+    return VK_NULL_HANDLE;
+
+  u32 *count = &s_thread_cmdbuf_counts[s_cur_frame_ind][thread];
+  VkCommandBuffer *cmdbufs = s_thread_cmdbufs[s_cur_frame_ind][thread];
+
+  if (s_thread_cmdbufs_used[thread] < *count)
+    return cmdbufs[s_thread_cmdbufs_used[thread]++];
+
+  if (*count == MAX_THREAD_CMDBUFS)
+    fatal("%u thread exceeded secondary command buffers limit", thread);
+
+  const VkCommandBufferAllocateInfo info = {
+    .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+    .pNext = NULL,
+    .level = VK_COMMAND_BUFFER_LEVEL_SECONDARY,
+    .commandPool = s_thread_cmd_pools[s_cur_frame_ind][thread],
+    .commandBufferCount = 1,
+  };
+
+  const VkResult res = vkAllocateCommandBuffers(s_device, &info,
+                                                &cmdbufs[*count]);
+  if (res != VK_SUCCESS)
+    fatal("failed to allocate secondary command buffer: %d", res);
+
+  ++(*count);
+  return cmdbufs[s_thread_cmdbufs_used[thread]++];
+}
+
+/**
+ * @brief Stable sorts spans of the queue by the draw order key.
+ *
+ * Spans are usually already sorted, so insertion sort is enough.
+ */
+inline static void _queue_sort(_sprite_queue_t *queue)
+{
+  for (u32 i = 1; i < queue->span_count; ++i) {
+    const _span_t span = queue->spans[i];
+
+    u32 j = i;
+    for (; j > 0 && queue->spans[j - 1].order > span.order; --j)
+      queue->spans[j] = queue->spans[j - 1];
+
+    queue->spans[j] = span;
+  }
+}
+
+/**
+ * @brief Returns the framebuffer the current frame is rendered to.
+ */
+inline static VkFramebuffer _cur_framebuf(void)
+{
+  // upscaled frames are rendered into the frame's own target
+  return s_framebufs[s_upscaled ? (u32)s_cur_frame_ind : s_cur_image_ind];
+}
+
+/**
+ * @brief Begins a secondary command buffer inside of the frame's
+ *        render pass.
+ *
+ * @return Returns the command buffer, or VK_NULL_HANDLE if the thread
+ *         can't record.
+ */
+static VkCommandBuffer _secondary_begin(void)
+{
+  const VkCommandBuffer cmdbuf = _secondary_cmdbuf_get();
+  if (cmdbuf == VK_NULL_HANDLE)
+    return VK_NULL_HANDLE;
+
+  const VkCommandBufferInheritanceInfo inheritance_info = {
+    .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO,
+    .pNext = NULL,
+    .renderPass = s_render_pass,
+    .subpass = 0,
+    .framebuffer = _cur_framebuf(),
+  };
+
+  const VkCommandBufferBeginInfo begin_info = {
+    .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+    .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT |
+             VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT,
+    .pNext = NULL,
+    .pInheritanceInfo = &inheritance_info,
+  };
+
+  vkBeginCommandBuffer(cmdbuf, &begin_info);
+
+  return cmdbuf;
+}
+
+/**
+ * @brief Binds the sprite pipeline and its state for drawing sprites
+ *        from the vertex buffer.
+ */
+static void _sprite_state_bind(VkCommandBuffer cmdbuf, VkBuffer vert_buf)
+{
+  vkCmdBindPipeline(cmdbuf, VK_PIPELINE_BIND_POINT_GRAPHICS, s_pipeline);
+
+  const VkViewport viewport = {
+    .x = 0.0f,
+    .y = 0.0f,
+    .width = s_frame_extent.width,
+    .height = s_frame_extent.height,
+    .minDepth = 0.0f,
+    .maxDepth = 1.0f,
+  };
+  vkCmdSetViewport(cmdbuf, 0, 1, &viewport);
+
+  const VkRect2D scissor = {
+    .offset = {0, 0},
+    .extent = s_frame_extent,
+  };
+  vkCmdSetScissor(cmdbuf, 0, 1, &scissor);
+
+  vkCmdBindDescriptorSets(cmdbuf, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                          s_pipeline_layout, 0, 1,
+                          &s_descriptor_sets[s_cur_frame_ind], 0, NULL);
+
+  static const VkDeviceSize offsets[1] = { 0 };
+  vkCmdBindVertexBuffers(cmdbuf, 0, 1, &vert_buf, offsets);
+
+  vkCmdBindIndexBuffer(cmdbuf, s_ind_buf, 0, VK_INDEX_TYPE_UINT16);
+}
+
+/**
+ * @brief Records spans into a secondary command buffer.
+ *
+ * @param slot Index of the secondary slot the command buffer goes to,
+ *             the gpu time is measured only for the first
+ *             GFX_MAX_TIMED_PASSES slots.
+ *
+ * @return Returns the recorded command buffer, or VK_NULL_HANDLE if
+ *         there are no spans or the thread can't record.
+ */
+static VkCommandBuffer _record(const _span_t *spans, u32 count,
+                               u32 slot)
+{
+  if (!count)
+    return VK_NULL_HANDLE;
+
+  profile_begin("record");
+
+  const VkCommandBuffer cmdbuf = _secondary_begin();
+  if (cmdbuf == VK_NULL_HANDLE) {
+    profile_end();
+    return VK_NULL_HANDLE;
+  }
+
+  const i32 timed = s_timestamps_supported &&
+                    slot < GFX_MAX_TIMED_PASSES;
+  const VkQueryPool query_pool = s_query_pools[s_cur_frame_ind];
+
+  if (timed)
+    vkCmdWriteTimestamp(cmdbuf, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                        query_pool, 2 + 2 * slot);
+
+  _sprite_state_bind(cmdbuf, s_vert_bufs[s_cur_frame_ind]);
+
+  u32 first = spans[0].first;
+  u32 verts = spans[0].count;
+  u32 quads = 0;
+  u32 draw_calls = 0;
+
+  for (u32 i = 1; i <= count; ++i) {
+    // spans that lie next to each other in the buffer share a draw
+    if (i < count && spans[i].first == first + verts) {
+      verts += spans[i].count;
+      continue;
+    }
+
+    vkCmdDrawIndexed(cmdbuf, verts / 4 * 6, 1, 0, first, 0);
+    quads += verts / 4;
+    ++draw_calls;
+
+    if (i < count) {
+      first = spans[i].first;
+      verts = spans[i].count;
+    }
+  }
+
+  if (timed) {
+    vkCmdWriteTimestamp(cmdbuf, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                        query_pool, 2 + 2 * slot + 1);
+    s_pass_timed[s_cur_frame_ind][slot] = 1;
+  }
+
+  vkEndCommandBuffer(cmdbuf);
+
+  // NOTE: layers are recorded by several threads at once
+  __atomic_add_fetch(&s_frame_stats.quads, quads, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&s_frame_stats.draw_calls, draw_calls,
+                     __ATOMIC_RELAXED);
+  __atomic_add_fetch(&s_frame_stats.pipeline_binds, 1, __ATOMIC_RELAXED);
+
+  profile_end();
+
+  return cmdbuf;
+}
+
+/**
+ * @brief Records sprites drawn outside of layers by all the threads
+ *        so far, so they're executed before anything recorded after.
+ *
+ * Queues are merged by the draw order key, sprites with the same key
+ * go in the thread index order, and then in the order they were
+ * drawn by the thread.
+ */
+static void _thread_queues_flush(void)
+{
+  const u32 thread_count = job_thread_count();
+  u32 heads[JOB_MAX_THREADS] = { 0 };
+  u32 count = 0;
+
+  for (u32 i = 0; i < thread_count; ++i)
+    _queue_sort(&s_thread_queues[i]);
+
+  // k-way merge of the sorted queues
+  for (;;) {
+    _sprite_queue_t *min = NULL;
+    u32 min_thread = 0;
+
+    for (u32 i = 0; i < thread_count; ++i) {
+      _sprite_queue_t *queue = &s_thread_queues[i];
+      if (heads[i] == queue->span_count)
+        continue;
+
+      if (!min || queue->spans[heads[i]].order <
+                  min->spans[heads[min_thread]].order) {
+        min = queue;
+        min_thread = i;
+      }
+    }
+
+    if (!min)
+      break;
+
+    s_merged_spans[count++] = min->spans[heads[min_thread]++];
+  }
+
+  // NOTE: the rest of the current chunks is kept for the next sprites
+  for (u32 i = 0; i < thread_count; ++i)
+    s_thread_queues[i].span_count = 0;
+
+  const VkCommandBuffer cmdbuf = _record(s_merged_spans, count,
+                                         s_secondary_count);
+  if (cmdbuf == VK_NULL_HANDLE)
+    return;
+
+  if (s_secondary_count == MAX_SECONDARY_CMDBUFS)
+    fatal("secondary command buffers limit exceeded");
+
+  s_secondaries[s_secondary_count++] = cmdbuf;
+}
+
+static void _layers_job(u32 start, u32 end, void *data)
+{
+  const _layers_ctx_t *ctx = data;
+
+  // NOTE: a layer function waiting for its own jobs might execute
+  //       another layer on this thread, so the queue is restored
+  _sprite_queue_t *prev_queue = t_queue;
+
+  _sprite_queue_t queue;
+  _queue_reset(&queue);
+
+  for (u32 i = start; i < end; ++i) {
+    t_queue = &queue;
+    ctx->fn(i, ctx->data);
+
+    _queue_sort(&queue);
+    s_secondaries[ctx->base + i] =
+      _record(queue.spans, queue.span_count, ctx->base + i);
+
+    // NOTE: the rest of the current chunk is kept for the next layer
+    queue.span_count = 0;
+  }
+
+  t_queue = prev_queue;
+}
+
+// +------------------------------------------------------------------+
+// |                           timestamps                             |
+// +------------------------------------------------------------------+
+
+/**
+ * @brief Reads a pair of timestamps from the frame's query pool.
+ *
+ * @return Returns the time between them in milliseconds, or a negative
+ *         value if the queries aren't available.
+ */
+static f64 _timestamps_read(u32 frame, u32 first)
+{
+  u64 ticks[2];
+
+  // NOTE: the frame fence is signaled, so the results never stall
+  const VkResult res = vkGetQueryPoolResults(
+    s_device, s_query_pools[frame], first, 2, sizeof(ticks), ticks,
+    sizeof(u64), VK_QUERY_RESULT_64_BIT);
+
+  if (res != VK_SUCCESS)
+    return -1.0;
+
+  const u64 delta = ((ticks[1] & s_timestamp_mask) -
+                     (ticks[0] & s_timestamp_mask)) & s_timestamp_mask;
+
+  return (f64)delta * s_timestamp_period / 1000000.0;
+}
+
+/**
+ * @brief Feeds the gpu frame time to the dynamic resolution controller.
+ *
+ * The scale goes down as soon as a few frames are over the budget,
+ * by the root of the overrun since the cost grows with the area, and
+ * goes up by small steps after many frames with the headroom.
+ */
+static void _dynres_update(f64 frame_ms)
+{
+  if (!s_dynres.enabled)
+    return;
+
+  if (s_dynres.cooldown) {
+    --s_dynres.cooldown;
+    return;
+  }
+
+  s_dynres.avg_ms = s_dynres.avg_ms > 0.0 ?
+    s_dynres.avg_ms + (frame_ms - s_dynres.avg_ms) * DYNRES_SMOOTHING :
+    frame_ms;
+
+  const f64 budget = s_dynres.settings.target_ms;
+
+  if (s_dynres.avg_ms > budget) {
+    ++s_dynres.over;
+    s_dynres.under = 0;
+  } else if (s_dynres.avg_ms < budget * DYNRES_HEADROOM) {
+    ++s_dynres.under;
+    s_dynres.over = 0;
+  } else {
+    s_dynres.over = 0;
+    s_dynres.under = 0;
+  }
+
+  f32 scale = s_dynres.scale;
+
+  if (s_dynres.over >= DYNRES_DOWN_FRAMES)
+    scale *= (f32)sqrt(budget / s_dynres.avg_ms);
+  else if (s_dynres.under >= DYNRES_UP_FRAMES)
+    scale += DYNRES_UP_STEP;
+  else
+    return;
+
+  scale = clamp(scale, s_dynres.settings.min_scale,
+                s_dynres.settings.max_scale);
+
+  s_dynres.over = 0;
+  s_dynres.under = 0;
+
+  if (scale == s_dynres.scale)
+    return;
+
+  debug("render scale: %.2f -> %.2f, gpu frame %.3f ms",
+        s_dynres.scale, scale, s_dynres.avg_ms);
+
+  // timings at the previous scale don't tell anything anymore
+  s_dynres.scale = scale;
+  s_dynres.avg_ms = 0.0;
+  s_dynres.cooldown = DYNRES_COOLDOWN_FRAMES;
+}
+
+/**
+ * @brief Resolves timings of the frame that used the current frame
+ *        index last time.
+ *
+ * Should be called after the frame fence is waited.
+ */
+static void _timestamps_resolve(void)
+{
+  const u32 frame = s_cur_frame_ind;
+
+  if (!s_query_frames[frame])
+    return;
+
+  const f64 frame_ms = _timestamps_read(frame, 0);
+
+  if (frame_ms >= 0.0) {
+    s_gpu_stats.frame = s_query_frames[frame];
+    s_gpu_stats.frame_ms = frame_ms;
+    s_gpu_stats.pass_count = 0;
+
+    // passes go in the execution order, empty ones are skipped
+    for (u32 i = 0; i < GFX_MAX_TIMED_PASSES; ++i) {
+      if (!s_pass_timed[frame][i])
+        continue;
+
+      const f64 pass_ms = _timestamps_read(frame, 2 + 2 * i);
+      s_gpu_stats.pass_ms[s_gpu_stats.pass_count++] =
+        pass_ms >= 0.0 ? pass_ms : 0.0;
+    }
+
+    if (
+      s_gpu_stats_log_interval &&
+      s_gpu_stats.frame % s_gpu_stats_log_interval == 0
+    )
+      info("gpu frame %llu: %.3f ms, %u passes",
+           (unsigned long long)s_gpu_stats.frame, s_gpu_stats.frame_ms,
+           s_gpu_stats.pass_count);
+
+    _dynres_update(frame_ms);
+  }
+
+  s_query_frames[frame] = 0;
+}
+
+// +------------------------------------------------------------------+
+// |                            drawing                               |
+// +------------------------------------------------------------------+
+
+/**
+ * @brief Acquires the next swapchain image, recreates the swapchain
+ *        if it's out of date.
+ *
+ * @return Returns 1 on success, or 0 if there is no image to draw
+ *         the frame to.
+ */
+inline static i32 _image_acquire(void)
+{
+  if (s_swapchain_dirty && !_swapchain_recreate(s_resx, s_resy))
+    return 0;
+
+  VkResult res = vkAcquireNextImageKHR(
+    s_device, s_swapchain, UINT64_MAX,
+    s_image_available_semaphores[s_cur_frame_ind], VK_NULL_HANDLE,
+    &s_cur_image_ind);
+
+  if (res == VK_ERROR_OUT_OF_DATE_KHR) {
+    if (!_swapchain_recreate(s_resx, s_resy)) {
+      s_swapchain_dirty = 1;
+      return 0;
+    }
+
+    res = vkAcquireNextImageKHR(
+      s_device, s_swapchain, UINT64_MAX,
+      s_image_available_semaphores[s_cur_frame_ind], VK_NULL_HANDLE,
+      &s_cur_image_ind);
+  }
+
+  // NOTE: suboptimal image can still be presented, the swapchain is
+  //       recreated on the next frame
+  if (res == VK_SUBOPTIMAL_KHR) {
+    s_swapchain_dirty = 1;
+    return 1;
+  }
+
+  if (res != VK_SUCCESS) {
+    error("failed to acquire swapchain image: %d", res);
+    s_swapchain_dirty = 1;
+    return 0;
+  }
+
+  return 1;
+}
+
+/**
+ * @brief Makes the current frame statistics the last frame ones and
+ *        starts counting the next frame.
+ */
+static void _frame_stats_finish(void)
+{
+  s_last_frame_stats = s_frame_stats;
+  s_frame_stats_history[s_frame_stats_count % GFX_FRAME_STATS_WINDOW] =
+    s_frame_stats;
+  ++s_frame_stats_count;
+
+  memset(&s_frame_stats, 0, sizeof(s_frame_stats));
+}
+
+/**
+ * @brief Updates the part of the target the frame is drawn to by the
+ *        dynamic resolution scale.
+ */
+inline static void _frame_extent_update(void)
+{
+  s_frame_extent = s_render_extent;
+
+  if (!s_dynres.enabled)
+    return;
+
+  const f32 w = s_render_extent.width * s_dynres.scale + 0.5f;
+  const f32 h = s_render_extent.height * s_dynres.scale + 0.5f;
+
+  if (w >= 1.0f && w < s_render_extent.width)
+    s_frame_extent.width = (u32)w;
+  if (h >= 1.0f && h < s_render_extent.height)
+    s_frame_extent.height = (u32)h;
+}
+
+/**
+ * @brief Records the blit of the frame target into the swapchain image.
+ *
+ * The target is scaled by the largest integer factor that fits the
+ * window and centered, so pixels stay square and crisp, the bars
+ * around it are cleared. Windows smaller than the resolution get the
+ * target downscaled to fit.
+ */
+static void _upscale(VkCommandBuffer cmdbuf)
+{
+  const VkImage target = s_targets[s_cur_frame_ind];
+  const VkImage image = s_swapchain_images[s_cur_image_ind];
+
+  const u32 sw = s_swapchain_extent.width, sh = s_swapchain_extent.height;
+  const u32 rw = s_render_extent.width, rh = s_render_extent.height;
+
+  // frames drawn to the part of the target take the same place on
+  // the screen, but aren't scaled by an integer factor
+  const i32 partial = s_frame_extent.width != rw ||
+                      s_frame_extent.height != rh;
+
+  const u32 scale = sw / rw < sh / rh ? sw / rw : sh / rh;
+  VkFilter filter = partial ? VK_FILTER_LINEAR : VK_FILTER_NEAREST;
+  u32 w = rw * scale, h = rh * scale;
+
+  if (!scale) {
+    filter = VK_FILTER_LINEAR;
+
+    if ((u64)sw * rh < (u64)sh * rw) {
+      w = sw;
+      h = (u32)((u64)rh * sw / rw);
+    } else {
+      w = (u32)((u64)rw * sh / rh);
+      h = sh;
+    }
+
+    if (!w) { w = 1; }
+    if (!h) { h = 1; }
+  }
+
+  const VkImageSubresourceRange range = {
+    .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+    .baseMipLevel = 0,
+    .levelCount = 1,
+    .baseArrayLayer = 0,
+    .layerCount = 1,
+  };
+
+  // the target is left in the transfer source layout by the render
+  // pass, the swapchain image contents are discarded
+  const VkImageMemoryBarrier begin_barriers[2] = {
+    {
+      .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+      .srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+      .dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT,
+      .oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+      .newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+      .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+      .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+      .image = target,
+      .subresourceRange = range,
+    },
+    {
+      .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+      .srcAccessMask = 0,
+      .dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+      .oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+      .newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+      .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+      .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+      .image = image,
+      .subresourceRange = range,
+    },
+  };
+
+  vkCmdPipelineBarrier(cmdbuf,
+                       VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
+                       VK_PIPELINE_STAGE_TRANSFER_BIT,
+                       VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, NULL, 0, NULL,
+                       2, begin_barriers);
+
+  if (w < sw || h < sh) {
+    static const VkClearColorValue black = {{ 0.0f, 0.0f, 0.0f, 1.0f }};
+    vkCmdClearColorImage(cmdbuf, image,
+                         VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, &black, 1,
+                         &range);
+
+    const VkImageMemoryBarrier clear_barrier = {
+      .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+      .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+      .dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+      .oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+      .newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+      .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+      .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+      .image = image,
+      .subresourceRange = range,
+    };
+
+    vkCmdPipelineBarrier(cmdbuf, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, NULL, 0,
+                         NULL, 1, &clear_barrier);
+  }
+
+  const i32 x = (i32)(sw - w) / 2;
+  const i32 y = (i32)(sh - h) / 2;
+
+  const VkImageBlit blit = {
+    .srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+    .srcSubresource.mipLevel = 0,
+    .srcSubresource.baseArrayLayer = 0,
+    .srcSubresource.layerCount = 1,
+    .srcOffsets = {
+      { 0, 0, 0 },
+      { (i32)s_frame_extent.width, (i32)s_frame_extent.height, 1 }
+    },
+
+    .dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+    .dstSubresource.mipLevel = 0,
+    .dstSubresource.baseArrayLayer = 0,
+    .dstSubresource.layerCount = 1,
+    .dstOffsets = { { x, y, 0 }, { x + (i32)w, y + (i32)h, 1 } },
+  };
+
+  vkCmdBlitImage(cmdbuf, target, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                 image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit,
+                 filter);
+
+  const VkImageMemoryBarrier present_barrier = {
+    .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+    .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+    .dstAccessMask = 0,
+    .oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+    .newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+    .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+    .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+    .image = image,
+    .subresourceRange = range,
+  };
+
+  vkCmdPipelineBarrier(cmdbuf, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                       VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, NULL, 0,
+                       NULL, 1, &present_barrier);
+}
+
+void draw_begin(color_t color)
+{
+  profile_begin("draw_begin");
+
+  const u64 fence_wait_start = get_time_ns();
+  vkWaitForFences(s_device, 1, &s_in_flight_fences[s_cur_frame_ind],
+                  VK_TRUE, UINT64_MAX);
+  s_frame_stats.fence_wait_ms +=
+    (get_time_ns() - fence_wait_start) / 1000000.0;
+
+  _timestamps_resolve();
+  memset(s_pass_timed[s_cur_frame_ind], 0,
+         sizeof(s_pass_timed[s_cur_frame_ind]));
+
+  // the frame's previous secondary command buffers have finished
+  // execution, so their pools can be reset
+  for (u32 i = 0; i < job_thread_count(); ++i) {
+    vkResetCommandPool(s_device, s_thread_cmd_pools[s_cur_frame_ind][i],
+                       0 /* reset flags */);
+    s_thread_cmdbufs_used[i] = 0;
+  }
+
+  s_vert_count = 0;
+  s_secondary_count = 0;
+
+  for (u32 i = 0; i < job_thread_count(); ++i)
+    _queue_reset(&s_thread_queues[i]);
+
+  // NOTE: sprites of a skipped frame are still queued into the frame
+  //       vertex buffer, but never recorded
+  if (s_headless) {
+    if (s_swapchain_dirty && _swapchain_recreate(s_resx, s_resy))
+      s_swapchain_dirty = 0;
+
+    s_cur_image_ind = s_cur_frame_ind;
+  } else {
+    const u64 acquire_start = get_time_ns();
+    s_frame_skipped = !_image_acquire();
+    s_frame_stats.acquire_ms +=
+      (get_time_ns() - acquire_start) / 1000000.0;
+  }
+
+  if (s_frame_skipped) {
+    profile_end();
+    return;
+  }
+
+  s_frame_open = 1;
+
+  _frame_extent_update();
+
+  // the fence is reset only when it's guaranteed to be submitted
+  vkResetFences(s_device, 1, &s_in_flight_fences[s_cur_frame_ind]);
+
+  // the image might be still rendered by another frame in flight
+  // if there are more frames in flight than swapchain images
+  if (
+    s_image_fences[s_cur_image_ind] != VK_NULL_HANDLE &&
+    s_image_fences[s_cur_image_ind] != s_in_flight_fences[s_cur_frame_ind]
+  ) {
+    const u64 image_wait_start = get_time_ns();
+    vkWaitForFences(s_device, 1, &s_image_fences[s_cur_image_ind],
+                    VK_TRUE, UINT64_MAX);
+    s_frame_stats.fence_wait_ms +=
+      (get_time_ns() - image_wait_start) / 1000000.0;
+  }
+
+  s_image_fences[s_cur_image_ind] = s_in_flight_fences[s_cur_frame_ind];
+
+  vkResetCommandBuffer(CUR_GRAPHICS_CMDBUF, 0 /* reset flags */);
+
+  static const VkCommandBufferBeginInfo cmdbuf_begin_info = {
+    .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+    .flags = 0,
+    .pNext = NULL,
+    .pInheritanceInfo = NULL,
+  };
+
+  vkBeginCommandBuffer(CUR_GRAPHICS_CMDBUF, &cmdbuf_begin_info);
+
+  // NOTE: queries can be reset only outside of a render pass
+  if (s_timestamps_supported) {
+    vkCmdResetQueryPool(CUR_GRAPHICS_CMDBUF,
+                        s_query_pools[s_cur_frame_ind], 0,
+                        QUERIES_PER_FRAME);
+    vkCmdWriteTimestamp(CUR_GRAPHICS_CMDBUF,
+                        VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                        s_query_pools[s_cur_frame_ind], 0);
+    s_query_frames[s_cur_frame_ind] = ++s_frame_counter;
+  }
+
+  // NOTE: compute dispatches can't be recorded inside a render pass
+  _particles_dispatch(CUR_GRAPHICS_CMDBUF);
+
+  const VkClearValue clear_values[2] = {
+    (VkClearValue){
+      .color = {{
+        (color >> 24) / 255.0f,
+        (color >> 16 & 0xff) / 255.0f,
+        (color >> 8 & 0xff) / 255.0f,
+        (color & 0xff) / 255.0f
+      }}
+    },
     (VkClearValue){
       .depthStencil = {
         .depth = 0.0f,
@@ -1408,92 +2932,110 @@ void draw_begin(color_t color)
     .sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
     .pNext = NULL,
     .renderPass = s_render_pass,
-    .framebuffer = s_framebufs[s_cur_frame_ind],
+    .framebuffer = _cur_framebuf(),
     .renderArea = (VkRect2D){
       .offset = { 0.0f, 0.0f },
-      .extent = s_swapchain_extent,
+      .extent = s_frame_extent,
     },
     .clearValueCount = 2,
     .pClearValues = clear_values,
   };
 
-  vkCmdBeginRenderPass(CUR_GRAPHICS_CMDBUF, &render_pass_begin_info, 
-                       VK_SUBPASS_CONTENTS_INLINE);
-
-  vkCmdBindPipeline(CUR_GRAPHICS_CMDBUF,
-                    VK_PIPELINE_BIND_POINT_GRAPHICS, s_pipeline);
-
-  const VkViewport viewport = {
-    .x = 0.0f,
-    .y = 0.0f,
-    .width = s_swapchain_extent.width,
-    .height = s_swapchain_extent.height,
-    .minDepth = 0.0f,
-    .maxDepth = 1.0f,
-  };
-  vkCmdSetViewport(CUR_GRAPHICS_CMDBUF, 0, 1, &viewport);
+  // NOTE: all the drawing is recorded into secondary command buffers,
+  //       so they can be recorded by the several threads
+  vkCmdBeginRenderPass(CUR_GRAPHICS_CMDBUF, &render_pass_begin_info,
+                       VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
 
-  const VkRect2D scissor = {
-    .offset = {0, 0},
-    .extent = s_swapchain_extent,
-  };
-  vkCmdSetScissor(CUR_GRAPHICS_CMDBUF, 0, 1, &scissor);
+  profile_end();
 }
 
-void _batch(void)
+void draw_layers(u32 count, draw_layer_fn fn, void *data)
 {
-  _fill_memory(s_verts, sizeof(_vert_t) * s_vert_count, s_vert_buf);
+  assert(fn, "passed layer function is a null pointer");
 
-  const i32 ind_count = s_vert_count * 1.5f;
-  uint16_t inds[ind_count];
+  if (s_frame_skipped)
+    return;
 
-  const i32 iters = ind_count / 6;
-  for (i32 i = 0; i < iters; ++i) {
-    inds[i * 6 + 0] = i * 4 + 0;
-    inds[i * 6 + 1] = i * 4 + 1;
-    inds[i * 6 + 2] = i * 4 + 2;
-    inds[i * 6 + 3] = i * 4 + 2;
-    inds[i * 6 + 4] = i * 4 + 3;
-    inds[i * 6 + 5] = i * 4 + 0;
-  }
+  if (s_secondary_count + count + 1 > MAX_SECONDARY_CMDBUFS)
+    fatal("secondary command buffers limit exceeded");
+
+  _thread_queues_flush();
+
+  _layers_ctx_t ctx = {
+    .fn   = fn,
+    .data = data,
+    .base = s_secondary_count,
+  };
+
+  // slots are reserved upfront, so layers are executed in the index
+  // order no matter which thread recorded them
+  s_secondary_count += count;
+
+  job_parallel_for(count, 1, _layers_job, &ctx);
+}
 
-  _fill_memory(inds, sizeof(inds), s_ind_buf);
+void draw_set_order(u32 order)
+{
+  t_order = order;
 }
 
 void draw_end(void)
 {
-  _batch();
+  if (s_frame_skipped) {
+    s_frame_skipped = 0;
+    _frame_stats_finish();
+    return;
+  }
 
-  static const VkDeviceSize offsets[1] = { 0 };
-  vkCmdBindVertexBuffers(CUR_GRAPHICS_CMDBUF, 0, 1, &s_vert_buf,
-                         offsets);
+  profile_begin("draw_end");
 
-  vkCmdBindIndexBuffer(CUR_GRAPHICS_CMDBUF, s_ind_buf, 0,
-                       VK_INDEX_TYPE_UINT16);
+  _thread_queues_flush();
 
-  vkCmdDrawIndexed(CUR_GRAPHICS_CMDBUF, s_vert_count * 1.5f,
-                   1, 0, 0, 0);
+  // skip layers that had nothing to draw
+  u32 count = 0;
+  for (u32 i = 0; i < s_secondary_count; ++i) {
+    if (s_secondaries[i] != VK_NULL_HANDLE)
+      s_secondaries[count++] = s_secondaries[i];
+  }
 
-  s_vert_count = 0;
+  if (count)
+    vkCmdExecuteCommands(CUR_GRAPHICS_CMDBUF, count, s_secondaries);
+
+  // vertices are written straight into the mapped frame buffer, so
+  // it's all that's uploaded besides the camera
+  s_frame_stats.bytes_uploaded +=
+    (u64)s_frame_stats.quads * 4 * sizeof(_vert_t);
 
   vkCmdEndRenderPass(CUR_GRAPHICS_CMDBUF);
 
+  if (s_upscaled)
+    _upscale(CUR_GRAPHICS_CMDBUF);
+
+  if (s_timestamps_supported)
+    vkCmdWriteTimestamp(CUR_GRAPHICS_CMDBUF,
+                        VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                        s_query_pools[s_cur_frame_ind], 1);
+
   vkEndCommandBuffer(CUR_GRAPHICS_CMDBUF);
 
-  static const VkPipelineStageFlags wait_stages[] = {
-    VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT
+  // the swapchain image is first written by the upscale blit if
+  // frames are upscaled
+  const VkPipelineStageFlags wait_stages[] = {
+    s_upscaled ? VK_PIPELINE_STAGE_TRANSFER_BIT :
+                 VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT
   };
 
+  // NOTE: offscreen images are neither acquired nor presented
   const VkSubmitInfo submit_info = {
     .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
     .pNext = NULL,
     .commandBufferCount = 1,
     .pCommandBuffers = &CUR_GRAPHICS_CMDBUF,
-    .waitSemaphoreCount = 1,
+    .waitSemaphoreCount = s_headless ? 0 : 1,
     .pWaitSemaphores = &s_image_available_semaphores[s_cur_frame_ind],
     .pWaitDstStageMask = wait_stages,
-    .signalSemaphoreCount = 1,
-    .pSignalSemaphores = &s_renderer_finished_semaphores[s_cur_frame_ind]
+    .signalSemaphoreCount = s_headless ? 0 : 1,
+    .pSignalSemaphores = &s_renderer_finished_semaphores[s_cur_image_ind]
   };
 
   const VkResult res = vkQueueSubmit(
@@ -1503,19 +3045,46 @@ void draw_end(void)
   if (res != VK_SUCCESS)
     fatal("failed to submit queue: %d", res);
 
+  s_frame_open = 0;
+
+  if (s_headless) {
+    s_last_frame_ind = s_cur_frame_ind;
+    s_cur_frame_ind = (s_cur_frame_ind + 1) % s_frames_in_flight;
+    _frame_stats_finish();
+    profile_end();
+    return;
+  }
+
   const VkPresentInfoKHR present_info = {
     .sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
     .pNext = NULL,
     .waitSemaphoreCount = 1,
-    .pWaitSemaphores = &s_renderer_finished_semaphores[s_cur_frame_ind],
+    .pWaitSemaphores = &s_renderer_finished_semaphores[s_cur_image_ind],
     .swapchainCount = 1,
     .pSwapchains = &s_swapchain,
     .pImageIndices = &s_cur_image_ind,
     .pResults = NULL
   };
-  vkQueuePresentKHR(s_queues[QUEUE_INDEX_PRESENT], &present_info);
+  const u64 present_start = get_time_ns();
+  const VkResult present_res = vkQueuePresentKHR(
+    s_queues[QUEUE_INDEX_PRESENT], &present_info);
+  s_frame_stats.present_ms += (get_time_ns() - present_start) / 1000000.0;
+
+  // NOTE: the swapchain is recreated right before the next image
+  //       acquisition, so the resize doesn't stall this frame
+  if (
+    present_res == VK_ERROR_OUT_OF_DATE_KHR ||
+    present_res == VK_SUBOPTIMAL_KHR
+  )
+    s_swapchain_dirty = 1;
+  else if (present_res != VK_SUCCESS)
+    error("failed to present swapchain image: %d", present_res);
 
-  s_cur_frame_ind = (s_cur_frame_ind + 1) % s_frames_count;
+  s_cur_frame_ind = (s_cur_frame_ind + 1) % s_frames_in_flight;
+
+  _frame_stats_finish();
+
+  profile_end();
 }
 
 void draw_wait(void)
@@ -1523,16 +3092,199 @@ void draw_wait(void)
   vkDeviceWaitIdle(s_device);
 }
 
-void camera_set(camera_t cam)
+gfx_frame_stats_t gfx_frame_stats_get(void)
 {
-  _ubo_t ubo = { cam };
+  return s_last_frame_stats;
+}
 
-  _fill_memory(&cam, sizeof(ubo), s_ubufs[s_cur_frame_ind]);
+gfx_frame_stats_avg_t gfx_frame_stats_avg_get(void)
+{
+  gfx_frame_stats_avg_t avg = { 0 };
+
+  avg.frame_count = s_frame_stats_count < GFX_FRAME_STATS_WINDOW ?
+                    s_frame_stats_count : GFX_FRAME_STATS_WINDOW;
+
+  if (!avg.frame_count)
+    return avg;
+
+  for (u32 i = 0; i < avg.frame_count; ++i) {
+    const gfx_frame_stats_t *stats = &s_frame_stats_history[i];
+
+    avg.quads          += stats->quads;
+    avg.draw_calls     += stats->draw_calls;
+    avg.pipeline_binds += stats->pipeline_binds;
+    avg.texture_binds  += stats->texture_binds;
+    avg.bytes_uploaded += stats->bytes_uploaded;
+    avg.staging_allocs += stats->staging_allocs;
+    avg.fence_wait_ms  += stats->fence_wait_ms;
+    avg.acquire_ms     += stats->acquire_ms;
+    avg.present_ms     += stats->present_ms;
+  }
 
-  vkCmdBindDescriptorSets(CUR_GRAPHICS_CMDBUF,
-                          VK_PIPELINE_BIND_POINT_GRAPHICS,
-                          s_pipeline_layout, 0, 1,
-                          &s_descriptor_sets[s_cur_frame_ind], 0, NULL);
+  const f64 count = avg.frame_count;
+
+  avg.quads          /= count;
+  avg.draw_calls     /= count;
+  avg.pipeline_binds /= count;
+  avg.texture_binds  /= count;
+  avg.bytes_uploaded /= count;
+  avg.staging_allocs /= count;
+  avg.fence_wait_ms  /= count;
+  avg.acquire_ms     /= count;
+  avg.present_ms     /= count;
+
+  return avg;
+}
+
+gfx_gpu_stats_t gfx_gpu_stats_get(void)
+{
+  return s_gpu_stats;
+}
+
+void gfx_gpu_stats_log(u32 interval)
+{
+  s_gpu_stats_log_interval = interval;
+}
+
+void gfx_dynres_enable(gfx_dynres_t dynres)
+{
+  assert(dynres.target_ms > 0.0, "wrong frame time budget: %f",
+         dynres.target_ms);
+  assert(
+    dynres.min_scale > 0.0f && dynres.min_scale <= dynres.max_scale &&
+    dynres.max_scale <= 1.0f,
+    "wrong render scale bounds: [%f; %f]", dynres.min_scale,
+    dynres.max_scale
+  );
+
+  if (!s_upscaled) {
+    error("dynamic resolution requires explicit resolution, "
+          "see init_ext()");
+    return;
+  }
+
+  if (!s_timestamps_supported) {
+    error("dynamic resolution requires gpu timestamps");
+    return;
+  }
+
+  // the current scale is kept within the new bounds
+  const f32 scale = s_dynres.enabled ? s_dynres.scale : dynres.max_scale;
+
+  s_dynres = (_dynres_t){
+    .enabled  = 1,
+    .settings = dynres,
+    .scale    = clamp(scale, dynres.min_scale, dynres.max_scale),
+  };
+}
+
+void gfx_dynres_disable(void)
+{
+  s_dynres.enabled = 0;
+}
+
+f32 gfx_render_scale_get(void)
+{
+  return s_dynres.enabled ? s_dynres.scale : 1.0f;
+}
+
+i32 read_frame(u8 *pixels)
+{
+  assert(pixels, "passed pixels buffer is a null pointer");
+
+  if (!s_headless) {
+    error("frame readback is supported only in the headless mode");
+    return 0;
+  }
+
+  if (s_last_frame_ind < 0)
+    return 0;
+
+  // the last frame is rendered into the image of its frame index
+  const VkImage image = s_swapchain_images[s_last_frame_ind];
+
+  vkWaitForFences(s_device, 1, &s_in_flight_fences[s_last_frame_ind],
+                  VK_TRUE, UINT64_MAX);
+
+  const VkCommandBuffer cmdbuf = _onetime_cmdbuf_begin();
+
+  const VkImageMemoryBarrier image_barrier = {
+    .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+    .pNext = NULL,
+    .srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+    .dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT,
+    .oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+    .newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+    .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+    .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+    .image = image,
+    .subresourceRange = {
+      .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+      .baseMipLevel = 0,
+      .levelCount = 1,
+      .baseArrayLayer = 0,
+      .layerCount = 1,
+    },
+  };
+
+  vkCmdPipelineBarrier(cmdbuf, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                       VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, NULL, 0, NULL,
+                       1, &image_barrier);
+
+  const VkBufferImageCopy region = {
+    .bufferOffset = 0,
+    .bufferRowLength = 0,
+    .bufferImageHeight = 0,
+    .imageSubresource = {
+      .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+      .mipLevel = 0,
+      .baseArrayLayer = 0,
+      .layerCount = 1,
+    },
+    .imageOffset = { 0, 0, 0 },
+    .imageExtent = {
+      s_swapchain_extent.width,
+      s_swapchain_extent.height,
+      1
+    },
+  };
+
+  vkCmdCopyImageToBuffer(cmdbuf, image,
+                         VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                         s_readback_buf, 1, &region);
+
+  const VkBufferMemoryBarrier buf_barrier = {
+    .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+    .pNext = NULL,
+    .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+    .dstAccessMask = VK_ACCESS_HOST_READ_BIT,
+    .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+    .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+    .buffer = s_readback_buf,
+    .offset = 0,
+    .size = VK_WHOLE_SIZE,
+  };
+
+  vkCmdPipelineBarrier(cmdbuf, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                       VK_PIPELINE_STAGE_HOST_BIT, 0, 0, NULL, 1,
+                       &buf_barrier, 0, NULL);
+
+  _onetime_cmdbuf_end(cmdbuf);
+
+  memcpy(pixels, s_readback_ptr,
+         (size_t)s_swapchain_extent.width * s_swapchain_extent.height * 4);
+
+  return 1;
+}
+
+void camera_set(camera_t cam)
+{
+  const _ubo_t ubo = { cam };
+
+  // NOTE: the uniform buffer is bound by every batch, so the camera
+  //       is shared by the whole frame
+  memcpy(s_ubuf_ptrs[s_cur_frame_ind], &ubo, sizeof(ubo));
+  s_frame_stats.bytes_uploaded += sizeof(ubo);
 }
 
 void camera_reset(void)
@@ -1541,7 +3293,91 @@ void camera_reset(void)
 
 void set_resolution(u16 x, u16 y)
 {
-  _swapchain_recreate(x, y);
+  if (s_upscaled && (!x || !y)) {
+    error("upscaled frames require explicit resolution: %ux%u", x, y);
+    return;
+  }
+
+  s_resx = x;
+  s_resy = y;
+
+  // NOTE: the open frame's fence is reset and its commands use the
+  //       current targets, so it's recreated on the next draw_begin()
+  if (s_frame_open || !_swapchain_recreate(x, y))
+    s_swapchain_dirty = 1;
+}
+
+i32 is_present_mode_supported(present_mode_t mode)
+{
+  assert(mode < PRESENT_MODE_MAX, "wrong present mode: %d", mode);
+
+  // NOTE: FIFO mode is required to be supported by the spec
+  if (mode == PRESENT_MODE_FIFO)
+    return 1;
+
+  if (s_surface == VK_NULL_HANDLE)
+    return 0;
+
+  u32 count;
+  vkGetPhysicalDeviceSurfacePresentModesKHR(s_gpu, s_surface, &count,
+                                            NULL);
+
+  VkPresentModeKHR modes[count ? count : 1];
+  vkGetPhysicalDeviceSurfacePresentModesKHR(s_gpu, s_surface, &count,
+                                            modes);
+
+  for (u32 i = 0; i < count; ++i) {
+    if (modes[i] == s_vk_present_modes[mode])
+      return 1;
+  }
+
+  return 0;
+}
+
+void set_present_mode(present_mode_t mode)
+{
+  assert(mode < PRESENT_MODE_MAX, "wrong present mode: %d", mode);
+
+  if (s_present_mode == mode)
+    return;
+
+  s_present_mode = mode;
+
+  // the swapchain isn't created yet, the mode is applied on init
+  if (s_swapchain == VK_NULL_HANDLE)
+    return;
+
+  // NOTE: the open frame's fence is reset and its commands use the
+  //       swapchain images, so it's recreated on the next draw_begin()
+  if (s_frame_open || !_swapchain_recreate(s_resx, s_resy))
+    s_swapchain_dirty = 1;
+}
+
+present_mode_t get_present_mode(void)
+{
+  return s_present_mode;
+}
+
+void set_latency_mode(latency_mode_t mode)
+{
+  assert(mode >= LATENCY_MODE_LOW && mode <= LATENCY_MODE_THROUGHPUT,
+         "wrong latency mode: %d", mode);
+
+  // NOTE: frames in flight might use resources of the frames that are
+  //       skipped in the new mode, so let them finish first
+  if (s_device != VK_NULL_HANDLE)
+    vkDeviceWaitIdle(s_device);
+
+  s_frames_in_flight = mode;
+  s_cur_frame_ind = 0;
+
+  debug("latency mode set: %u frame%s in flight", s_frames_in_flight,
+        s_frames_in_flight > 1 ? "s" : "");
+}
+
+latency_mode_t get_latency_mode(void)
+{
+  return (latency_mode_t)s_frames_in_flight;
 }
 
 void draw_rect(rect_t rect, color_t color)
@@ -1572,68 +3408,18 @@ void draw_texture_ext(rect_t dst_rect, rect_t src_rect, u32 tex_id,
 
   (void)(rot);
 
-  assert(s_vert_count < RESERVED_VERTS_COUNT,
-         "verts number exceeds the limit");
-
-  s_verts[s_vert_count++] = (_vert_t){
-    .pos = {
-      dst_rect.x,
-      dst_rect.y,
-      depth
-    },
-    .color = color,
-    .uv = {
-      src_rect.x,
-      src_rect.y
-    },
-    .tex_id = tex_id,
-  };
-
-  s_verts[s_vert_count++] = (_vert_t){
-    .pos = {
-      dst_rect.x + dst_rect.width,
-      dst_rect.y,
-      depth
-    },
-    .color = color,
-    .uv = {
-      src_rect.x + src_rect.width,
-      src_rect.y,
-    },
-    .tex_id = tex_id,
-  };
-
-  s_verts[s_vert_count++] = (_vert_t){
-    .pos = {
-      dst_rect.x + dst_rect.width,
-      dst_rect.y + dst_rect.height,
-      depth
-    },
-    .color = color,
-    .uv = {
-      src_rect.x + src_rect.width,
-      src_rect.y + src_rect.height,
-    },
-    .tex_id = tex_id,
-  };
+  u32 reserved;
+  _vert_t *verts = _sprites_reserve(1, &reserved);
 
-  s_verts[s_vert_count++] = (_vert_t){
-    .pos = {
-      dst_rect.x,
-      dst_rect.y + dst_rect.height,
-      depth
-    },
-    .color = color,
-    .uv = {
-      src_rect.x,
-      src_rect.y + src_rect.height,
-    },
-    .tex_id = tex_id,
-  };
+  assert(verts, "verts number exceeds the limit");
+  if (!verts)
+    return;
+
+  _sprite_write(verts, dst_rect, src_rect, tex_id, color, depth);
 }
 
 void _image_create(
-  uint32_t width, uint32_t height, VkFormat format,
+  uint32_t width, uint32_t height, uint32_t mip_levels, VkFormat format,
   VkImageUsageFlags usage, VkMemoryPropertyFlags mem_props,
   VkImage *image, VkDeviceMemory *mem)
 {
@@ -1641,7 +3427,7 @@ void _image_create(
       .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
       .imageType = VK_IMAGE_TYPE_2D,
       .extent = { width, height, 1 },
-      .mipLevels = 1,
+      .mipLevels = mip_levels,
       .arrayLayers = 1,
       .format = format,
       .tiling = VK_IMAGE_TILING_OPTIMAL,
@@ -1673,7 +3459,8 @@ void _image_create(
 }
 
 VkImageView _image_view_create(VkImage image, VkFormat format, 
-                               VkImageAspectFlags aspect)
+                               VkImageAspectFlags aspect,
+                               uint32_t mip_levels)
 {
   const VkImageViewCreateInfo info = {
     .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
@@ -1682,7 +3469,7 @@ VkImageView _image_view_create(VkImage image, VkFormat format,
     .format = format,
     .subresourceRange.aspectMask = aspect,
     .subresourceRange.baseMipLevel = 0,
-    .subresourceRange.levelCount = 1,
+    .subresourceRange.levelCount = mip_levels,
     .subresourceRange.baseArrayLayer = 0,
     .subresourceRange.layerCount = 1,
   };
@@ -1727,7 +3514,7 @@ void _copy_buf_to_image(VkBuffer buffer, VkImage image,
 }
 
 void _trans_image_layout(VkImage image, VkImageLayout old,
-                         VkImageLayout new)
+                         VkImageLayout new, uint32_t mip_levels)
 {
   VkCommandBuffer cmdbuf = _onetime_cmdbuf_begin();
 
@@ -1740,7 +3527,7 @@ void _trans_image_layout(VkImage image, VkImageLayout old,
     .image = image,
     .subresourceRange.aspectMask = 0, //
     .subresourceRange.baseMipLevel = 0,
-    .subresourceRange.levelCount = 1,
+    .subresourceRange.levelCount = mip_levels,
     .subresourceRange.baseArrayLayer = 0,
     .subresourceRange.layerCount = 1,
     .srcAccessMask = 0, // TODO
@@ -1798,8 +3585,92 @@ void _trans_image_layout(VkImage image, VkImageLayout old,
   _onetime_cmdbuf_end(cmdbuf);
 }
 
+void _mipmaps_generate(VkImage image, int width, int height,
+                       uint32_t mip_levels)
+{
+  VkCommandBuffer cmdbuf = _onetime_cmdbuf_begin();
+
+  VkImageMemoryBarrier barrier = {
+    .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+    .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+    .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+    .image = image,
+    .subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+    .subresourceRange.levelCount = 1,
+    .subresourceRange.baseArrayLayer = 0,
+    .subresourceRange.layerCount = 1,
+  };
+
+  // every level is blitted from the previous one, which becomes
+  // a transfer source and then is handed to the fragment shader
+  for (uint32_t i = 1; i < mip_levels; ++i) {
+    const int mip_width = width > 1 ? width / 2 : 1;
+    const int mip_height = height > 1 ? height / 2 : 1;
+
+    barrier.subresourceRange.baseMipLevel = i - 1;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+    vkCmdPipelineBarrier(cmdbuf, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, NULL, 0,
+                         NULL, 1, &barrier);
+
+    const VkImageBlit blit = {
+      .srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+      .srcSubresource.mipLevel = i - 1,
+      .srcSubresource.baseArrayLayer = 0,
+      .srcSubresource.layerCount = 1,
+      .srcOffsets = { { 0, 0, 0 }, { width, height, 1 } },
+
+      .dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+      .dstSubresource.mipLevel = i,
+      .dstSubresource.baseArrayLayer = 0,
+      .dstSubresource.layerCount = 1,
+      .dstOffsets = { { 0, 0, 0 }, { mip_width, mip_height, 1 } },
+    };
+
+    vkCmdBlitImage(cmdbuf, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                   image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit,
+                   VK_FILTER_LINEAR);
+
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+    vkCmdPipelineBarrier(cmdbuf, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, NULL,
+                         0, NULL, 1, &barrier);
+
+    width = mip_width;
+    height = mip_height;
+  }
+
+  // the last level is only written
+  barrier.subresourceRange.baseMipLevel = mip_levels - 1;
+  barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+  barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+  barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+  vkCmdPipelineBarrier(cmdbuf, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                       VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, NULL,
+                       0, NULL, 1, &barrier);
+
+  _onetime_cmdbuf_end(cmdbuf);
+}
+
 struct texture* texture_load(const char *path)
 {
+  return texture_load_ext(path, (texture_params_t){ 0 });
+}
+
+struct texture* texture_load_ext(const char *path, texture_params_t params)
+{
+  profile_begin("texture_load");
+
   struct texture *tex = malloc(sizeof(struct texture));
 
   stbi_uc *pixels = stbi_load(path, &tex->width, &tex->height,
@@ -1810,6 +3681,7 @@ struct texture* texture_load(const char *path)
     error("failed to load \"%s\" texture: %s", path,
           stbi_failure_reason());
     free(tex);
+    profile_end();
     return NULL;
   }
 
@@ -1817,6 +3689,7 @@ struct texture* texture_load(const char *path)
   VkDeviceMemory staging_buf_mem;
   _buf_create(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, image_size,
               &staging_buf, &staging_buf_mem);
+  ++s_frame_stats.staging_allocs;
 
   void* data;
   vkMapMemory(s_device, staging_buf_mem, 0, image_size, 0, &data);
@@ -1825,20 +3698,38 @@ struct texture* texture_load(const char *path)
 
   stbi_image_free(pixels);
 
-  _image_create(tex->width, tex->height, VK_FORMAT_R8G8B8A8_SRGB,
-                VK_IMAGE_USAGE_SAMPLED_BIT,
+  // the full chain down to 1x1, blitted on the GPU, the format is
+  // required to support linear blits
+  tex->mip_levels = 1;
+  if (params.mip != TEXTURE_MIP_NONE) {
+    int size = tex->width > tex->height ? tex->width : tex->height;
+    for (; size > 1; size /= 2)
+      ++tex->mip_levels;
+  }
+
+  _image_create(tex->width, tex->height, tex->mip_levels,
+                VK_FORMAT_R8G8B8A8_SRGB,
+                VK_IMAGE_USAGE_SAMPLED_BIT |
+                VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &tex->image,
                 &tex->mem);
 
   _trans_image_layout(tex->image, VK_IMAGE_LAYOUT_UNDEFINED,
-                      VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+                      VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                      tex->mip_levels);
   _copy_buf_to_image(staging_buf, tex->image, tex->width, tex->height);
 
-  _trans_image_layout(tex->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                      VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+  if (tex->mip_levels > 1)
+    _mipmaps_generate(tex->image, tex->width, tex->height,
+                      tex->mip_levels);
+  else
+    _trans_image_layout(tex->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, 1);
 
   tex->view = _image_view_create(tex->image, VK_FORMAT_R8G8B8A8_SRGB,
-                                 VK_IMAGE_ASPECT_COLOR_BIT);
+                                 VK_IMAGE_ASPECT_COLOR_BIT,
+                                 tex->mip_levels);
+  tex->sampler = _sampler_get(params);
 
   vkFreeMemory(s_device, staging_buf_mem, NULL);
   vkDestroyBuffer(s_device, staging_buf, NULL);
@@ -1846,6 +3737,8 @@ struct texture* texture_load(const char *path)
   memcpy(tex->path, path, strlen(path));
   info("loaded texture: %s", tex->path);
 
+  profile_end();
+
   return tex;
 }
 
@@ -1865,15 +3758,15 @@ void texture_bind(texture_t texture, u32 ind)
   assert(ind < MAX_TEXTURE_COUNT,
          "texture binding index exceeds the bounds of the array")
 
-  VkWriteDescriptorSet writes[s_frames_count];
+  VkWriteDescriptorSet writes[MAX_FRAMES_IN_FLIGHT];
 
   const VkDescriptorImageInfo image_info = {
     .imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
     .imageView = texture->view,
-    .sampler = s_sampler,
+    .sampler = texture->sampler,
   };
 
-  for (uint32_t i = 0; i < s_frames_count; ++i) {
+  for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
     writes[i] = (VkWriteDescriptorSet){
       .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
       .dstSet = s_descriptor_sets[i],
@@ -1885,6 +3778,630 @@ void texture_bind(texture_t texture, u32 ind)
     };
   }
 
-  vkUpdateDescriptorSets(s_device, s_frames_count, writes, 0, NULL);
+  vkUpdateDescriptorSets(s_device, MAX_FRAMES_IN_FLIGHT, writes, 0, NULL);
+
+  ++s_frame_stats.texture_binds;
+}
+
+
+// +------------------------------------------------------------------+
+// |                           particles                              |
+// +------------------------------------------------------------------+
+
+/**
+ * @brief Creates compute pipelines of particles, they're created with
+ *        the first particle system.
+ *
+ * @return Returns 1 on success, otherwise returns 0.
+ */
+static i32 _particles_pipelines_create(void)
+{
+  uint32_t family_count;
+  vkGetPhysicalDeviceQueueFamilyProperties(s_gpu, &family_count, NULL);
+
+  VkQueueFamilyProperties families[family_count];
+  vkGetPhysicalDeviceQueueFamilyProperties(s_gpu, &family_count, families);
+
+  // NOTE: particles are simulated in the frame's graphics command
+  //       buffer, so they're drawn without any semaphores
+  if (
+    !(families[s_queue_families[QUEUE_INDEX_GRAPHICS]].queueFlags &
+      VK_QUEUE_COMPUTE_BIT)
+  ) {
+    error("graphics queue doesn't support compute, particles are "
+          "unavailable");
+    return 0;
+  }
+
+  VkDescriptorSetLayoutBinding bindings[5];
+  for (u32 i = 0; i < 5; ++i) {
+    bindings[i] = (VkDescriptorSetLayoutBinding){
+      .binding = i,
+      .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+      .descriptorType = i == 0 ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER :
+                                 VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+      .descriptorCount = 1,
+      .pImmutableSamplers = NULL,
+    };
+  }
+
+  const VkDescriptorSetLayoutCreateInfo set_layout_info = {
+    .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+    .flags = 0,
+    .pNext = NULL,
+    .bindingCount = 5,
+    .pBindings = bindings,
+  };
+
+  VkResult res = vkCreateDescriptorSetLayout(s_device, &set_layout_info,
+                                             NULL, &s_particles_set_layout);
+  if (res != VK_SUCCESS)
+    fatal("failed to create particles descriptor set layout: %d", res);
+
+  const VkDescriptorPoolSize sizes[2] = {
+    {
+      .type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+      .descriptorCount = MAX_PARTICLE_SYSTEMS * MAX_FRAMES_IN_FLIGHT,
+    },
+    {
+      .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+      .descriptorCount = 4 * MAX_PARTICLE_SYSTEMS * MAX_FRAMES_IN_FLIGHT,
+    }
+  };
+
+  // sets are freed with their particle systems
+  const VkDescriptorPoolCreateInfo pool_info = {
+    .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+    .flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT,
+    .pNext = NULL,
+    .maxSets = MAX_PARTICLE_SYSTEMS * MAX_FRAMES_IN_FLIGHT,
+    .poolSizeCount = 2,
+    .pPoolSizes = sizes,
+  };
+
+  res = vkCreateDescriptorPool(s_device, &pool_info, NULL,
+                               &s_particles_descriptor_pool);
+  if (res != VK_SUCCESS)
+    fatal("failed to create particles descriptor pool: %d", res);
+
+  const VkPushConstantRange push_range = {
+    .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+    .offset = 0,
+    .size = sizeof(_particles_push_t),
+  };
+
+  const VkPipelineLayoutCreateInfo layout_info = {
+    .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+    .flags = 0,
+    .pNext = NULL,
+    .setLayoutCount = 1,
+    .pSetLayouts = &s_particles_set_layout,
+    .pushConstantRangeCount = 1,
+    .pPushConstantRanges = &push_range,
+  };
+
+  res = vkCreatePipelineLayout(s_device, &layout_info, NULL,
+                               &s_particles_pipeline_layout);
+  if (res != VK_SUCCESS)
+    fatal("failed to create particles pipeline layout: %d", res);
+
+  VkShaderModule shaders[2];
+  _shader_module_create("shaders/particles-comp.spv", &shaders[0]);
+  _shader_module_create("shaders/particles-args-comp.spv", &shaders[1]);
+
+  VkComputePipelineCreateInfo infos[2];
+  for (u32 i = 0; i < 2; ++i) {
+    infos[i] = (VkComputePipelineCreateInfo){
+      .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+      .flags = 0,
+      .pNext = NULL,
+      .stage = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+        .flags = 0,
+        .pNext = NULL,
+        .stage = VK_SHADER_STAGE_COMPUTE_BIT,
+        .module = shaders[i],
+        .pName = "main",
+        .pSpecializationInfo = NULL,
+      },
+      .layout = s_particles_pipeline_layout,
+      .basePipelineHandle = VK_NULL_HANDLE,
+      .basePipelineIndex = 0,
+    };
+  }
+
+  VkPipeline pipelines[2];
+  res = vkCreateComputePipelines(s_device, VK_NULL_HANDLE, 2, infos, NULL,
+                                 pipelines);
+
+  vkDestroyShaderModule(s_device, shaders[0], NULL);
+  vkDestroyShaderModule(s_device, shaders[1], NULL);
+
+  if (res != VK_SUCCESS)
+    fatal("failed to create particles compute pipelines: %d", res);
+
+  s_particles_pipeline = pipelines[0];
+  s_particles_args_pipeline = pipelines[1];
+
+  trace("Vulkan particles pipelines created");
+
+  return 1;
+}
+
+static void _particles_destroy(struct particles *particles)
+{
+  // NOTE: destroying null handles is a no-op
+  for (u32 i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
+    if (particles->frame_ptrs[i])
+      vkUnmapMemory(s_device, particles->frame_mems[i]);
+
+    vkFreeMemory(s_device, particles->frame_mems[i], NULL);
+    vkDestroyBuffer(s_device, particles->frame_bufs[i], NULL);
+  }
+
+  if (particles->sets[0] != VK_NULL_HANDLE)
+    vkFreeDescriptorSets(s_device, s_particles_descriptor_pool,
+                         MAX_FRAMES_IN_FLIGHT, particles->sets);
+
+  vkFreeMemory(s_device, particles->args_mem, NULL);
+  vkDestroyBuffer(s_device, particles->args_buf, NULL);
+  vkFreeMemory(s_device, particles->vert_mem, NULL);
+  vkDestroyBuffer(s_device, particles->vert_buf, NULL);
+  vkFreeMemory(s_device, particles->count_mem, NULL);
+  vkDestroyBuffer(s_device, particles->count_buf, NULL);
+  vkFreeMemory(s_device, particles->state_mem, NULL);
+  vkDestroyBuffer(s_device, particles->state_buf, NULL);
+
+  free(particles);
+}
+
+void _particles_quit(void)
+{
+  for (u32 i = 0; i < MAX_PARTICLE_SYSTEMS; ++i) {
+    if (s_particle_systems[i])
+      _particles_destroy(s_particle_systems[i]);
+
+    s_particle_systems[i] = NULL;
+  }
+
+  if (s_particles_pipeline == VK_NULL_HANDLE)
+    return;
+
+  vkDestroyPipeline(s_device, s_particles_pipeline, NULL);
+  vkDestroyPipeline(s_device, s_particles_args_pipeline, NULL);
+  vkDestroyPipelineLayout(s_device, s_particles_pipeline_layout, NULL);
+  vkDestroyDescriptorPool(s_device, s_particles_descriptor_pool, NULL);
+  vkDestroyDescriptorSetLayout(s_device, s_particles_set_layout, NULL);
+
+  s_particles_pipeline = VK_NULL_HANDLE;
+  s_particles_args_pipeline = VK_NULL_HANDLE;
+}
+
+static i32 _particles_buffers_create(struct particles *particles)
+{
+  const VkMemoryPropertyFlags local = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+  const u32 capacity = particles->capacity;
+
+  if (
+    !_buf_create_ext(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                     2 * sizeof(_particle_t) * capacity, local,
+                     &particles->state_buf, &particles->state_mem) ||
+    !_buf_create_ext(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, 2 * sizeof(u32),
+                     local, &particles->count_buf, &particles->count_mem) ||
+    !_buf_create_ext(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                     VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+                     4 * sizeof(_vert_t) * capacity, local,
+                     &particles->vert_buf, &particles->vert_mem) ||
+    !_buf_create_ext(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                     VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+                     sizeof(VkDrawIndexedIndirectCommand) *
+                     particles->chunk_count, local,
+                     &particles->args_buf, &particles->args_mem)
+  )
+    return 0;
+
+  for (u32 i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
+    if (!_buf_create(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+                     sizeof(_particles_frame_t), &particles->frame_bufs[i],
+                     &particles->frame_mems[i]))
+      return 0;
+
+    vkMapMemory(s_device, particles->frame_mems[i], 0,
+                sizeof(_particles_frame_t), 0,
+                (void**)&particles->frame_ptrs[i]);
+  }
+
+  // no particles and empty draws until the first step
+  const VkCommandBuffer cmdbuf = _onetime_cmdbuf_begin();
+  vkCmdFillBuffer(cmdbuf, particles->count_buf, 0, VK_WHOLE_SIZE, 0);
+  vkCmdFillBuffer(cmdbuf, particles->args_buf, 0, VK_WHOLE_SIZE, 0);
+  _onetime_cmdbuf_end(cmdbuf);
+
+  return 1;
+}
+
+static i32 _particles_sets_create(struct particles *particles)
+{
+  VkDescriptorSetLayout layouts[MAX_FRAMES_IN_FLIGHT];
+  for (u32 i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i)
+    layouts[i] = s_particles_set_layout;
+
+  const VkDescriptorSetAllocateInfo info = {
+    .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+    .pNext = NULL,
+    .descriptorSetCount = MAX_FRAMES_IN_FLIGHT,
+    .pSetLayouts = layouts,
+    .descriptorPool = s_particles_descriptor_pool,
+  };
+
+  const VkResult res = vkAllocateDescriptorSets(s_device, &info,
+                                                particles->sets);
+  if (res != VK_SUCCESS) {
+    error("failed to allocate particles descriptor sets: %d", res);
+    particles->sets[0] = VK_NULL_HANDLE;
+    return 0;
+  }
+
+  // only the frame buffers differ between the sets
+  const VkBuffer bufs[5] = {
+    VK_NULL_HANDLE,
+    particles->state_buf,
+    particles->count_buf,
+    particles->vert_buf,
+    particles->args_buf,
+  };
+
+  VkDescriptorBufferInfo buf_infos[MAX_FRAMES_IN_FLIGHT][5];
+  VkWriteDescriptorSet writes[MAX_FRAMES_IN_FLIGHT * 5];
+
+  for (u32 i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
+    for (u32 j = 0; j < 5; ++j) {
+      buf_infos[i][j] = (VkDescriptorBufferInfo){
+        .buffer = j == 0 ? particles->frame_bufs[i] : bufs[j],
+        .offset = 0,
+        .range = VK_WHOLE_SIZE,
+      };
+
+      writes[i * 5 + j] = (VkWriteDescriptorSet){
+        .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+        .pNext = NULL,
+        .dstSet = particles->sets[i],
+        .dstBinding = j,
+        .dstArrayElement = 0,
+        .descriptorType = j == 0 ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER :
+                                   VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+        .descriptorCount = 1,
+        .pBufferInfo = &buf_infos[i][j],
+        .pImageInfo = NULL,
+        .pTexelBufferView = NULL,
+      };
+    }
+  }
+
+  vkUpdateDescriptorSets(s_device, MAX_FRAMES_IN_FLIGHT * 5, writes, 0,
+                         NULL);
+
+  return 1;
+}
+
+/**
+ * @brief Writes the pending step into the frame's uniform buffer.
+ *
+ * @return Returns the number of particles to spawn.
+ */
+static u32 _particles_frame_write(struct particles *particles)
+{
+  _particles_frame_t *frame = particles->frame_ptrs[s_cur_frame_ind];
+
+  // emissions over the capacity would be dropped anyway
+  u32 first = 0;
+  for (u32 i = 0; i < PARTICLES_MAX_EMITTERS; ++i) {
+    const particle_emitter_t *e = &particles->emitters[i];
+    const u32 room = particles->capacity - first;
+    const u32 count = particles->emit_counts[i] < room ?
+                      particles->emit_counts[i] : room;
+
+    frame->emitters[i] = (_particle_emitter_gpu_t){
+      .pos         = { e->pos.x, e->pos.y },
+      .area        = { e->area.x, e->area.y },
+      .vel_min     = { e->vel_min.x, e->vel_min.y },
+      .vel_max     = { e->vel_max.x, e->vel_max.y },
+      .gravity     = { e->gravity.x, e->gravity.y },
+      .life        = { e->life_min, e->life_max },
+      .size        = { e->size_start, e->size_end },
+      .color_start = e->color_start,
+      .color_end   = e->color_end,
+      .src         = { e->src.x, e->src.y, e->src.width, e->src.height },
+      .tex_id      = e->tex_id,
+      .depth       = e->depth,
+      .emit_first  = first,
+      .emit_count  = count,
+    };
+
+    first += count;
+    particles->emit_counts[i] = 0;
+  }
+
+  particles->seed = particles->seed * 1664525u + 1013904223u;
+
+  frame->dt = particles->dt;
+  frame->seed = particles->seed;
+  frame->emit_total = first;
+  frame->capacity = particles->capacity;
+
+  particles->dt = 0.0f;
+
+  s_frame_stats.bytes_uploaded += sizeof(_particles_frame_t);
+
+  return first;
+}
+
+inline static void _barrier(VkCommandBuffer cmdbuf,
+                            VkPipelineStageFlags src_stages,
+                            VkAccessFlags src_access,
+                            VkPipelineStageFlags dst_stages,
+                            VkAccessFlags dst_access)
+{
+  const VkMemoryBarrier barrier = {
+    .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+    .pNext = NULL,
+    .srcAccessMask = src_access,
+    .dstAccessMask = dst_access,
+  };
+
+  vkCmdPipelineBarrier(cmdbuf, src_stages, dst_stages, 0, 1, &barrier, 0,
+                       NULL, 0, NULL);
+}
+
+void _particles_dispatch(VkCommandBuffer cmdbuf)
+{
+  struct particles *systems[MAX_PARTICLE_SYSTEMS];
+  u32 spawns[MAX_PARTICLE_SYSTEMS];
+  u32 count = 0;
+
+  for (u32 i = 0; i < MAX_PARTICLE_SYSTEMS; ++i) {
+    struct particles *particles = s_particle_systems[i];
+    if (!particles)
+      continue;
+
+    u32 emits = 0;
+    for (u32 j = 0; j < PARTICLES_MAX_EMITTERS; ++j)
+      emits += particles->emit_counts[j];
+
+    // systems without steps keep the sprites of the last one
+    if (particles->dt <= 0.0f && !emits)
+      continue;
+
+    spawns[count] = _particles_frame_write(particles);
+    systems[count++] = particles;
+  }
+
+  if (!count)
+    return;
+
+  // the previous frames might still read the buffers, and their steps
+  // wrote the particles this one reads
+  _barrier(cmdbuf,
+           VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT |
+           VK_PIPELINE_STAGE_VERTEX_INPUT_BIT |
+           VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+           VK_ACCESS_SHADER_WRITE_BIT,
+           VK_PIPELINE_STAGE_TRANSFER_BIT |
+           VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+           VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT |
+           VK_ACCESS_TRANSFER_WRITE_BIT);
+
+  // live particles are appended to the other half
+  for (u32 i = 0; i < count; ++i)
+    vkCmdFillBuffer(cmdbuf, systems[i]->count_buf,
+                    (1 - systems[i]->src) * sizeof(u32), sizeof(u32), 0);
+
+  _barrier(cmdbuf,
+           VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+           VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+           VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+
+  vkCmdBindPipeline(cmdbuf, VK_PIPELINE_BIND_POINT_COMPUTE,
+                    s_particles_pipeline);
+
+  for (u32 i = 0; i < count; ++i) {
+    const struct particles *particles = systems[i];
+
+    const _particles_push_t push = {
+      .src         = particles->src,
+      .capacity    = particles->capacity,
+      .chunk_quads = PARTICLES_CHUNK_QUADS,
+      .chunk_count = particles->chunk_count,
+    };
+
+    vkCmdBindDescriptorSets(cmdbuf, VK_PIPELINE_BIND_POINT_COMPUTE,
+                            s_particles_pipeline_layout, 0, 1,
+                            &particles->sets[s_cur_frame_ind], 0, NULL);
+    vkCmdPushConstants(cmdbuf, s_particles_pipeline_layout,
+                       VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push), &push);
+
+    // the first capacity threads simulate, the rest spawn
+    const u32 threads = particles->capacity + spawns[i];
+    vkCmdDispatch(cmdbuf,
+                  (threads + PARTICLES_GROUP_SIZE - 1) / PARTICLES_GROUP_SIZE,
+                  1, 1);
+  }
+
+  _barrier(cmdbuf,
+           VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+           VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+
+  vkCmdBindPipeline(cmdbuf, VK_PIPELINE_BIND_POINT_COMPUTE,
+                    s_particles_args_pipeline);
+
+  for (u32 i = 0; i < count; ++i) {
+    struct particles *particles = systems[i];
+
+    const _particles_push_t push = {
+      .src         = particles->src,
+      .capacity    = particles->capacity,
+      .chunk_quads = PARTICLES_CHUNK_QUADS,
+      .chunk_count = particles->chunk_count,
+    };
+
+    vkCmdBindDescriptorSets(cmdbuf, VK_PIPELINE_BIND_POINT_COMPUTE,
+                            s_particles_pipeline_layout, 0, 1,
+                            &particles->sets[s_cur_frame_ind], 0, NULL);
+    vkCmdPushConstants(cmdbuf, s_particles_pipeline_layout,
+                       VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push), &push);
+    vkCmdDispatch(cmdbuf,
+                  (particles->chunk_count + PARTICLES_GROUP_SIZE - 1) /
+                  PARTICLES_GROUP_SIZE,
+                  1, 1);
+
+    particles->src = 1 - particles->src;
+  }
+
+  _barrier(cmdbuf,
+           VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+           VK_PIPELINE_STAGE_VERTEX_INPUT_BIT |
+           VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+           VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT |
+           VK_ACCESS_INDIRECT_COMMAND_READ_BIT);
+}
+
+particles_t particles_create(u32 capacity)
+{
+  assert(capacity, "particle system capacity is zero");
+
+  if (
+    s_particles_pipeline == VK_NULL_HANDLE &&
+    !_particles_pipelines_create()
+  )
+    return NULL;
+
+  u32 slot = 0;
+  while (slot < MAX_PARTICLE_SYSTEMS && s_particle_systems[slot])
+    ++slot;
+
+  if (slot == MAX_PARTICLE_SYSTEMS) {
+    error("particle systems limit exceeded: %d", MAX_PARTICLE_SYSTEMS);
+    return NULL;
+  }
+
+  VkPhysicalDeviceProperties props;
+  vkGetPhysicalDeviceProperties(s_gpu, &props);
+
+  // the largest buffer is the vertex one, up to twice the capacity of
+  // threads are dispatched
+  const u64 vert_size = 4ull * sizeof(_vert_t) * capacity;
+  const u64 groups = (2ull * capacity + PARTICLES_GROUP_SIZE - 1) /
+                     PARTICLES_GROUP_SIZE;
+
+  if (
+    vert_size > props.limits.maxStorageBufferRange ||
+    groups > props.limits.maxComputeWorkGroupCount[0]
+  ) {
+    error("particle system capacity exceeds the gpu limits: %u", capacity);
+    return NULL;
+  }
+
+  struct particles *particles = calloc(1, sizeof(struct particles));
+  if (!particles) {
+    error("failed to allocate particle system");
+    return NULL;
+  }
+
+  particles->capacity = capacity;
+  particles->chunk_count = (capacity + PARTICLES_CHUNK_QUADS - 1) /
+                           PARTICLES_CHUNK_QUADS;
+  particles->seed = slot;
+
+  if (
+    !_particles_buffers_create(particles) ||
+    !_particles_sets_create(particles)
+  ) {
+    error("failed to create particle system");
+    _particles_destroy(particles);
+    return NULL;
+  }
+
+  s_particle_systems[slot] = particles;
+
+  info("created particle system: %u particles", capacity);
+
+  return particles;
+}
+
+void particles_free(particles_t particles)
+{
+  if (!particles)
+    return;
+
+  // the frames in flight might still simulate or draw the particles
+  vkDeviceWaitIdle(s_device);
+
+  for (u32 i = 0; i < MAX_PARTICLE_SYSTEMS; ++i) {
+    if (s_particle_systems[i] == particles)
+      s_particle_systems[i] = NULL;
+  }
+
+  _particles_destroy(particles);
+}
+
+void particles_emitter_set(particles_t particles, u32 ind,
+                           const particle_emitter_t *emitter)
+{
+  assert(particles, "passed particle system is a null pointer");
+  assert(emitter, "passed emitter is a null pointer");
+  assert(ind < PARTICLES_MAX_EMITTERS, "emitter index is out of bounds");
+
+  particles->emitters[ind] = *emitter;
+}
+
+void particles_emit(particles_t particles, u32 ind, u32 count)
+{
+  assert(particles, "passed particle system is a null pointer");
+  assert(ind < PARTICLES_MAX_EMITTERS, "emitter index is out of bounds");
+
+  const u32 room = particles->capacity - particles->emit_counts[ind];
+  particles->emit_counts[ind] += count < room ? count : room;
+}
+
+void particles_simulate(particles_t particles, f32 dt)
+{
+  assert(particles, "passed particle system is a null pointer");
+
+  particles->dt += dt;
 }
 
+void draw_particles(particles_t particles)
+{
+  assert(particles, "passed particle system is a null pointer");
+  assert(job_thread_ind() == 0,
+         "particles can be drawn only from the main thread");
+
+  if (s_frame_skipped)
+    return;
+
+  // sprites drawn before go first
+  _thread_queues_flush();
+
+  if (s_secondary_count == MAX_SECONDARY_CMDBUFS)
+    fatal("secondary command buffers limit exceeded");
+
+  const VkCommandBuffer cmdbuf = _secondary_begin();
+  if (cmdbuf == VK_NULL_HANDLE)
+    return;
+
+  _sprite_state_bind(cmdbuf, particles->vert_buf);
+
+  // NOTE: chunks are drawn with separate commands, as drawCount over
+  //       1 requires multiDrawIndirect feature
+  for (u32 i = 0; i < particles->chunk_count; ++i)
+    vkCmdDrawIndexedIndirect(cmdbuf, particles->args_buf,
+                             i * sizeof(VkDrawIndexedIndirectCommand), 1,
+                             sizeof(VkDrawIndexedIndirectCommand));
+
+  vkEndCommandBuffer(cmdbuf);
+
+  s_secondaries[s_secondary_count++] = cmdbuf;
+
+  s_frame_stats.draw_calls += particles->chunk_count;
+  ++s_frame_stats.pipeline_binds;
+}
@@ -4,6 +4,7 @@
 #include "internal.h"
 
 static opl_window_t s_window;
+static i32 s_headless;
 
 void init(u16 width, u16 height, const char *title)
 {
@@ -15,6 +16,8 @@ void init_ext(u16 width, u16 height, u16 resx, u16 resy,
 {
   _log_init();
 
+  _job_init();
+
   _input_init();
 
   if (!opl_init())
@@ -26,15 +29,39 @@ void init_ext(u16 width, u16 height, u16 resx, u16 resy,
     fatal("failed to create window");
   trace("opened window");
 
-  _gfx_init(s_window, resx, resy);
+  _gfx_init(s_window, width, height, resx, resy);
 
   info("oe initialized");
 }
 
+void init_headless(u16 resx, u16 resy)
+{
+  _log_init();
+
+  _job_init();
+
+  // NOTE: opl isn't initialized, there is no window to get input from
+  _input_init_headless();
+
+  s_headless = 1;
+  _gfx_init(NULL, resx, resy, resx, resy);
+
+  info("oe initialized in headless mode");
+}
+
 i32 should_close(void)
 {
   _input_update();
+
+  // the headless app decides on its own when to stop
+  if (s_headless) {
+    _input_poll(); // might be a replay
+    return 0;
+  }
+
   opl_update();
+  _input_poll();
+
   return opl_window_should_close(s_window);
 }
 
@@ -42,11 +69,19 @@ void quit(void)
 {
   _gfx_quit();
 
-  opl_window_close(s_window);
-  trace("widow closed");
+  _input_quit();
+
+  if (!s_headless) {
+    opl_window_close(s_window);
+    trace("widow closed");
+
+    opl_quit();
+    trace("opl terminated");
+  }
+
+  s_headless = 0;
 
-  opl_quit();
-  trace("opl terminated");
+  _job_quit();
 
   info("oe terminated");
 
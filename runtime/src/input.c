@@ -1,3 +1,20 @@
+/**
+ * @file input.c
+ * @brief The implementation of the oe input.
+ *
+ * Key and button states are kept as bitsets. Every poll compares the
+ * opl input state with the current bitsets, changes are accumulated
+ * into the frame's pressed and released sets and are queued as
+ * timestamped events, so presses that are shorter than a frame
+ * aren't lost.
+ *
+ * A recording starts with the input state at its beginning, followed
+ * by every sample of the opl input state as a delta to the previous
+ * one, grouped by frames. On replay, the samples of a frame are read
+ * at its start and are fed to the same comparison in place of the
+ * opl input state, one per poll.
+ */
+#include <stdio.h>
 #include <string.h>
 
 #include <opl.h>
@@ -5,49 +22,601 @@
 #include "oe.h"
 #include "internal.h"
 
-const opl_input_state_t *s_cur_input_state;
-opl_input_state_t s_prev_input_state;
+#define INPUT_KEY_COUNT  256
+#define INPUT_KEY_WORDS  (INPUT_KEY_COUNT / 64)
+#define INPUT_MAX_EVENTS 256 // must be a power of two
+
+#define INPUT_RECORD_MAGIC       "OEINPREC"
+#define INPUT_RECORD_VERSION     1
+#define INPUT_REPLAY_MAX_SAMPLES 64 // per frame, later polls aren't
+                                    // recorded
+
+#define BIT_GET(set, ind) (((set)[(ind) / 64] >> ((ind) % 64)) & 1)
+
+static const opl_input_state_t *s_opl_input_state;
+static const opl_input_state_t s_headless_input_state;
+static i32 s_headless;
+
+static u64 s_keys_down[INPUT_KEY_WORDS];
+static u64 s_keys_pressed[INPUT_KEY_WORDS];  // since the frame start
+static u64 s_keys_released[INPUT_KEY_WORDS]; // since the frame start
+static u64 s_btns_down;
+static u64 s_btns_pressed;
+static u64 s_btns_released;
+static vec2_t s_mouse_pos;
+static float s_mouse_wheel; // scrolled since the frame start
+
+static input_event_t s_events[INPUT_MAX_EVENTS];
+static u32 s_event_head;
+static u32 s_event_tail;
+static u32 s_events_dropped;
+
+/**
+ * @brief The header of an input recording.
+ *
+ * The header is followed by a sample of the initial input state, and
+ * records, every record starts with a tag
+ * byte, fields are written without padding in the host byte order:
+ * - INPUT_RECORD_FRAME:  starts a frame;
+ * - INPUT_RECORD_DT:     f64 simulated delta time of the frame;
+ * - INPUT_RECORD_SAMPLE: u8 flags, then the changed parts only:
+ *                        u16 count and codes of the toggled keys,
+ *                        u8 mask of the toggled buttons, i32 x and y,
+ *                        f32 wheel.
+ */
+typedef struct _input_record_header {
+  char magic[8];
+  u32  version;
+  u32  reserved;
+} _input_record_header_t;
+
+enum {
+  INPUT_RECORD_FRAME  = 1,
+  INPUT_RECORD_DT     = 2,
+  INPUT_RECORD_SAMPLE = 3,
+};
+
+enum {
+  INPUT_SAMPLE_KEYS  = 1 << 0,
+  INPUT_SAMPLE_BTNS  = 1 << 1,
+  INPUT_SAMPLE_POS   = 1 << 2,
+  INPUT_SAMPLE_WHEEL = 1 << 3,
+};
+
+static FILE *s_record;
+static u32 s_record_frames;
+static opl_input_state_t s_record_state; // the last written sample
+static u32 s_record_samples; // written in the current frame
+static u32 s_record_skipped; // polls past the sample limit
+
+static FILE *s_replay;
+static u32 s_replay_frames;
+static opl_input_state_t s_replay_state; // the last read sample
+static opl_input_state_t s_replay_samples[INPUT_REPLAY_MAX_SAMPLES];
+static u32 s_replay_sample_count;
+static u32 s_replay_sample_ind;
+static f64 s_replay_dt;
+static i32 s_replay_has_dt;
+
+static void _event_push(const input_event_t *event) {
+  if (s_event_tail - s_event_head == INPUT_MAX_EVENTS) {
+    ++s_events_dropped;
+    return;
+  }
+
+  s_events[s_event_tail++ & (INPUT_MAX_EVENTS - 1)] = *event;
+}
+
+/**
+ * @brief Queues events of the bits that changed in the set.
+ */
+static void _changes_push(u64 changed, u64 down, u32 base,
+                          input_event_type_t down_type,
+                          input_event_type_t up_type, u64 time) {
+  while (changed) {
+    const u32 bit = __builtin_ctzll(changed);
+    changed &= changed - 1;
+
+    input_event_t event = {
+      .type = (down >> bit) & 1 ? down_type : up_type,
+      .time = time,
+    };
+
+    if (down_type == INPUT_EVENT_KEY_DOWN)
+      event.key = (key_t)(base + bit);
+    else
+      event.btn = (btn_t)(base + bit);
+
+    _event_push(&event);
+  }
+}
+
+/**
+ * @brief Clears the state accumulated during a frame.
+ */
+static void _frame_reset(void) {
+  memset(s_keys_pressed, 0, sizeof(s_keys_pressed));
+  memset(s_keys_released, 0, sizeof(s_keys_released));
+  s_btns_pressed = 0;
+  s_btns_released = 0;
+  s_mouse_wheel = 0.0f;
+
+  // NOTE: events not read during the frame are stale now
+  s_event_head = s_event_tail;
+}
+
+/**
+ * @brief Compares the input state with the current one.
+ */
+static void _state_sample(const opl_input_state_t *state) {
+  const u64 time = get_time_ns();
+
+  for (u32 i = 0; i < INPUT_KEY_WORDS; ++i) {
+    u64 down = 0;
+    for (u32 j = 0; j < 64; ++j)
+      down |= (u64)(state->keys[i * 64 + j] != 0) << j;
+
+    const u64 changed = down ^ s_keys_down[i];
+    if (!changed)
+      continue;
+
+    s_keys_pressed[i]  |= changed & down;
+    s_keys_released[i] |= changed & ~down;
+    s_keys_down[i] = down;
+
+    _changes_push(changed, down, i * 64, INPUT_EVENT_KEY_DOWN,
+                  INPUT_EVENT_KEY_UP, time);
+  }
+
+  u64 btns_down = 0;
+  for (u32 i = 0; i < sizeof(state->btns); ++i)
+    btns_down |= (u64)(state->btns[i] != 0) << i;
+
+  const u64 btns_changed = btns_down ^ s_btns_down;
+  s_btns_pressed  |= btns_changed & btns_down;
+  s_btns_released |= btns_changed & ~btns_down;
+  s_btns_down = btns_down;
+
+  _changes_push(btns_changed, btns_down, 0, INPUT_EVENT_BTN_DOWN,
+                INPUT_EVENT_BTN_UP, time);
+
+  const vec2_t pos = { state->x, state->y };
+  if (pos.x != s_mouse_pos.x || pos.y != s_mouse_pos.y) {
+    s_mouse_pos = pos;
+    _event_push(&(input_event_t){
+      .type = INPUT_EVENT_MOTION,
+      .time = time,
+      .pos  = pos,
+    });
+  }
+
+  if (state->wheel != 0.0f) {
+    s_mouse_wheel += state->wheel;
+    _event_push(&(input_event_t){
+      .type  = INPUT_EVENT_WHEEL,
+      .time  = time,
+      .wheel = state->wheel,
+    });
+  }
+}
+
+/**
+ * @brief Makes the input state current, without reporting any presses
+ *        or releases.
+ */
+static void _state_set(const opl_input_state_t *state) {
+  memset(s_keys_down, 0, sizeof(s_keys_down));
+  s_btns_down = 0;
+  s_mouse_pos = (vec2_t){ 0.0f, 0.0f };
+
+  _state_sample(state);
+  _frame_reset();
+}
+
+// +------------------------------------------------------------------+
+// |                            recording                             |
+// +------------------------------------------------------------------+
+
+static void _record_frame(void) {
+  const u8 tag = INPUT_RECORD_FRAME;
+  fwrite(&tag, sizeof(tag), 1, s_record);
+
+  ++s_record_frames;
+  s_record_samples = 0;
+}
+
+static void _record_sample(const opl_input_state_t *state) {
+  // NOTE: replay keeps up to INPUT_REPLAY_MAX_SAMPLES per frame, changes
+  //       of the skipped polls are written with the next frame's sample
+  if (s_record_samples == INPUT_REPLAY_MAX_SAMPLES) {
+    ++s_record_skipped;
+    return;
+  }
+
+  const opl_input_state_t *prev = &s_record_state;
+
+  u8 keys[256];
+  u16 key_count = 0;
+  for (u32 i = 0; i < INPUT_KEY_COUNT; ++i)
+    if (!state->keys[i] != !prev->keys[i])
+      keys[key_count++] = (u8)i;
+
+  u8 btns = 0;
+  for (u32 i = 0; i < sizeof(state->btns); ++i)
+    if (!state->btns[i] != !prev->btns[i])
+      btns |= 1 << i;
+
+  const i32 x = state->x;
+  const i32 y = state->y;
+  const f32 wheel = state->wheel;
+
+  u8 flags = 0;
+  if (key_count)
+    flags |= INPUT_SAMPLE_KEYS;
+  if (btns)
+    flags |= INPUT_SAMPLE_BTNS;
+  if (state->x != prev->x || state->y != prev->y)
+    flags |= INPUT_SAMPLE_POS;
+  if (wheel != 0.0f)
+    flags |= INPUT_SAMPLE_WHEEL;
+
+  // NOTE: samples are written even when nothing has changed, so every
+  //       poll on replay gets the sample of the same poll
+  const u8 tag = INPUT_RECORD_SAMPLE;
+  fwrite(&tag, sizeof(tag), 1, s_record);
+  fwrite(&flags, sizeof(flags), 1, s_record);
+
+  if (flags & INPUT_SAMPLE_KEYS) {
+    fwrite(&key_count, sizeof(key_count), 1, s_record);
+    fwrite(keys, 1, key_count, s_record);
+  }
+
+  if (flags & INPUT_SAMPLE_BTNS)
+    fwrite(&btns, sizeof(btns), 1, s_record);
+
+  if (flags & INPUT_SAMPLE_POS) {
+    fwrite(&x, sizeof(x), 1, s_record);
+    fwrite(&y, sizeof(y), 1, s_record);
+  }
+
+  if (flags & INPUT_SAMPLE_WHEEL)
+    fwrite(&wheel, sizeof(wheel), 1, s_record);
+
+  s_record_state = *state;
+  ++s_record_samples;
+}
+
+i32 input_record_begin(const char *path) {
+  assert(path, "passed path is a null pointer");
+
+  if (s_record || s_replay) {
+    error("failed to begin input recording, input is already being "
+          "recorded or replayed");
+    return 0;
+  }
+
+  FILE *fd = fopen(path, "wb");
+  if (!fd) {
+    error("failed to open \"%s\" input recording", path);
+    return 0;
+  }
+
+  const _input_record_header_t header = {
+    .magic   = INPUT_RECORD_MAGIC,
+    .version = INPUT_RECORD_VERSION,
+  };
+
+  if (fwrite(&header, sizeof(header), 1, fd) != 1) {
+    error("failed to write \"%s\" input recording header", path);
+    fclose(fd);
+    return 0;
+  }
+
+  memset(&s_record_state, 0, sizeof(s_record_state));
+  s_record_frames = 0;
+  s_record_samples = 0;
+  s_record_skipped = 0;
+  s_record = fd;
+
+  // keys held at the start are down on replay as well
+  _record_sample(s_opl_input_state);
+
+  info("recording input to \"%s\"", path);
+
+  return 1;
+}
+
+void input_record_end(void) {
+  if (!s_record)
+    return;
+
+  fclose(s_record);
+  s_record = NULL;
+
+  if (s_record_skipped)
+    warn("%u input polls past %u per frame weren't recorded",
+         s_record_skipped, INPUT_REPLAY_MAX_SAMPLES);
+
+  info("input recording finished, %u frames recorded", s_record_frames);
+}
+
+// +------------------------------------------------------------------+
+// |                             replay                               |
+// +------------------------------------------------------------------+
+
+#define READ(var) (fread(&(var), sizeof(var), 1, s_replay) == 1)
+
+static i32 _replay_sample_read(void) {
+  opl_input_state_t *state = &s_replay_state;
+
+  u8 flags;
+  if (!READ(flags))
+    return 0;
+
+  if (flags & INPUT_SAMPLE_KEYS) {
+    u16 key_count;
+    u8 keys[256];
+    if (
+      !READ(key_count) || key_count > INPUT_KEY_COUNT ||
+      fread(keys, 1, key_count, s_replay) != key_count
+    )
+      return 0;
+
+    for (u32 i = 0; i < key_count; ++i)
+      state->keys[keys[i]] = !state->keys[keys[i]];
+  }
+
+  if (flags & INPUT_SAMPLE_BTNS) {
+    u8 btns;
+    if (!READ(btns))
+      return 0;
+
+    for (u32 i = 0; i < sizeof(state->btns); ++i)
+      if ((btns >> i) & 1)
+        state->btns[i] = !state->btns[i];
+  }
+
+  if (flags & INPUT_SAMPLE_POS) {
+    i32 x, y;
+    if (!READ(x) || !READ(y))
+      return 0;
+
+    state->x = x;
+    state->y = y;
+  }
+
+  state->wheel = 0.0f;
+  if (flags & INPUT_SAMPLE_WHEEL) {
+    f32 wheel;
+    if (!READ(wheel))
+      return 0;
+
+    state->wheel = wheel;
+  }
+
+  if (s_replay_sample_count == INPUT_REPLAY_MAX_SAMPLES)
+    return 0;
+
+  s_replay_samples[s_replay_sample_count++] = *state;
+
+  return 1;
+}
+
+/**
+ * @brief Reads all the records of the next frame.
+ *
+ * @return Returns 1 on success, or 0 if the recording has ended or is
+ *         corrupted.
+ */
+static i32 _replay_frame_read(void) {
+  s_replay_sample_count = 0;
+  s_replay_sample_ind = 0;
+  s_replay_has_dt = 0;
+
+  u8 tag;
+  if (!READ(tag) || tag != INPUT_RECORD_FRAME)
+    return 0;
+
+  for (;;) {
+    const int c = fgetc(s_replay);
+    if (c == EOF || c == INPUT_RECORD_FRAME) {
+      if (c != EOF)
+        ungetc(c, s_replay);
+      break;
+    }
+
+    if (c == INPUT_RECORD_DT) {
+      if (!READ(s_replay_dt))
+        return 0;
+      s_replay_has_dt = 1;
+    } else if (c != INPUT_RECORD_SAMPLE || !_replay_sample_read()) {
+      return 0;
+    }
+  }
+
+  ++s_replay_frames;
+
+  return 1;
+}
+
+i32 input_replay_begin(const char *path) {
+  assert(path, "passed path is a null pointer");
+
+  if (s_record || s_replay) {
+    error("failed to begin input replay, input is already being "
+          "recorded or replayed");
+    return 0;
+  }
+
+  FILE *fd = fopen(path, "rb");
+  if (!fd) {
+    error("failed to open \"%s\" input recording", path);
+    return 0;
+  }
+
+  _input_record_header_t header;
+  if (
+    fread(&header, sizeof(header), 1, fd) != 1 ||
+    memcmp(header.magic, INPUT_RECORD_MAGIC, sizeof(header.magic)) ||
+    header.version != INPUT_RECORD_VERSION
+  ) {
+    error("\"%s\" isn't an input recording", path);
+    fclose(fd);
+    return 0;
+  }
+
+  memset(&s_replay_state, 0, sizeof(s_replay_state));
+  s_replay_sample_count = 0;
+  s_replay_sample_ind = 0;
+  s_replay_has_dt = 0;
+  s_replay_frames = 0;
+  s_replay = fd;
+
+  u8 tag;
+  if (!READ(tag) || tag != INPUT_RECORD_SAMPLE || !_replay_sample_read()) {
+    error("input recording \"%s\" is corrupted", path);
+    fclose(fd);
+    s_replay = NULL;
+    return 0;
+  }
+
+  _state_set(&s_replay_state);
+
+  info("replaying input from \"%s\"", path);
+
+  return 1;
+}
+
+void input_replay_end(void) {
+  if (!s_replay)
+    return;
+
+  fclose(s_replay);
+  s_replay = NULL;
+  s_replay_sample_count = 0;
+
+  info("input replay finished, %u frames replayed", s_replay_frames);
+}
+
+i32 input_replay_active(void) {
+  return s_replay != NULL;
+}
+
+#undef READ
+
+f64 _input_frame_dt(f64 dt) {
+  if (s_record && s_record_frames) {
+    const u8 tag = INPUT_RECORD_DT;
+    fwrite(&tag, sizeof(tag), 1, s_record);
+    fwrite(&dt, sizeof(dt), 1, s_record);
+  }
+
+  if (s_replay && s_replay_has_dt)
+    return s_replay_dt;
+
+  return dt;
+}
+
+// +------------------------------------------------------------------+
+// |                              input                               |
+// +------------------------------------------------------------------+
 
 void _input_init(void) {
-  s_cur_input_state = opl_get_input_state();
-  memcpy(&s_prev_input_state, s_cur_input_state,
-         sizeof(opl_input_state_t));
+  s_headless = 0;
+  s_opl_input_state = opl_get_input_state();
+
+  _state_set(s_opl_input_state);
+}
+
+void _input_init_headless(void) {
+  s_headless = 1;
+  s_opl_input_state = &s_headless_input_state;
+  _state_set(s_opl_input_state);
+}
+
+void _input_quit(void) {
+  input_record_end();
+  input_replay_end();
 }
 
 void _input_update(void) {
-  memcpy(&s_prev_input_state, s_cur_input_state,
-         sizeof(opl_input_state_t));
+  _frame_reset();
+
+  if (s_events_dropped) {
+    warn("%u input events dropped", s_events_dropped);
+    s_events_dropped = 0;
+  }
+
+  if (s_record)
+    _record_frame();
+
+  if (s_replay && !_replay_frame_read()) {
+    if (!feof(s_replay))
+      error("input recording is corrupted");
+    input_replay_end();
+  }
+}
+
+void _input_poll(void) {
+  if (s_replay) {
+    // polls past the recorded ones see no changes
+    if (s_replay_sample_ind < s_replay_sample_count)
+      _state_sample(&s_replay_samples[s_replay_sample_ind++]);
+    return;
+  }
+
+  _state_sample(s_opl_input_state);
+
+  if (s_record && s_record_frames)
+    _record_sample(s_opl_input_state);
+}
+
+void input_poll(void) {
+  if (!s_headless && !s_replay)
+    opl_update();
+
+  _input_poll();
+}
+
+i32 input_event_next(input_event_t *event) {
+  assert(event, "passed event is a null pointer");
+
+  if (s_event_head == s_event_tail)
+    return 0;
+
+  *event = s_events[s_event_head++ & (INPUT_MAX_EVENTS - 1)];
+
+  return 1;
 }
 
-int is_key_pressed(key_t key) {
-  return s_cur_input_state->keys[key] && !s_prev_input_state.keys[key];
+i32 is_key_pressed(key_t key) {
+  return BIT_GET(s_keys_pressed, (u32)key);
 }
 
-int is_key_down(key_t key) {
-  return s_cur_input_state->keys[key];
+i32 is_key_down(key_t key) {
+  return BIT_GET(s_keys_down, (u32)key);
 }
 
-int is_key_released(key_t key) {
-  return !s_cur_input_state->keys[key] && s_prev_input_state.keys[key];
+i32 is_key_released(key_t key) {
+  return BIT_GET(s_keys_released, (u32)key);
 }
 
-int is_btn_pressed(btn_t btn) {
-  return s_cur_input_state->btns[btn] && s_prev_input_state.btns[btn];
+i32 is_btn_pressed(btn_t btn) {
+  return (s_btns_pressed >> btn) & 1;
 }
 
-int is_btn_down(btn_t btn) {
-  return s_cur_input_state->btns[btn];
+i32 is_btn_down(btn_t btn) {
+  return (s_btns_down >> btn) & 1;
 }
 
-int is_btn_released(btn_t btn) {
-  return !s_cur_input_state->btns[btn] && s_prev_input_state.btns[btn];
+i32 is_btn_released(btn_t btn) {
+  return (s_btns_released >> btn) & 1;
 }
 
 vec2_t mouse_pos(void) {
-  return (vec2_t){ s_cur_input_state->x, s_cur_input_state->y };
+  return s_mouse_pos;
 }
 
 float mouse_wheel(void) {
-  return s_cur_input_state->wheel;
+  return s_mouse_wheel;
 }
-
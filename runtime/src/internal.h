@@ -20,10 +20,60 @@ typedef struct _vert {
   u8      tex_id;
 } _vert_t;
 
+/**
+ * @brief Writes vertices of a sprite.
+ */
+static inline void _sprite_write(_vert_t *verts, rect_t dst, rect_t src,
+                                 u32 tex_id, color_t color, f32 depth)
+{
+  verts[0] = (_vert_t){
+    .pos = { dst.x, dst.y, depth },
+    .color = color,
+    .uv = { src.x, src.y },
+    .tex_id = tex_id,
+  };
+
+  verts[1] = (_vert_t){
+    .pos = { dst.x + dst.width, dst.y, depth },
+    .color = color,
+    .uv = { src.x + src.width, src.y },
+    .tex_id = tex_id,
+  };
+
+  verts[2] = (_vert_t){
+    .pos = { dst.x + dst.width, dst.y + dst.height, depth },
+    .color = color,
+    .uv = { src.x + src.width, src.y + src.height },
+    .tex_id = tex_id,
+  };
+
+  verts[3] = (_vert_t){
+    .pos = { dst.x, dst.y + dst.height, depth },
+    .color = color,
+    .uv = { src.x, src.y + src.height },
+    .tex_id = tex_id,
+  };
+}
+
 typedef struct _ubo {
   camera_t cam;
 } _ubo_t;
 
+#define THREAD_MAX_SLOTS 64
+#define THREAD_SLOT_NONE UINT32_MAX
+
+/**
+ * @brief Returns the slot of the calling thread.
+ *
+ * Every thread gets its own slot on the first call, threads not
+ * created by the job system too, so per thread data indexed by the
+ * slot has a single writer. Slots aren't reused.
+ *
+ * @return Returns the slot below THREAD_MAX_SLOTS, or THREAD_SLOT_NONE
+ *         if all the slots are taken.
+ */
+extern u32 _thread_slot(void);
+
 /**
  * @brief Initializes logging system.
  */
@@ -34,24 +84,86 @@ extern void _log_init(void);
  */
 extern void _log_quit(void);
 
+/**
+ * @brief Initializes job system and starts worker threads.
+ */
+extern void _job_init(void);
+
+/**
+ * @brief Stops worker threads and terminates job system.
+ */
+extern void _job_quit(void);
+
 /**
  * @brief Initializes input system.
  */
 extern void _input_init(void);
 
 /**
- * @brief Updates input system.
+ * @brief Initializes input system without a window, no key or button
+ *        is ever pressed.
+ */
+extern void _input_init_headless(void);
+
+/**
+ * @brief Finishes input recording and replay, if any.
+ */
+extern void _input_quit(void);
+
+/**
+ * @brief Starts a new input frame.
  *
- * This function should be called before opl_update call.
+ * Clears pressed and released states, the wheel and events of the
+ * previous frame. This function should be called before opl_update
+ * call.
  */
 extern void _input_update(void);
 
+/**
+ * @brief Samples the opl input state and queues events of changes.
+ *
+ * This function should be called after opl_update call.
+ */
+extern void _input_poll(void);
+
+/**
+ * @brief Passes the measured frame delta time through input
+ *        recording and replay.
+ *
+ * The delta time is written to a recording, and is replaced with the
+ * recorded one on replay.
+ *
+ * @param dt The measured delta time in seconds.
+ *
+ * @return Returns the delta time to simulate the frame with.
+ */
+extern f64 _input_frame_dt(f64 dt);
+
+/**
+ * @brief Reserves vertices for up to count sprites in the calling
+ *        thread's queue, see draw_set_order().
+ *
+ * Sprites are reserved in chunks, so fewer than count might be
+ * reserved, the rest are reserved by the next calls.
+ *
+ * @param reserved Receives the number of reserved sprites, 4 vertices
+ *                 per sprite.
+ *
+ * @return Returns a pointer to the vertices in the mapped vertex
+ *         buffer, or NULL if the buffer is exhausted.
+ */
+extern _vert_t *_sprites_reserve(u32 count, u32 *reserved);
+
 /**
  * @brief Initialized graphics API.
  *
- * @param window An opl window handle of the main window.
+ * @param window An opl window handle of the main window, or NULL to
+ *               render into offscreen images.
+ * @param width  The width of the window.
+ * @param height The height of the window.
  */
-extern void _gfx_init(opl_window_t window, i16 resx, i16 resy);
+extern void _gfx_init(opl_window_t window, u16 width, u16 height,
+                      i16 resx, i16 resy);
 
 /**
  * @brief Terminate graphics API.
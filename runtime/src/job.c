@@ -0,0 +1,394 @@
+/**
+ * @file job.c
+ * @brief The implementation of the oe job system.
+ *
+ * Every thread owns a fixed size Chase-Lev deque. The owner pushes
+ * and pops jobs from the bottom of its deque, idle threads steal
+ * from the top of the other deques. Thread 0 is the thread which
+ * called init(), it executes jobs only while waiting on a counter.
+ * Other threads have no deque and can't submit jobs, so they don't
+ * execute jobs while waiting, a stolen job might submit more.
+ */
+#include <string.h>
+#include <sched.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "oe.h"
+#include "internal.h"
+
+#define JOB_QUEUE_SIZE       4096 // must be a power of two
+#define JOB_MAX_RANGE_CHUNKS 1024
+
+#define LOAD(ptr)       __atomic_load_n(ptr, __ATOMIC_ACQUIRE)
+#define STORE(ptr, val) __atomic_store_n(ptr, val, __ATOMIC_RELEASE)
+
+typedef struct _job {
+  job_fn         fn;
+  void          *data;
+  job_counter_t *counter;
+  struct _job   *next; // used only by the counter wait lists
+} _job_t;
+
+typedef struct _deque {
+  i64    top;
+  i64    bottom;
+  _job_t jobs[JOB_QUEUE_SIZE];
+} _deque_t;
+
+typedef struct _range_job {
+  job_range_fn fn;
+  void        *data;
+  u32          start, end;
+} _range_job_t;
+
+static _deque_t s_deques[JOB_MAX_THREADS];
+static pthread_t s_threads[JOB_MAX_THREADS];
+static u32 s_thread_count = 1;
+static i32 s_running;
+static i32 s_queued;
+static i32 s_sleeping;
+static pthread_mutex_t s_sleep_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t s_sleep_cond = PTHREAD_COND_INITIALIZER;
+
+static __thread u32 t_thread_ind = JOB_THREAD_NONE;
+
+static void _counter_signal(job_counter_t *counter);
+
+// +------------------------------------------------------------------+
+// |                            deque                                 |
+// +------------------------------------------------------------------+
+
+inline static i32 _deque_push(_deque_t *deque, const _job_t *job)
+{
+  const i64 b = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED);
+  const i64 t = LOAD(&deque->top);
+
+  if (b - t >= JOB_QUEUE_SIZE)
+    return 0;
+
+  deque->jobs[b & (JOB_QUEUE_SIZE - 1)] = *job;
+  STORE(&deque->bottom, b + 1);
+
+  return 1;
+}
+
+inline static i32 _deque_pop(_deque_t *deque, _job_t *job)
+{
+  const i64 b = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED) - 1;
+  __atomic_store_n(&deque->bottom, b, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  i64 t = __atomic_load_n(&deque->top, __ATOMIC_RELAXED);
+
+  if (t > b) {
+    // deque is empty
+    __atomic_store_n(&deque->bottom, b + 1, __ATOMIC_RELAXED);
+    return 0;
+  }
+
+  *job = deque->jobs[b & (JOB_QUEUE_SIZE - 1)];
+
+  if (t != b)
+    return 1;
+
+  // the last job, race against thieves
+  const i32 won = __atomic_compare_exchange_n(
+    &deque->top, &t, t + 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+  __atomic_store_n(&deque->bottom, b + 1, __ATOMIC_RELAXED);
+
+  return won;
+}
+
+inline static i32 _deque_steal(_deque_t *deque, _job_t *job)
+{
+  i64 t = LOAD(&deque->top);
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  const i64 b = LOAD(&deque->bottom);
+
+  if (t >= b)
+    return 0;
+
+  *job = deque->jobs[t & (JOB_QUEUE_SIZE - 1)];
+
+  return __atomic_compare_exchange_n(
+    &deque->top, &t, t + 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+}
+
+// +------------------------------------------------------------------+
+// |                          scheduling                              |
+// +------------------------------------------------------------------+
+
+inline static void _push(const _job_t *job)
+{
+  // only the owner can push to a deque
+  assert(t_thread_ind != JOB_THREAD_NONE,
+         "jobs can be submitted only from the main thread and jobs");
+
+  // NOTE: if the own deque is full, execute the job in place, it's
+  //       better than dropping it or blocking the caller
+  if (
+    t_thread_ind == JOB_THREAD_NONE ||
+    !_deque_push(&s_deques[t_thread_ind], job)
+  ) {
+    job->fn(job->data);
+    _counter_signal(job->counter);
+    return;
+  }
+
+  __atomic_add_fetch(&s_queued, 1, __ATOMIC_SEQ_CST);
+
+  if (__atomic_load_n(&s_sleeping, __ATOMIC_SEQ_CST)) {
+    pthread_mutex_lock(&s_sleep_mutex);
+    pthread_cond_signal(&s_sleep_cond);
+    pthread_mutex_unlock(&s_sleep_mutex);
+  }
+}
+
+inline static i32 _take(_job_t *job)
+{
+  const i32 owner = t_thread_ind != JOB_THREAD_NONE;
+
+  if (owner && _deque_pop(&s_deques[t_thread_ind], job))
+    goto TAKEN;
+
+  for (u32 i = owner; i < s_thread_count; ++i) {
+    const u32 victim = owner ? (t_thread_ind + i) % s_thread_count : i;
+
+    if (_deque_steal(&s_deques[victim], job))
+      goto TAKEN;
+  }
+
+  return 0;
+
+TAKEN:
+  __atomic_sub_fetch(&s_queued, 1, __ATOMIC_SEQ_CST);
+  return 1;
+}
+
+inline static i32 _execute_one(void)
+{
+  _job_t job;
+  if (!_take(&job))
+    return 0;
+
+  job.fn(job.data);
+  _counter_signal(job.counter);
+
+  return 1;
+}
+
+static void _counter_signal(job_counter_t *counter)
+{
+  if (!counter)
+    return;
+
+  // NOTE: the counter might live on the waiter's stack, it can be
+  //       gone as soon as job_wait() sees zero and the lock released,
+  //       so the last job holds the lock while decrementing
+  i32 value = LOAD(&counter->value);
+  while (value > 1) {
+    if (__atomic_compare_exchange_n(&counter->value, &value, value - 1, 0,
+                                    __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+      return;
+  }
+
+  while (__atomic_exchange_n(&counter->lock, 1, __ATOMIC_ACQUIRE))
+    sched_yield();
+
+  // a job might have been added to the counter meanwhile
+  if (__atomic_sub_fetch(&counter->value, 1, __ATOMIC_ACQ_REL) > 0) {
+    __atomic_store_n(&counter->lock, 0, __ATOMIC_RELEASE);
+    return;
+  }
+
+  // the counter reached zero, release jobs that were waiting on it
+  _job_t *waiter = counter->waiters;
+  counter->waiters = NULL;
+
+  // the last access to the counter
+  __atomic_store_n(&counter->lock, 0, __ATOMIC_RELEASE);
+
+  while (waiter) {
+    _job_t *next = waiter->next;
+    _push(waiter);
+    free(waiter);
+    waiter = next;
+  }
+}
+
+static void *_worker_main(void *arg)
+{
+  t_thread_ind = (u32)(uintptr_t)arg;
+
+  while (LOAD(&s_running)) {
+    if (_execute_one())
+      continue;
+
+    pthread_mutex_lock(&s_sleep_mutex);
+    __atomic_add_fetch(&s_sleeping, 1, __ATOMIC_SEQ_CST);
+
+    while (
+      LOAD(&s_running) &&
+      !__atomic_load_n(&s_queued, __ATOMIC_SEQ_CST)
+    )
+      pthread_cond_wait(&s_sleep_cond, &s_sleep_mutex);
+
+    __atomic_sub_fetch(&s_sleeping, 1, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&s_sleep_mutex);
+  }
+
+  return NULL;
+}
+
+void _job_init(void)
+{
+  long cores = sysconf(_SC_NPROCESSORS_ONLN);
+  if (cores < 1) { cores = 1; }
+  if (cores > JOB_MAX_THREADS) { cores = JOB_MAX_THREADS; }
+
+  s_thread_count = (u32)cores;
+  t_thread_ind = 0;
+  STORE(&s_running, 1);
+
+  for (u32 i = 1; i < s_thread_count; ++i) {
+    if (pthread_create(&s_threads[i], NULL, _worker_main,
+                       (void*)(uintptr_t)i)) {
+      error("failed to create %u worker thread, continuing with %u",
+            i, i);
+      s_thread_count = i;
+      break;
+    }
+  }
+
+  debug("job system initialized: %u threads", s_thread_count);
+}
+
+void _job_quit(void)
+{
+  pthread_mutex_lock(&s_sleep_mutex);
+  STORE(&s_running, 0);
+  pthread_cond_broadcast(&s_sleep_cond);
+  pthread_mutex_unlock(&s_sleep_mutex);
+
+  for (u32 i = 1; i < s_thread_count; ++i)
+    pthread_join(s_threads[i], NULL);
+
+  s_thread_count = 1;
+  memset(s_deques, 0, sizeof(s_deques));
+  s_queued = 0;
+
+  trace("job system terminated");
+}
+
+// +------------------------------------------------------------------+
+// |                              api                                 |
+// +------------------------------------------------------------------+
+
+void job_run(job_fn fn, void *data, job_counter_t *counter)
+{
+  job_run_after(NULL, fn, data, counter);
+}
+
+void job_run_after(job_counter_t *dependency, job_fn fn, void *data,
+                   job_counter_t *counter)
+{
+  assert(fn, "passed job function is a null pointer");
+
+  if (counter)
+    __atomic_add_fetch(&counter->value, 1, __ATOMIC_ACQ_REL);
+
+  const _job_t job = { fn, data, counter, NULL };
+
+  if (!dependency || !LOAD(&dependency->value)) {
+    _push(&job);
+    return;
+  }
+
+  while (__atomic_exchange_n(&dependency->lock, 1, __ATOMIC_ACQUIRE))
+    sched_yield();
+
+  // the dependency might have been satisfied while we were spinning
+  if (!LOAD(&dependency->value)) {
+    __atomic_store_n(&dependency->lock, 0, __ATOMIC_RELEASE);
+    _push(&job);
+    return;
+  }
+
+  _job_t *waiter = malloc(sizeof(_job_t));
+  if (!waiter)
+    fatal("failed to allocate memory for a dependent job");
+
+  *waiter = job;
+  waiter->next = dependency->waiters;
+  dependency->waiters = waiter;
+
+  __atomic_store_n(&dependency->lock, 0, __ATOMIC_RELEASE);
+}
+
+void job_wait(job_counter_t *counter)
+{
+  // the last job releases the lock after it's done with the counter
+  while (LOAD(&counter->value) > 0 || LOAD(&counter->lock)) {
+    if (t_thread_ind == JOB_THREAD_NONE || !_execute_one())
+      sched_yield();
+  }
+}
+
+static void _range_job(void *data)
+{
+  const _range_job_t *range = data;
+  range->fn(range->start, range->end, range->data);
+}
+
+void job_parallel_for(u32 count, u32 grain, job_range_fn fn, void *data)
+{
+  if (!count)
+    return;
+
+  if (!grain)
+    grain = count / (s_thread_count * 4) + 1;
+
+  u32 chunk_count = (count + grain - 1) / grain;
+  if (chunk_count > JOB_MAX_RANGE_CHUNKS) {
+    chunk_count = JOB_MAX_RANGE_CHUNKS;
+    grain = (count + chunk_count - 1) / chunk_count;
+    chunk_count = (count + grain - 1) / grain;
+  }
+
+  // NOTE: a single chunk isn't worth the trip through the queues
+  if (chunk_count == 1 || s_thread_count == 1) {
+    fn(0, count, data);
+    return;
+  }
+
+  _range_job_t ranges[chunk_count];
+  job_counter_t counter = JOB_COUNTER_INIT;
+
+  // the first chunk is executed by the calling thread itself
+  for (u32 i = 1; i < chunk_count; ++i) {
+    const u32 start = i * grain;
+
+    ranges[i] = (_range_job_t){
+      .fn    = fn,
+      .data  = data,
+      .start = start,
+      .end   = start + grain < count ? start + grain : count,
+    };
+
+    job_run(_range_job, &ranges[i], &counter);
+  }
+
+  fn(0, grain, data);
+
+  job_wait(&counter);
+}
+
+u32 job_thread_count(void)
+{
+  return s_thread_count;
+}
+
+u32 job_thread_ind(void)
+{
+  return t_thread_ind;
+}
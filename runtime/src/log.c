@@ -1,20 +1,419 @@
 /**
- * @file internal.h
- * @brief The implementation of the internal oe functions.
+ * @file log.c
+ * @brief The implementation of the oe logging.
+ *
+ * Every thread owns a single producer single consumer ring of log
+ * records, indexed by its thread slot. A record keeps the format
+ * pointer and the raw arguments, messages are formatted and written by
+ * the logger thread. Records are ordered across the threads by a global
+ * sequence number. Messages with arguments that don't fit a record are
+ * written right away.
+ *
+ * While a binary log is open, records are written to it as they are,
+ * with the formats written once, and only warnings and errors are
+ * formatted as text.
  *
  * @date 30.09.2024
  * @author Ilya Buravov
  */
+#define _POSIX_C_SOURCE 199309L
+
+#include <time.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <stdarg.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
 
 #include <opl.h>
 #include <arch.h>
 
 #include "oe.h"
 #include "internal.h"
+#include "log_format.h"
+
+#define LOG_RING_SIZE    128 // per thread, must be a power of two
+#define LOG_MAX_FORMATS  1024 // must be a power of two
+
+#define LOAD(ptr)       __atomic_load_n(ptr, __ATOMIC_ACQUIRE)
+#define STORE(ptr, val) __atomic_store_n(ptr, val, __ATOMIC_RELEASE)
+
+typedef struct _log_record {
+  u64         seq;
+  u64         time; // ns
+  const char *fmt;  // NULL if the message is written as text
+  u32         level;
+  u32         size; // the number of bytes in data
+  u8          data[LOG_MAX_ARGS_SIZE];
+} _log_record_t;
+
+typedef struct _log_ring {
+  u64           head; // written by the consumer
+  u64           tail; // written by the owner thread
+  _log_record_t records[LOG_RING_SIZE];
+} _log_ring_t;
+
+/**
+ * @brief Format string written to the binary log.
+ */
+typedef struct _log_format_id {
+  const char *fmt;
+  u32         id;
+} _log_format_id_t;
+
+log_level_t _log_level = LOG_LEVEL_TRACE;
 
 static arch_logger_t s_logger;
+static _log_ring_t s_rings[THREAD_MAX_SLOTS];
+static u64 s_seq;
+static u32 s_dropped;
+static i32 s_running;
+static pthread_t s_thread;
+static pthread_mutex_t s_consume_mutex = PTHREAD_MUTEX_INITIALIZER;
+static i32 s_sleeping;
+static pthread_mutex_t s_sleep_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t s_sleep_cond = PTHREAD_COND_INITIALIZER;
+static FILE *s_binary;
+static _log_format_id_t s_format_ids[LOG_MAX_FORMATS];
+static u32 s_format_count;
+
+// +------------------------------------------------------------------+
+// |                            writing                               |
+// +------------------------------------------------------------------+
+
+/**
+ * @brief Writes the message to the logger, or to stdout if there is
+ *        no logger.
+ *
+ * Should be called with the consume mutex locked, so the logger isn't
+ * destroyed while it's written to.
+ */
+static void _write_v(log_level_t level, const char *fmt, va_list args)
+{
+  va_list copy;
+  va_copy(copy, args);
+
+  const i32 written =
+    s_logger && arch_logvl(s_logger, (arch_log_level_t)level, fmt, copy);
+
+  va_end(copy);
+
+  if (written)
+    return;
+
+  // ignore error codes
+  vprintf(fmt, args);
+  puts("");
+}
+
+static void _write(log_level_t level, const char *fmt, ...)
+{
+  va_list valist;
+  va_start(valist, fmt);
+  _write_v(level, fmt, valist);
+  va_end(valist);
+}
+
+/**
+ * @brief Returns the binary log id of the format, writes the format
+ *        if it's the first message using it.
+ *
+ * @return Returns the format id, or 0 if there is no space for it.
+ */
+static u32 _binary_format_id(const char *fmt)
+{
+  // NOTE: formats are usually string literals, so the pointer
+  //       identifies the format
+  u32 ind = (u32)(((uintptr_t)fmt >> 3) * 2654435761u) &
+            (LOG_MAX_FORMATS - 1);
+
+  for (u32 i = 0; i < LOG_MAX_FORMATS; ++i) {
+    _log_format_id_t *entry = &s_format_ids[ind];
+
+    if (entry->fmt == fmt)
+      return entry->id;
+
+    if (!entry->fmt)
+      break;
+
+    ind = (ind + 1) & (LOG_MAX_FORMATS - 1);
+  }
+
+  // keep the table half empty, so lookups stay short
+  if (s_format_count >= LOG_MAX_FORMATS / 2)
+    return 0;
+
+  const size_t len = strlen(fmt);
+  if (len > UINT16_MAX)
+    return 0;
+
+  s_format_ids[ind] = (_log_format_id_t){ fmt, ++s_format_count };
+
+  const u8  tag = LOG_BINARY_FORMAT;
+  const u32 id  = s_format_count;
+  const u16 len16 = (u16)len;
+
+  fwrite(&tag, sizeof(tag), 1, s_binary);
+  fwrite(&id, sizeof(id), 1, s_binary);
+  fwrite(&len16, sizeof(len16), 1, s_binary);
+  fwrite(fmt, 1, len, s_binary);
+
+  return id;
+}
+
+/**
+ * @brief Writes the record to the binary log.
+ *
+ * @param msg The formatted message, or NULL if it's not formatted,
+ *            required if the record has no format.
+ */
+static void _binary_write(const _log_record_t *record, const char *msg)
+{
+  u32 id = record->fmt ? _binary_format_id(record->fmt) : 0;
+
+  const u8 *data = record->data;
+  u32 size = record->size;
+
+  // the message is written as text if it has no format or its format
+  // didn't fit
+  char formatted[LOG_MAX_MSG];
+  if (!id) {
+    if (!msg) {
+      _log_format(record->fmt, record->data, record->size, formatted);
+      msg = formatted;
+    }
+
+    data = (const u8*)msg;
+    size = strlen(msg) + 1;
+  }
+
+  const u8  tag   = LOG_BINARY_MESSAGE;
+  const u8  level = (u8)record->level;
+  const u16 size16 = (u16)(size < UINT16_MAX ? size : UINT16_MAX);
+
+  fwrite(&tag, sizeof(tag), 1, s_binary);
+  fwrite(&record->time, sizeof(record->time), 1, s_binary);
+  fwrite(&level, sizeof(level), 1, s_binary);
+  fwrite(&id, sizeof(id), 1, s_binary);
+  fwrite(&size16, sizeof(size16), 1, s_binary);
+  fwrite(data, 1, size16, s_binary);
+}
+
+/**
+ * @brief Writes the message right away, to the binary log as text too
+ *        if it's open.
+ *
+ * Should be called with the consume mutex locked.
+ */
+static void _write_sync_v(log_level_t level, const char *fmt, va_list args)
+{
+  if (!s_binary) {
+    _write_v(level, fmt, args);
+    return;
+  }
+
+  char buf[LOG_MAX_MSG];
+  char *msg = buf;
+
+  va_list copy;
+  va_copy(copy, args);
+  const i32 len = vsnprintf(buf, sizeof(buf), fmt, copy);
+  va_end(copy);
+
+  if (len < 0)
+    return;
+
+  // long messages are formatted again into a buffer that fits them
+  if ((size_t)len >= sizeof(buf)) {
+    msg = malloc((size_t)len + 1);
+    if (!msg) {
+      _write_v(level, fmt, args);
+      return;
+    }
+
+    vsnprintf(msg, (size_t)len + 1, fmt, args);
+  }
+
+  if (level >= LOG_LEVEL_WARN)
+    _write(level, "%s", msg);
+
+  const _log_record_t record = {
+    .time  = get_time_ns(),
+    .level = level,
+  };
+  _binary_write(&record, msg);
+
+  if (msg != buf)
+    free(msg);
+}
+
+static void _write_sync(log_level_t level, const char *fmt, ...)
+{
+  va_list valist;
+  va_start(valist, fmt);
+  _write_sync_v(level, fmt, valist);
+  va_end(valist);
+}
+
+/**
+ * @brief Writes all the queued records in the sequence order.
+ *
+ * Should be called with the consume mutex locked.
+ *
+ * @return Returns the number of written records.
+ */
+static u32 _drain(void)
+{
+  u32 written = 0;
+  char msg[LOG_MAX_MSG];
+
+  const u32 dropped = __atomic_exchange_n(&s_dropped, 0, __ATOMIC_ACQ_REL);
+  if (dropped)
+    _write_sync(LOG_LEVEL_WARN, "%u log messages dropped", dropped);
+
+  for (;;) {
+    _log_ring_t *next = NULL;
+    u64 next_seq = UINT64_MAX;
+
+    for (u32 i = 0; i < THREAD_MAX_SLOTS; ++i) {
+      _log_ring_t *ring = &s_rings[i];
+      const u64 head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+
+      if (head == LOAD(&ring->tail))
+        continue;
+
+      const u64 seq = ring->records[head & (LOG_RING_SIZE - 1)].seq;
+      if (seq < next_seq) {
+        next_seq = seq;
+        next = ring;
+      }
+    }
+
+    if (!next)
+      return written;
+
+    const u64 head = next->head;
+    const _log_record_t *record = &next->records[head & (LOG_RING_SIZE - 1)];
+
+    const i32 text = !s_binary || record->level >= LOG_LEVEL_WARN;
+
+    if (text) {
+      _log_format(record->fmt, record->data, record->size, msg);
+      _write((log_level_t)record->level, "%s", msg);
+    }
+
+    if (s_binary)
+      _binary_write(record, text ? msg : NULL);
+
+    __atomic_store_n(&next->head, head + 1, __ATOMIC_SEQ_CST);
+    ++written;
+  }
+}
+
+/**
+ * @brief Returns nonzero if there are records or dropped messages to
+ *        write.
+ */
+static i32 _pending(void)
+{
+  if (__atomic_load_n(&s_dropped, __ATOMIC_SEQ_CST))
+    return 1;
+
+  for (u32 i = 0; i < THREAD_MAX_SLOTS; ++i) {
+    const _log_ring_t *ring = &s_rings[i];
+
+    if (__atomic_load_n(&ring->head, __ATOMIC_SEQ_CST) !=
+        __atomic_load_n(&ring->tail, __ATOMIC_SEQ_CST))
+      return 1;
+  }
+
+  return 0;
+}
+
+static void *_logger_main(void *arg)
+{
+  (void)arg;
+
+  while (LOAD(&s_running)) {
+    pthread_mutex_lock(&s_consume_mutex);
+    const u32 written = _drain();
+    pthread_mutex_unlock(&s_consume_mutex);
+
+    if (written)
+      continue;
+
+    // NOTE: sleeping is set before the rings are checked, so a thread
+    //       queueing a record either sees it and wakes the logger up,
+    //       or the record is seen here
+    pthread_mutex_lock(&s_sleep_mutex);
+    __atomic_store_n(&s_sleeping, 1, __ATOMIC_SEQ_CST);
+
+    while (LOAD(&s_running) && !_pending())
+      pthread_cond_wait(&s_sleep_cond, &s_sleep_mutex);
+
+    __atomic_store_n(&s_sleeping, 0, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&s_sleep_mutex);
+  }
+
+  return NULL;
+}
+
+/**
+ * @brief Wakes the logger thread up if it's sleeping.
+ */
+static void _logger_wake(void)
+{
+  if (!__atomic_load_n(&s_sleeping, __ATOMIC_SEQ_CST))
+    return;
+
+  pthread_mutex_lock(&s_sleep_mutex);
+  pthread_cond_signal(&s_sleep_cond);
+  pthread_mutex_unlock(&s_sleep_mutex);
+}
+
+/**
+ * @brief Stops the logger thread and writes what's left.
+ */
+static void _logger_stop(void)
+{
+  pthread_mutex_lock(&s_sleep_mutex);
+  const i32 running = __atomic_exchange_n(&s_running, 0, __ATOMIC_SEQ_CST);
+  pthread_cond_signal(&s_sleep_cond);
+  pthread_mutex_unlock(&s_sleep_mutex);
+
+  if (running)
+    pthread_join(s_thread, NULL);
+
+  pthread_mutex_lock(&s_consume_mutex);
+  _drain();
+  pthread_mutex_unlock(&s_consume_mutex);
+
+  log_binary_close();
+}
+
+/**
+ * @brief Stops the logger thread and destroys the logger, messages
+ *        logged after it are written to stdout.
+ */
+static void _logger_close(void)
+{
+  _logger_stop();
+
+  pthread_mutex_lock(&s_consume_mutex);
+
+  if (s_logger) {
+    arch_logger_destroy(s_logger);
+    s_logger = NULL;
+  }
+
+  pthread_mutex_unlock(&s_consume_mutex);
+}
+
+// +------------------------------------------------------------------+
+// |                             api                                  |
+// +------------------------------------------------------------------+
 
 void _log_init(void)
 {
@@ -44,40 +443,170 @@ void _log_init(void)
   if (!s_logger)
     fatal("failed to create an Archivio logger instance");
 
+  // NOTE: messages are written synchronously if there is no thread
+  STORE(&s_running, 1);
+  if (pthread_create(&s_thread, NULL, _logger_main, NULL)) {
+    STORE(&s_running, 0);
+    error("failed to create logger thread, logging synchronously");
+  }
+
   trace("logger initialized");
 }
 
 void _log_quit(void)
 {
-  arch_logger_destroy(s_logger);
-  trace("log terminated"); 
+  trace("log terminated");
+  _logger_close();
 }
 
 void log_msg(log_level_t level, const char *msg, ...)
 {
   assert(msg, "passed msg is a null pointer");
 
+  // NOTE: fatal messages are never filtered
+  if (level < _log_level && level != LOG_LEVEL_FATAL)
+    return;
+
+  profile_begin("log_msg");
+
   va_list valist;
   va_start(valist, msg);
 
-  if (
-    !s_logger ||
-    !arch_logvl(s_logger, (arch_log_level_t)level, msg, valist)
-  )
-    goto SIMPLE_LOG;
+  if (!__atomic_load_n(&s_running, __ATOMIC_SEQ_CST))
+    goto SYNC_LOG;
+
+  // NOTE: threads past the slot limit write right away
+  const u32 slot = _thread_slot();
+  if (slot == THREAD_SLOT_NONE)
+    goto SYNC_LOG;
+
+  _log_ring_t *ring = &s_rings[slot];
+  const u64 tail = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+
+  // NOTE: the ring is full, less important messages are dropped, the
+  //       rest are written right away after the queued ones
+  if (tail - LOAD(&ring->head) == LOG_RING_SIZE) {
+    if (level < LOG_LEVEL_WARN) {
+      __atomic_add_fetch(&s_dropped, 1, __ATOMIC_SEQ_CST);
+      _logger_wake();
+      goto END;
+    }
+
+    goto SYNC_LOG;
+  }
+
+  _log_record_t *record = &ring->records[tail & (LOG_RING_SIZE - 1)];
+  record->time = get_time_ns();
+  record->level = level;
+  record->fmt = msg;
 
+  va_list args;
+  va_copy(args, valist);
+  const i32 captured = _log_args_capture(msg, args, record->data,
+                                         &record->size);
+  va_end(args);
+
+  // NOTE: arguments that don't fit the record are written right away,
+  //       so long messages aren't cut
+  if (!captured)
+    goto SYNC_LOG;
+
+  record->seq = __atomic_fetch_add(&s_seq, 1, __ATOMIC_RELAXED);
+  __atomic_store_n(&ring->tail, tail + 1, __ATOMIC_SEQ_CST);
+
+  // NOTE: the logger is woken up only when the ring gets its first
+  //       record, it drains the rest of them before sleeping again
+  if (__atomic_load_n(&ring->head, __ATOMIC_SEQ_CST) == tail)
+    _logger_wake();
+
+  // NOTE: the logger was stopped while the record was queued, it
+  //       might have missed the record, so it's written here
+  if (!__atomic_load_n(&s_running, __ATOMIC_SEQ_CST)) {
+    pthread_mutex_lock(&s_consume_mutex);
+    _drain();
+    pthread_mutex_unlock(&s_consume_mutex);
+  }
+
+  goto END;
+
+SYNC_LOG:
+  // queued messages are written first to keep the order
+  pthread_mutex_lock(&s_consume_mutex);
+  _drain();
+  _write_sync_v(level, msg, valist);
+  pthread_mutex_unlock(&s_consume_mutex);
+
+END:
   va_end(valist);
 
+  // everything logged before a fatal error is written before exit,
+  // other threads' messages go to stdout after the logger is closed
   if (level == LOG_LEVEL_FATAL)
-    arch_logger_destroy(s_logger);
+    _logger_close();
 
-  return;
+  profile_end();
+}
 
-SIMPLE_LOG:
-  ; // THIS SHOULD BE HERE!
-  // ignore error codes
-  vprintf(msg, valist);
-  puts("");
-  va_end(valist);
+void log_set_level(log_level_t level)
+{
+  __atomic_store_n(&_log_level, level, __ATOMIC_RELAXED);
+}
+
+log_level_t log_get_level(void)
+{
+  return __atomic_load_n(&_log_level, __ATOMIC_RELAXED);
 }
 
+i32 log_binary_open(const char *path)
+{
+  assert(path, "passed path is a null pointer");
+
+  FILE *fd = fopen(path, "wb");
+  if (!fd) {
+    error("failed to open \"%s\" binary log", path);
+    return 0;
+  }
+
+  struct timespec real;
+  clock_gettime(CLOCK_REALTIME, &real);
+
+  _log_binary_header_t header = {
+    .magic      = LOG_BINARY_MAGIC,
+    .version    = LOG_BINARY_VERSION,
+    .endian     = LOG_BINARY_ENDIAN,
+    .ptr_size   = sizeof(void*),
+    .ldbl_size  = sizeof(long double),
+    .start_time = get_time_ns(),
+    .start_real = (u64)real.tv_sec * 1000000000ull + (u64)real.tv_nsec,
+  };
+
+  if (fwrite(&header, sizeof(header), 1, fd) != 1) {
+    error("failed to write \"%s\" binary log header", path);
+    fclose(fd);
+    return 0;
+  }
+
+  log_binary_close();
+
+  pthread_mutex_lock(&s_consume_mutex);
+  s_binary = fd;
+  pthread_mutex_unlock(&s_consume_mutex);
+
+  info("binary log opened: %s", path);
+
+  return 1;
+}
+
+void log_binary_close(void)
+{
+  pthread_mutex_lock(&s_consume_mutex);
+
+  if (s_binary) {
+    fclose(s_binary);
+    s_binary = NULL;
+    memset(s_format_ids, 0, sizeof(s_format_ids));
+    s_format_count = 0;
+  }
+
+  pthread_mutex_unlock(&s_consume_mutex);
+}
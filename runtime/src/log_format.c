@@ -0,0 +1,328 @@
+/**
+ * @file log_format.c
+ * @brief The implementation of the deferred log formatting.
+ */
+#include <stdio.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "oe.h"
+#include "log_format.h"
+
+#define LOG_MAX_SPEC 32
+
+/**
+ * @brief Parsed printf conversion specification.
+ */
+typedef struct _log_spec {
+  u32  len;     // the number of format characters it takes
+  u32  stars;   // the number of '*' width and precision arguments
+  char length;  // 'H' for hh, 'h', 'l', 'L' for ll and long double,
+                // 'j', 'z', 't' or 0
+  char conv;
+} _log_spec_t;
+
+/**
+ * @brief Parses a conversion specification starting right after '%'.
+ */
+static void _spec_parse(const char *fmt, _log_spec_t *spec)
+{
+  const char *c = fmt;
+  *spec = (_log_spec_t){ 0 };
+
+  while (*c && strchr("-+ #0", *c))
+    ++c;
+
+  // width, then precision
+  for (i32 i = 0; i < 2; ++i) {
+    if (i == 1) {
+      if (*c != '.')
+        break;
+      ++c;
+    }
+
+    if (*c == '*') {
+      ++spec->stars;
+      ++c;
+      continue;
+    }
+
+    while (*c >= '0' && *c <= '9')
+      ++c;
+  }
+
+  if (*c == 'h' || *c == 'l') {
+    spec->length = *c++;
+
+    if (*c == spec->length) {
+      spec->length = spec->length == 'h' ? 'H' : 'L';
+      ++c;
+    }
+  } else if (*c && strchr("Ljzt", *c)) {
+    spec->length = *c++;
+  }
+
+  spec->conv = *c;
+  spec->len = (u32)(c - fmt) + (*c ? 1 : 0);
+}
+
+/**
+ * @brief Reserves space in the captured data.
+ *
+ * @return Returns a pointer to the space, or NULL if it doesn't fit.
+ */
+inline static u8 *_data_reserve(u8 *data, u32 *size, u32 count)
+{
+  if (*size + count > LOG_MAX_ARGS_SIZE)
+    return NULL;
+
+  u8 *ptr = data + *size;
+  *size += count;
+
+  return ptr;
+}
+
+#define PUT(type, val) \
+{ \
+  const type v = (val); \
+  u8 *ptr = _data_reserve(data, size, sizeof(type)); \
+  if (!ptr) return 0; \
+  memcpy(ptr, &v, sizeof(type)); \
+}
+
+i32 _log_args_capture(const char *fmt, va_list args, u8 *data,
+                      u32 *size)
+{
+  *size = 0;
+
+  for (const char *c = fmt; *c; ++c) {
+    if (*c != '%')
+      continue;
+
+    _log_spec_t spec;
+    _spec_parse(c + 1, &spec);
+
+    if (!spec.conv)
+      break;
+
+    c += spec.len;
+
+    for (u32 i = 0; i < spec.stars; ++i)
+      PUT(int, va_arg(args, int));
+
+    switch (spec.conv) {
+    case 'd':
+    case 'i':
+      switch (spec.length) {
+      case 'H': PUT(i64, (signed char)va_arg(args, int)); break;
+      case 'h': PUT(i64, (short)va_arg(args, int));       break;
+      case 'l': PUT(i64, va_arg(args, long));             break;
+      case 'L': PUT(i64, va_arg(args, long long));        break;
+      case 'j': PUT(i64, va_arg(args, intmax_t));         break;
+      case 'z': PUT(i64, va_arg(args, size_t));           break;
+      case 't': PUT(i64, va_arg(args, ptrdiff_t));        break;
+      default:  PUT(i64, va_arg(args, int));              break;
+      }
+      break;
+
+    case 'u':
+    case 'x':
+    case 'X':
+    case 'o':
+      switch (spec.length) {
+      case 'H': PUT(u64, (unsigned char)va_arg(args, unsigned)); break;
+      case 'h': PUT(u64, (unsigned short)va_arg(args, unsigned)); break;
+      case 'l': PUT(u64, va_arg(args, unsigned long));            break;
+      case 'L': PUT(u64, va_arg(args, unsigned long long));       break;
+      case 'j': PUT(u64, va_arg(args, uintmax_t));                break;
+      case 'z': PUT(u64, va_arg(args, size_t));                   break;
+      case 't': PUT(u64, va_arg(args, ptrdiff_t));                break;
+      default:  PUT(u64, va_arg(args, unsigned));                 break;
+      }
+      break;
+
+    case 'f':
+    case 'F':
+    case 'e':
+    case 'E':
+    case 'g':
+    case 'G':
+    case 'a':
+    case 'A':
+      if (spec.length == 'L')
+        PUT(long double, va_arg(args, long double))
+      else
+        PUT(f64, va_arg(args, double))
+      break;
+
+    case 'c':
+      PUT(int, va_arg(args, int));
+      break;
+
+    case 'p':
+      PUT(void*, va_arg(args, void*));
+      break;
+
+    case 's': {
+      // wide strings are formatted right away
+      if (spec.length == 'l')
+        return 0;
+
+      const char *str = va_arg(args, const char*);
+      if (!str) { str = "(null)"; }
+
+      const u32 len = strlen(str) + 1;
+      u8 *ptr = _data_reserve(data, size, len);
+      if (!ptr)
+        return 0;
+
+      memcpy(ptr, str, len);
+      break;
+    }
+
+    case '%':
+      break;
+
+    // NOTE: %n and unknown conversions can't be deferred
+    default:
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+#undef PUT
+
+// NOTE: the data might come from a corrupted file
+#define GET(type, var) \
+  type var; \
+  if (data + sizeof(type) > end) goto END; \
+  memcpy(&var, data, sizeof(type)); \
+  data += sizeof(type);
+
+void _log_format(const char *fmt, const u8 *data, u32 size, char *msg)
+{
+  const u8 *end = data + size;
+  u32 len = 0;
+
+  for (const char *c = fmt; *c && len < LOG_MAX_MSG - 1; ++c) {
+    if (*c != '%') {
+      msg[len++] = *c;
+      continue;
+    }
+
+    _log_spec_t spec;
+    _spec_parse(c + 1, &spec);
+
+    if (!spec.conv)
+      break;
+
+    // the spec is rebuilt with captured '*' values, and integers are
+    // always passed as 64 bit ones
+    char spec_fmt[LOG_MAX_SPEC];
+    u32 fmt_len = 0;
+
+    for (u32 i = 0; i <= spec.len && fmt_len < LOG_MAX_SPEC - 24; ++i) {
+      const char ch = c[i];
+
+      if (ch == '*') {
+        GET(int, star);
+        fmt_len += sprintf(spec_fmt + fmt_len, "%d", star);
+      } else if (i > 0 && i < spec.len && strchr("hlLjzt", ch)) {
+        continue;
+      } else {
+        spec_fmt[fmt_len++] = ch;
+      }
+    }
+    spec_fmt[fmt_len] = '\0';
+
+    c += spec.len;
+
+    char *out = msg + len;
+    const size_t rem = LOG_MAX_MSG - len;
+    int res = 0;
+
+    // 64 bit length modifier goes right before the conversion
+    if (strchr("diuxXo", spec.conv)) {
+      memmove(spec_fmt + fmt_len + 1, spec_fmt + fmt_len - 1, 2);
+      spec_fmt[fmt_len - 1] = 'l';
+      spec_fmt[fmt_len] = 'l';
+    }
+
+    switch (spec.conv) {
+    case 'd':
+    case 'i': {
+      GET(i64, v);
+      res = snprintf(out, rem, spec_fmt, (long long)v);
+      break;
+    }
+
+    case 'u':
+    case 'x':
+    case 'X':
+    case 'o': {
+      GET(u64, v);
+      res = snprintf(out, rem, spec_fmt, (unsigned long long)v);
+      break;
+    }
+
+    case 'f':
+    case 'F':
+    case 'e':
+    case 'E':
+    case 'g':
+    case 'G':
+    case 'a':
+    case 'A':
+      if (spec.length == 'L') {
+        spec_fmt[fmt_len - 1] = 'L';
+        spec_fmt[fmt_len] = spec.conv;
+        spec_fmt[fmt_len + 1] = '\0';
+
+        GET(long double, v);
+        res = snprintf(out, rem, spec_fmt, v);
+      } else {
+        GET(f64, v);
+        res = snprintf(out, rem, spec_fmt, v);
+      }
+      break;
+
+    case 'c': {
+      GET(int, v);
+      res = snprintf(out, rem, spec_fmt, v);
+      break;
+    }
+
+    case 'p': {
+      GET(void*, v);
+      res = snprintf(out, rem, spec_fmt, v);
+      break;
+    }
+
+    case 's': {
+      const u8 *term = memchr(data, '\0', end - data);
+      if (!term)
+        goto END;
+
+      const char *v = (const char*)data;
+      data = term + 1;
+      res = snprintf(out, rem, spec_fmt, v);
+      break;
+    }
+
+    case '%':
+      msg[len++] = '%';
+      break;
+    }
+
+    if (res > 0)
+      len += (u32)res < rem ? (u32)res : rem - 1;
+  }
+
+END:
+  msg[len] = '\0';
+}
+
+#undef GET
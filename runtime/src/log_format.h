@@ -0,0 +1,71 @@
+/**
+ * @file log_format.h
+ * @brief The header of the deferred log formatting.
+ *
+ * Arguments of a log message are captured into a byte buffer and
+ * formatted later, possibly by another program reading a binary log.
+ * Integers are widened to 64 bits, strings are copied with their
+ * terminators.
+ */
+#pragma once
+
+#include <stdarg.h>
+
+#include "oe.h"
+
+#define LOG_MAX_ARGS_SIZE 224
+#define LOG_MAX_MSG       1024
+
+#define LOG_BINARY_MAGIC   "OEBINLOG"
+#define LOG_BINARY_VERSION 1
+#define LOG_BINARY_ENDIAN  0x01020304
+
+/**
+ * @brief The header of a binary log file.
+ *
+ * The header is followed by records, every record starts with a tag
+ * byte, fields are written without padding in the host byte order:
+ * - LOG_BINARY_FORMAT:  u32 id, u16 length, format characters;
+ * - LOG_BINARY_MESSAGE: u64 time, u8 level, u32 format id, u16 size,
+ *                       captured arguments.
+ *
+ * A format is written before the first message using it. Message with
+ * format id 0 keeps the formatted text instead of arguments.
+ */
+typedef struct _log_binary_header {
+  char magic[8];
+  u32  version;
+  u32  endian;    // LOG_BINARY_ENDIAN as written by the host
+  u8   ptr_size;  // captured pointers and long doubles have the host
+  u8   ldbl_size; // sizes, so they're checked on decoding
+  u8   reserved[6];
+  u64  start_time; // get_time_ns() when the file was opened
+  u64  start_real; // ns since the epoch when the file was opened
+} _log_binary_header_t;
+
+enum {
+  LOG_BINARY_FORMAT  = 1,
+  LOG_BINARY_MESSAGE = 2,
+};
+
+/**
+ * @brief Captures arguments of a printf format.
+ *
+ * @param data A buffer of LOG_MAX_ARGS_SIZE bytes.
+ * @param size Receives the number of captured bytes.
+ *
+ * @return Returns 1 on success, or 0 if the arguments don't fit or
+ *         the format can't be deferred, e.g. it has %n or %ls.
+ */
+extern i32 _log_args_capture(const char *fmt, va_list args, u8 *data,
+                             u32 *size);
+
+/**
+ * @brief Formats captured arguments.
+ *
+ * Formatting stops at the first argument that's out of the data.
+ *
+ * @param msg A buffer of LOG_MAX_MSG bytes, receives the message.
+ */
+extern void _log_format(const char *fmt, const u8 *data, u32 size,
+                        char *msg);
@@ -1,14 +1,158 @@
+/**
+ * @file math.c
+ * @brief The implementation of the oe batch math.
+ *
+ * Points are processed two per 128 bit register, as x0 y0 x1 y1, and
+ * rectangles one per register. The scalar tails and the fallback use
+ * the inline functions from oe_math.h.
+ */
 #include "oe.h"
 
-vec2_t vec2_add(vec2_t v1, vec2_t v2) {
-  v1.x += v2.x;
-  v1.y += v2.y;
-  return v1;
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define MATH_SSE2
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define MATH_NEON
+#endif
+
+void vec2_transform_batch(const mat3_t *m, const vec2_t *src,
+                          vec2_t *dst, u32 count)
+{
+  assert(m, "passed matrix is a null pointer");
+  assert(src || !count, "passed points are a null pointer");
+  assert(dst || !count, "passed destination is a null pointer");
+
+  u32 i = 0;
+
+#if defined(MATH_SSE2)
+  // x' = a * x + b * y + tx, y' = c * x + d * y + ty for both points
+  const __m128 ac = _mm_setr_ps(m->m[0][0], m->m[1][0],
+                                m->m[0][0], m->m[1][0]);
+  const __m128 bd = _mm_setr_ps(m->m[0][1], m->m[1][1],
+                                m->m[0][1], m->m[1][1]);
+  const __m128 t  = _mm_setr_ps(m->m[0][2], m->m[1][2],
+                                m->m[0][2], m->m[1][2]);
+
+  for (; i + 2 <= count; i += 2) {
+    const __m128 p  = _mm_loadu_ps(&src[i].x);
+    const __m128 xx = _mm_shuffle_ps(p, p, _MM_SHUFFLE(2, 2, 0, 0));
+    const __m128 yy = _mm_shuffle_ps(p, p, _MM_SHUFFLE(3, 3, 1, 1));
+
+    const __m128 res = _mm_add_ps(
+      _mm_add_ps(_mm_mul_ps(ac, xx), _mm_mul_ps(bd, yy)), t
+    );
+    _mm_storeu_ps(&dst[i].x, res);
+  }
+#elif defined(MATH_NEON)
+  const float32x2_t ac = { m->m[0][0], m->m[1][0] };
+  const float32x2_t bd = { m->m[0][1], m->m[1][1] };
+  const float32x4_t ac2 = vcombine_f32(ac, ac);
+  const float32x4_t bd2 = vcombine_f32(bd, bd);
+  const float32x2_t t = { m->m[0][2], m->m[1][2] };
+  const float32x4_t t2 = vcombine_f32(t, t);
+
+  for (; i + 2 <= count; i += 2) {
+    const float32x4_t p = vld1q_f32(&src[i].x);
+    const float32x4_t xx = vtrn1q_f32(p, p);
+    const float32x4_t yy = vtrn2q_f32(p, p);
+
+    vst1q_f32(&dst[i].x, vmlaq_f32(vmlaq_f32(t2, ac2, xx), bd2, yy));
+  }
+#endif
+
+  for (; i < count; ++i)
+    dst[i] = mat3_transform(*m, src[i]);
 }
 
-vec2_t vec2_sub(vec2_t v1, vec2_t v2) {
-  v1.x -= v2.x;
-  v1.y -= v2.y;
-  return v1;
+void vec2_madd_batch(vec2_t *pos, const vec2_t *vel, f32 t, u32 count)
+{
+  assert(pos || !count, "passed positions are a null pointer");
+  assert(vel || !count, "passed velocities are a null pointer");
+
+  u32 i = 0;
+
+#if defined(MATH_SSE2)
+  const __m128 tt = _mm_set1_ps(t);
+
+  for (; i + 2 <= count; i += 2) {
+    const __m128 p = _mm_loadu_ps(&pos[i].x);
+    const __m128 v = _mm_loadu_ps(&vel[i].x);
+    _mm_storeu_ps(&pos[i].x, _mm_add_ps(p, _mm_mul_ps(v, tt)));
+  }
+#elif defined(MATH_NEON)
+  for (; i + 2 <= count; i += 2) {
+    const float32x4_t p = vld1q_f32(&pos[i].x);
+    const float32x4_t v = vld1q_f32(&vel[i].x);
+    vst1q_f32(&pos[i].x, vmlaq_n_f32(p, v, t));
+  }
+#endif
+
+  for (; i < count; ++i)
+    pos[i] = vec2_add(pos[i], vec2_scale(vel[i], t));
 }
 
+void rect_transform_batch(const mat3_t *m, const rect_t *src,
+                          rect_t *dst, u32 count)
+{
+  assert(m, "passed matrix is a null pointer");
+  assert(src || !count, "passed rectangles are a null pointer");
+  assert(dst || !count, "passed destination is a null pointer");
+
+  // the center is transformed as a point, and the half size by the
+  // absolute values of the linear part, which gives the bounding
+  // rectangle of the transformed corners
+  const f32 a = m->m[0][0], b = m->m[0][1];
+  const f32 c = m->m[1][0], d = m->m[1][1];
+  const f32 tx = m->m[0][2], ty = m->m[1][2];
+
+  u32 i = 0;
+
+#if defined(MATH_SSE2)
+  // lanes are center x, center y, half width, half height
+  const __m128 half = _mm_set1_ps(0.5f);
+  const __m128 pos_mask = _mm_castsi128_ps(_mm_setr_epi32(-1, -1, 0, 0));
+  const __m128 ac = _mm_setr_ps(a, c, fabsf(a), fabsf(c));
+  const __m128 bd = _mm_setr_ps(b, d, fabsf(b), fabsf(d));
+  const __m128 t  = _mm_setr_ps(tx, ty, 0.0f, 0.0f);
+
+  for (; i < count; ++i) {
+    const __m128 r = _mm_loadu_ps(&src[i].x);
+
+    const __m128 hs = _mm_mul_ps(
+      _mm_shuffle_ps(r, r, _MM_SHUFFLE(3, 2, 3, 2)), half
+    );
+    const __m128 ch = _mm_add_ps(hs, _mm_and_ps(r, pos_mask));
+
+    const __m128 xx = _mm_shuffle_ps(ch, ch, _MM_SHUFFLE(2, 2, 0, 0));
+    const __m128 yy = _mm_shuffle_ps(ch, ch, _MM_SHUFFLE(3, 3, 1, 1));
+
+    const __m128 res = _mm_add_ps(
+      _mm_add_ps(_mm_mul_ps(ac, xx), _mm_mul_ps(bd, yy)), t
+    );
+
+    // center - half size, half size * 2
+    const __m128 hh = _mm_shuffle_ps(res, res, _MM_SHUFFLE(3, 2, 3, 2));
+    const __m128 pos = _mm_sub_ps(res, hh);
+    const __m128 size = _mm_add_ps(hh, hh);
+
+    _mm_storeu_ps(&dst[i].x, _mm_shuffle_ps(pos, size,
+                                            _MM_SHUFFLE(1, 0, 1, 0)));
+  }
+#endif
+
+  for (; i < count; ++i) {
+    const rect_t r = src[i];
+    const f32 hw = r.width * 0.5f;
+    const f32 hh = r.height * 0.5f;
+    const f32 cx = r.x + hw;
+    const f32 cy = r.y + hh;
+
+    const f32 x = a * cx + b * cy + tx;
+    const f32 y = c * cx + d * cy + ty;
+    const f32 w = fabsf(a) * hw + fabsf(b) * hh;
+    const f32 h = fabsf(c) * hw + fabsf(d) * hh;
+
+    dst[i] = (rect_t){ x - w, y - h, w * 2.0f, h * 2.0f };
+  }
+}
@@ -0,0 +1,198 @@
+/**
+ * @file profile.c
+ * @brief The implementation of the oe cpu profiler.
+ *
+ * Every thread writes closed scopes into its own ring buffer, indexed
+ * by its thread slot, so recording never takes a lock. A buffer is
+ * allocated on the first scope of the thread, the ring keeps the
+ * latest events.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "oe.h"
+#include "internal.h"
+
+#define PROFILE_MAX_EVENTS 16384 // per thread, must be a power of two
+#define PROFILE_MAX_DEPTH  32
+
+typedef struct _profile_event {
+  const char *name;
+  u64         start; // ns
+  u64         duration;
+} _profile_event_t;
+
+typedef struct _profile_buf {
+  u64              count; // the number of events ever written
+  u32              job_thread; // job_thread_ind() of the owner
+  u32              depth;
+  const char      *names[PROFILE_MAX_DEPTH];
+  u64              starts[PROFILE_MAX_DEPTH];
+  _profile_event_t events[PROFILE_MAX_EVENTS];
+} _profile_buf_t;
+
+static _profile_buf_t *s_bufs[THREAD_MAX_SLOTS];
+static u64 s_epoch;
+
+static __thread i32 t_failed;
+
+static _profile_buf_t *_buf_get(void)
+{
+  // NOTE: threads past the slot limit aren't profiled
+  const u32 slot = _thread_slot();
+  if (slot == THREAD_SLOT_NONE)
+    return NULL;
+
+  _profile_buf_t *buf = __atomic_load_n(&s_bufs[slot],
+                                        __ATOMIC_ACQUIRE);
+  if (buf)
+    return buf;
+
+  // NOTE: logging here would open another scope, so a thread which
+  //       failed to allocate the buffer is silently not profiled
+  if (t_failed)
+    return NULL;
+
+  buf = calloc(1, sizeof(_profile_buf_t));
+  if (!buf) {
+    t_failed = 1;
+    return NULL;
+  }
+
+  u64 zero = 0;
+  __atomic_compare_exchange_n(&s_epoch, &zero, get_time_ns(), 0,
+                              __ATOMIC_ACQ_REL, __ATOMIC_RELAXED);
+
+  __atomic_store_n(&s_bufs[slot], buf, __ATOMIC_RELEASE);
+
+  return buf;
+}
+
+void profile_scope_begin(const char *name)
+{
+  _profile_buf_t *buf = _buf_get();
+  if (!buf)
+    return;
+
+  // NOTE: the main thread gets its job index after the first scopes
+  if (!buf->depth)
+    __atomic_store_n(&buf->job_thread, job_thread_ind(), __ATOMIC_RELAXED);
+
+  // scopes nested too deep are counted, but not recorded
+  if (buf->depth < PROFILE_MAX_DEPTH) {
+    buf->names[buf->depth] = name;
+    buf->starts[buf->depth] = get_time_ns();
+  }
+
+  ++buf->depth;
+}
+
+void profile_scope_end(void)
+{
+  _profile_buf_t *buf = _buf_get();
+  if (!buf || !buf->depth)
+    return;
+
+  --buf->depth;
+
+  if (buf->depth >= PROFILE_MAX_DEPTH)
+    return;
+
+  const u64 count = __atomic_load_n(&buf->count, __ATOMIC_RELAXED);
+
+  buf->events[count & (PROFILE_MAX_EVENTS - 1)] = (_profile_event_t){
+    .name     = buf->names[buf->depth],
+    .start    = buf->starts[buf->depth],
+    .duration = get_time_ns() - buf->starts[buf->depth],
+  };
+
+  __atomic_store_n(&buf->count, count + 1, __ATOMIC_RELEASE);
+}
+
+static void _name_write(FILE *fd, const char *name)
+{
+  fputc('"', fd);
+
+  for (const char *c = name; *c; ++c) {
+    if (*c == '"' || *c == '\\')
+      fputc('\\', fd);
+
+    // control characters aren't allowed in json strings
+    if ((unsigned char)*c >= 0x20)
+      fputc(*c, fd);
+  }
+
+  fputc('"', fd);
+}
+
+i32 profile_dump(const char *path)
+{
+  assert(path, "passed path is a null pointer");
+
+  FILE *fd = fopen(path, "w");
+  if (!fd) {
+    error("failed to open \"%s\" to write profile", path);
+    return 0;
+  }
+
+  const u64 epoch = __atomic_load_n(&s_epoch, __ATOMIC_ACQUIRE);
+  u64 total = 0;
+
+  // NOTE: chrome trace format, perfetto opens it as well
+  fprintf(fd, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+
+  const char *separator = "\n";
+
+  for (u32 i = 0; i < THREAD_MAX_SLOTS; ++i) {
+    const _profile_buf_t *buf = __atomic_load_n(&s_bufs[i],
+                                                __ATOMIC_ACQUIRE);
+    if (!buf)
+      continue;
+
+    // job threads keep their job indices, other threads are numbered
+    // by the slot
+    const u32 job_thread = __atomic_load_n(&buf->job_thread,
+                                           __ATOMIC_RELAXED);
+    const i32 job = job_thread != JOB_THREAD_NONE;
+    const char *name = !job ? "thread" : job_thread ? "worker" : "main";
+
+    fprintf(fd,
+            "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+            "\"tid\":%u,\"args\":{\"name\":\"%s %u\"}}",
+            separator, i, name, job ? job_thread : i);
+    separator = ",\n";
+
+    const u64 count = __atomic_load_n(&buf->count, __ATOMIC_ACQUIRE);
+    const u64 first = count > PROFILE_MAX_EVENTS ?
+                      count - PROFILE_MAX_EVENTS : 0;
+
+    for (u64 j = first; j < count; ++j) {
+      const _profile_event_t *event =
+        &buf->events[j & (PROFILE_MAX_EVENTS - 1)];
+
+      fprintf(fd, "%s{\"name\":", separator);
+      _name_write(fd, event->name);
+      fprintf(fd, ",\"ph\":\"X\",\"pid\":1,\"tid\":%u,"
+                  "\"ts\":%.3f,\"dur\":%.3f}",
+              i, (event->start - epoch) / 1000.0,
+              event->duration / 1000.0);
+    }
+
+    total += count - first;
+  }
+
+  fprintf(fd, "\n]}\n");
+
+  const i32 failed = ferror(fd);
+  fclose(fd);
+
+  if (failed) {
+    error("failed to write profile to \"%s\"", path);
+    return 0;
+  }
+
+  info("profile dumped to %s: %llu events", path,
+       (unsigned long long)total);
+
+  return 1;
+}
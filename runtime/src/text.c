@@ -0,0 +1,532 @@
+/**
+ * @file text.c
+ * @brief The implementation of the oe bitmap text.
+ *
+ * Glyphs are kept sorted by their code points. The first
+ * FONT_LOOKUP_SIZE code points are mapped to glyphs by a table, so
+ * the common text never searches. Kerning pairs are sorted by the
+ * pair key, and only glyphs which start any pair look them up.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "oe.h"
+#include "internal.h"
+
+#define FONT_LOOKUP_SIZE 256
+#define FONT_MAX_PATH    256
+
+typedef struct _glyph {
+  u32    id;      // the code point
+  rect_t src;     // the rectangle on the page
+  vec2_t offset;  // from the pen position to the top left corner
+  f32    advance;
+  i32    kerned;  // whether the glyph starts any kerning pair
+} _glyph_t;
+
+typedef struct _kerning {
+  u64 key;        // the first code point in the high half
+  f32 amount;
+} _kerning_t;
+
+struct font {
+  texture_t   texture;
+  u32         tex_ind;
+  f32         line_height;
+  u32         glyph_count;
+  _glyph_t   *glyphs;
+  u32         kerning_count;
+  _kerning_t *kernings;
+  u16         lookup[FONT_LOOKUP_SIZE]; // glyph index + 1, 0 if none
+};
+
+/**
+ * @brief Glyph layout state, yields sprites of the text one by one.
+ */
+typedef struct _pen {
+  const struct font *font;
+  const u8          *text;
+  vec2_t             origin;
+  vec2_t             pos;
+  f32                scale;
+  const _glyph_t    *prev;
+} _pen_t;
+
+// +------------------------------------------------------------------+
+// |                            parsing                               |
+// +------------------------------------------------------------------+
+
+/**
+ * @brief Returns the value of the key=value attribute of the line,
+ *        or NULL if there is none.
+ */
+static const char *_attr_find(const char *line, const char *key)
+{
+  const size_t len = strlen(key);
+
+  for (const char *p = strchr(line, ' '); p; p = strchr(p + 1, ' ')) {
+    if (!strncmp(p + 1, key, len) && p[len + 1] == '=')
+      return p + len + 2;
+  }
+
+  return NULL;
+}
+
+static i32 _attr_int(const char *line, const char *key, i32 def)
+{
+  const char *val = _attr_find(line, key);
+  return val ? (i32)strtol(val, NULL, 10) : def;
+}
+
+static i32 _attr_str(const char *line, const char *key, char *dst,
+                     size_t size)
+{
+  const char *val = _attr_find(line, key);
+  if (!val)
+    return 0;
+
+  const i32 quoted = *val == '"';
+  if (quoted)
+    ++val;
+
+  size_t len = 0;
+  while (
+    val[len] && (quoted ? val[len] != '"' : val[len] != ' ') &&
+    len + 1 < size
+  ) {
+    dst[len] = val[len];
+    ++len;
+  }
+
+  dst[len] = '\0';
+
+  return 1;
+}
+
+static i32 _line_is(const char *line, const char *tag)
+{
+  const size_t len = strlen(tag);
+  return !strncmp(line, tag, len) && (line[len] == ' ' || !line[len]);
+}
+
+static int _glyph_cmp(const void *a, const void *b)
+{
+  const u32 x = ((const _glyph_t*)a)->id;
+  const u32 y = ((const _glyph_t*)b)->id;
+  return (x > y) - (x < y);
+}
+
+static int _kerning_cmp(const void *a, const void *b)
+{
+  const u64 x = ((const _kerning_t*)a)->key;
+  const u64 y = ((const _kerning_t*)b)->key;
+  return (x > y) - (x < y);
+}
+
+inline static u64 _kerning_key(u32 first, u32 second)
+{
+  return (u64)first << 32 | second;
+}
+
+/**
+ * @brief Reads the whole file into a null terminated buffer.
+ */
+static char *_file_read(const char *path)
+{
+  FILE *fd = fopen(path, "rb");
+  if (!fd)
+    return NULL;
+
+  fseek(fd, 0, SEEK_END);
+  const long size = ftell(fd);
+  fseek(fd, 0, SEEK_SET);
+
+  char *data = size >= 0 ? malloc(size + 1) : NULL;
+  if (!data || fread(data, 1, size, fd) != (size_t)size) {
+    free(data);
+    fclose(fd);
+    return NULL;
+  }
+
+  fclose(fd);
+  data[size] = '\0';
+
+  return data;
+}
+
+/**
+ * @brief Parses the description, the page file name is written to
+ *        page.
+ *
+ * @return Returns 1 on success, otherwise returns 0.
+ */
+static i32 _font_parse(struct font *font, char *data, char *page,
+                       size_t page_size)
+{
+  u32 glyph_cap = 0;
+  u32 kerning_cap = 0;
+  i32 page_found = 0;
+
+  for (char *line = data; line && *line;) {
+    char *next = strchr(line, '\n');
+    if (next)
+      *next++ = '\0';
+
+    // NOTE: files saved on windows end lines with "\r\n"
+    char *cr = strchr(line, '\r');
+    if (cr)
+      *cr = '\0';
+
+    if (_line_is(line, "common")) {
+      font->line_height = (f32)_attr_int(line, "lineHeight", 0);
+
+      if (_attr_int(line, "pages", 1) != 1) {
+        error("fonts with several pages aren't supported");
+        return 0;
+      }
+    } else if (_line_is(line, "page")) {
+      page_found = _attr_str(line, "file", page, page_size);
+    } else if (_line_is(line, "char")) {
+      if (font->glyph_count == glyph_cap) {
+        glyph_cap = glyph_cap ? glyph_cap * 2 : 128;
+        _glyph_t *glyphs = realloc(font->glyphs,
+                                   glyph_cap * sizeof(_glyph_t));
+        if (!glyphs)
+          return 0;
+        font->glyphs = glyphs;
+      }
+
+      font->glyphs[font->glyph_count++] = (_glyph_t){
+        .id = (u32)_attr_int(line, "id", 0),
+        .src = {
+          (f32)_attr_int(line, "x", 0),
+          (f32)_attr_int(line, "y", 0),
+          (f32)_attr_int(line, "width", 0),
+          (f32)_attr_int(line, "height", 0),
+        },
+        .offset = {
+          (f32)_attr_int(line, "xoffset", 0),
+          (f32)_attr_int(line, "yoffset", 0),
+        },
+        .advance = (f32)_attr_int(line, "xadvance", 0),
+      };
+    } else if (_line_is(line, "kerning")) {
+      if (font->kerning_count == kerning_cap) {
+        kerning_cap = kerning_cap ? kerning_cap * 2 : 128;
+        _kerning_t *kernings = realloc(font->kernings,
+                                       kerning_cap * sizeof(_kerning_t));
+        if (!kernings)
+          return 0;
+        font->kernings = kernings;
+      }
+
+      font->kernings[font->kerning_count++] = (_kerning_t){
+        .key = _kerning_key((u32)_attr_int(line, "first", 0),
+                            (u32)_attr_int(line, "second", 0)),
+        .amount = (f32)_attr_int(line, "amount", 0),
+      };
+    }
+
+    line = next;
+  }
+
+  if (!page_found) {
+    error("font has no page");
+    return 0;
+  }
+
+  return 1;
+}
+
+// +------------------------------------------------------------------+
+// |                            lookup                                |
+// +------------------------------------------------------------------+
+
+static const _glyph_t *_glyph_find(const struct font *font, u32 id)
+{
+  if (id < FONT_LOOKUP_SIZE) {
+    const u16 ind = font->lookup[id];
+    return ind ? &font->glyphs[ind - 1] : NULL;
+  }
+
+  const _glyph_t key = { .id = id };
+  return bsearch(&key, font->glyphs, font->glyph_count, sizeof(_glyph_t),
+                 _glyph_cmp);
+}
+
+static f32 _kerning_find(const struct font *font, const _glyph_t *first,
+                         const _glyph_t *second)
+{
+  if (!first || !first->kerned)
+    return 0.0f;
+
+  const _kerning_t key = { .key = _kerning_key(first->id, second->id) };
+  const _kerning_t *kerning = bsearch(&key, font->kernings,
+                                      font->kerning_count,
+                                      sizeof(_kerning_t), _kerning_cmp);
+
+  return kerning ? kerning->amount : 0.0f;
+}
+
+/**
+ * @brief Decodes the next UTF-8 code point and advances the text,
+ *        invalid sequences decode as U+FFFD.
+ */
+static u32 _utf8_next(const u8 **text)
+{
+  const u8 *s = *text;
+  const u8 c = *s++;
+
+  u32 cp;
+  u32 count;
+
+  if (c < 0x80)      { cp = c;        count = 0; }
+  else if (c < 0xc0) { *text = s; return 0xfffd; }
+  else if (c < 0xe0) { cp = c & 0x1f; count = 1; }
+  else if (c < 0xf0) { cp = c & 0x0f; count = 2; }
+  else if (c < 0xf8) { cp = c & 0x07; count = 3; }
+  else               { *text = s; return 0xfffd; }
+
+  for (u32 i = 0; i < count; ++i) {
+    if ((*s & 0xc0) != 0x80) {
+      *text = s;
+      return 0xfffd;
+    }
+    cp = cp << 6 | (*s++ & 0x3f);
+  }
+
+  *text = s;
+  return cp;
+}
+
+// +------------------------------------------------------------------+
+// |                            layout                                |
+// +------------------------------------------------------------------+
+
+inline static _pen_t _pen_init(const struct font *font, vec2_t pos,
+                               const char *text, f32 scale)
+{
+  return (_pen_t){
+    .font   = font,
+    .text   = (const u8*)text,
+    .origin = pos,
+    .pos    = pos,
+    .scale  = scale,
+    .prev   = NULL,
+  };
+}
+
+/**
+ * @brief Advances the pen to the next visible glyph.
+ *
+ * @param dst Receives the glyph rectangle on the screen.
+ *
+ * @return Returns the glyph, or NULL at the end of the text.
+ */
+static const _glyph_t *_pen_next(_pen_t *pen, rect_t *dst)
+{
+  while (*pen->text) {
+    const u32 cp = _utf8_next(&pen->text);
+
+    if (cp == '\n') {
+      pen->pos.x = pen->origin.x;
+      pen->pos.y += pen->font->line_height * pen->scale;
+      pen->prev = NULL;
+      continue;
+    }
+
+    const _glyph_t *glyph = _glyph_find(pen->font, cp);
+    if (!glyph)
+      continue;
+
+    pen->pos.x += _kerning_find(pen->font, pen->prev, glyph) * pen->scale;
+    pen->prev = glyph;
+
+    const vec2_t pos = pen->pos;
+    pen->pos.x += glyph->advance * pen->scale;
+
+    // spaces only move the pen
+    if (glyph->src.width <= 0.0f || glyph->src.height <= 0.0f)
+      continue;
+
+    *dst = (rect_t){
+      pos.x + glyph->offset.x * pen->scale,
+      pos.y + glyph->offset.y * pen->scale,
+      glyph->src.width * pen->scale,
+      glyph->src.height * pen->scale,
+    };
+
+    return glyph;
+  }
+
+  return NULL;
+}
+
+// +------------------------------------------------------------------+
+// |                             api                                  |
+// +------------------------------------------------------------------+
+
+font_t font_load(const char *path)
+{
+  assert(path, "passed path is a null pointer");
+
+  profile_begin("font_load");
+
+  char *data = _file_read(path);
+  if (!data) {
+    error("failed to read \"%s\" font", path);
+    profile_end();
+    return NULL;
+  }
+
+  struct font *font = calloc(1, sizeof(struct font));
+  char page[FONT_MAX_PATH];
+
+  if (!font || !_font_parse(font, data, page, sizeof(page))) {
+    error("failed to parse \"%s\" font", path);
+    free(data);
+    font_free(font);
+    profile_end();
+    return NULL;
+  }
+
+  free(data);
+
+  qsort(font->glyphs, font->glyph_count, sizeof(_glyph_t), _glyph_cmp);
+  qsort(font->kernings, font->kerning_count, sizeof(_kerning_t),
+        _kerning_cmp);
+
+  for (u32 i = 0; i < font->glyph_count; ++i) {
+    if (font->glyphs[i].id < FONT_LOOKUP_SIZE)
+      font->lookup[font->glyphs[i].id] = (u16)(i + 1);
+  }
+
+  // glyphs starting kerning pairs are marked, so the others don't
+  // search the pairs at all
+  for (u32 i = 0; i < font->kerning_count; ++i) {
+    _glyph_t *glyph = (_glyph_t*)_glyph_find(
+      font, (u32)(font->kernings[i].key >> 32));
+    if (glyph)
+      glyph->kerned = 1;
+  }
+
+  // the page path is relative to the description
+  char page_path[FONT_MAX_PATH];
+  const char *slash = strrchr(path, '/');
+  const int dir_len = slash ? (int)(slash - path + 1) : 0;
+
+  const int len = snprintf(page_path, sizeof(page_path), "%.*s%s",
+                           dir_len, path, page);
+  if (len < 0 || (size_t)len >= sizeof(page_path)) {
+    error("font page path is too long: %.*s%s", dir_len, path, page);
+    font_free(font);
+    profile_end();
+    return NULL;
+  }
+
+  const texture_params_t params = { .wrap = TEXTURE_WRAP_CLAMP };
+  font->texture = texture_load_ext(page_path, params);
+
+  if (!font->texture) {
+    font_free(font);
+    profile_end();
+    return NULL;
+  }
+
+  info("loaded font: %s, %u glyphs, %u kerning pairs", path,
+       font->glyph_count, font->kerning_count);
+
+  profile_end();
+
+  return font;
+}
+
+void font_free(font_t font)
+{
+  if (!font)
+    return;
+
+  if (font->texture)
+    texture_free(font->texture);
+
+  free(font->glyphs);
+  free(font->kernings);
+  free(font);
+}
+
+void font_bind(font_t font, u32 ind)
+{
+  assert(font, "passed font is a null pointer");
+
+  texture_bind(font->texture, ind);
+  font->tex_ind = ind;
+}
+
+f32 font_line_height(font_t font)
+{
+  assert(font, "passed font is a null pointer");
+
+  return font->line_height;
+}
+
+vec2_t text_measure(font_t font, const char *text, f32 scale)
+{
+  assert(font, "passed font is a null pointer");
+  assert(text, "passed text is a null pointer");
+
+  _pen_t pen = _pen_init(font, (vec2_t){ 0.0f, 0.0f }, text, scale);
+  vec2_t size = { 0.0f, font->line_height * scale };
+
+  // the width counts advances, so trailing spaces take their place
+  while (*pen.text) {
+    rect_t dst;
+    _pen_next(&pen, &dst);
+
+    if (pen.pos.x > size.x)
+      size.x = pen.pos.x;
+  }
+
+  size.y = pen.pos.y + font->line_height * scale;
+
+  return size;
+}
+
+void draw_text(font_t font, vec2_t pos, const char *text, color_t color)
+{
+  draw_text_ext(font, pos, text, 1.0f, color, 0.0f);
+}
+
+void draw_text_ext(font_t font, vec2_t pos, const char *text, f32 scale,
+                   color_t color, f32 depth)
+{
+  assert(font, "passed font is a null pointer");
+  assert(text, "passed text is a null pointer");
+
+  // the first pass counts the sprites, so they are reserved at once
+  _pen_t pen = _pen_init(font, pos, text, scale);
+  rect_t dst;
+  u32 count = 0;
+
+  while (_pen_next(&pen, &dst))
+    ++count;
+
+  pen = _pen_init(font, pos, text, scale);
+
+  while (count) {
+    u32 reserved;
+    _vert_t *verts = _sprites_reserve(count, &reserved);
+
+    assert(verts, "verts number exceeds the limit");
+    if (!verts)
+      return;
+
+    for (u32 i = 0; i < reserved; ++i) {
+      const _glyph_t *glyph = _pen_next(&pen, &dst);
+      _sprite_write(verts + i * 4, dst, glyph->src, font->tex_ind, color,
+                    depth);
+    }
+
+    count -= reserved;
+  }
+}
@@ -1,9 +1,162 @@
-#include <sys/time.h>
+/**
+ * @file utils.c
+ * @brief The implementation of the oe utility functions.
+ */
+#define _POSIX_C_SOURCE 199309L
 
-extern double get_time(void) {
-  struct timeval t;
-  gettimeofday(&t, NULL);
+#include <time.h>
+#include <string.h>
+#include <stdlib.h>
 
-  return t.tv_sec * 1000.0 + // sec to ms
-         t.tv_usec / 1000.0; // us to ms
+#include "oe.h"
+#include "internal.h"
+
+// weight of the last frame time in the smoothed one
+#define FRAME_TIMER_SMOOTHING 0.1
+
+double get_time(void)
+{
+  return get_time_ns() / 1000000.0;
+}
+
+u64 get_time_ns(void)
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+
+  return (u64)t.tv_sec * 1000000000ull + (u64)t.tv_nsec;
+}
+
+// +------------------------------------------------------------------+
+// |                          thread slots                            |
+// +------------------------------------------------------------------+
+
+static u32 s_thread_slot_count;
+
+static __thread u32 t_thread_slot = THREAD_SLOT_NONE;
+
+u32 _thread_slot(void)
+{
+  if (t_thread_slot != THREAD_SLOT_NONE)
+    return t_thread_slot;
+
+  u32 count = __atomic_load_n(&s_thread_slot_count, __ATOMIC_RELAXED);
+
+  do {
+    if (count >= THREAD_MAX_SLOTS)
+      return THREAD_SLOT_NONE;
+  } while (!__atomic_compare_exchange_n(&s_thread_slot_count, &count,
+                                        count + 1, 1, __ATOMIC_RELAXED,
+                                        __ATOMIC_RELAXED));
+
+  t_thread_slot = count;
+
+  return count;
+}
+
+// +------------------------------------------------------------------+
+// |                          frame timer                             |
+// +------------------------------------------------------------------+
+
+void frame_timer_init(frame_timer_t *timer)
+{
+  assert(timer, "passed timer is a null pointer");
+
+  memset(timer, 0, sizeof(frame_timer_t));
+  timer->last = get_time_ns();
+}
+
+f64 frame_timer_tick(frame_timer_t *timer)
+{
+  assert(timer, "passed timer is a null pointer");
+
+  const u64 now = get_time_ns();
+  const f64 dt = (now - timer->last) / 1000000000.0;
+  timer->last = now;
+
+  // replayed frames are simulated with the recorded delta time, while
+  // the samples keep the real one
+  timer->dt = _input_frame_dt(dt);
+
+  if (!timer->sample_count)
+    timer->smooth_dt = timer->dt;
+  else
+    timer->smooth_dt += (timer->dt - timer->smooth_dt) *
+                        FRAME_TIMER_SMOOTHING;
+
+  timer->samples[timer->next_sample] = dt * 1000.0;
+  timer->next_sample = (timer->next_sample + 1) % FRAME_TIMER_SAMPLES;
+
+  if (timer->sample_count < FRAME_TIMER_SAMPLES)
+    ++timer->sample_count;
+
+  return timer->dt;
+}
+
+static int _cmp_f32(const void *a, const void *b)
+{
+  const f32 x = *(const f32*)a;
+  const f32 y = *(const f32*)b;
+
+  return (x > y) - (x < y);
+}
+
+f64 frame_timer_percentile(const frame_timer_t *timer, f64 percentile)
+{
+  assert(timer, "passed timer is a null pointer");
+
+  if (!timer->sample_count)
+    return 0.0;
+
+  f32 sorted[FRAME_TIMER_SAMPLES];
+  memcpy(sorted, timer->samples, sizeof(f32) * timer->sample_count);
+  qsort(sorted, timer->sample_count, sizeof(f32), _cmp_f32);
+
+  if (percentile < 0.0) { percentile = 0.0; }
+  if (percentile > 100.0) { percentile = 100.0; }
+
+  const u32 ind = (u32)(percentile / 100.0 * (timer->sample_count - 1));
+
+  return sorted[ind];
+}
+
+// +------------------------------------------------------------------+
+// |                          fixed step                              |
+// +------------------------------------------------------------------+
+
+void fixed_step_init(fixed_step_t *fs, f64 step, u32 max_steps)
+{
+  assert(fs, "passed fixed step is a null pointer");
+  assert(step > 0.0, "fixed step must be positive");
+
+  fs->step = step;
+  fs->accumulator = 0.0;
+  fs->max_steps = max_steps;
+}
+
+u32 fixed_step_advance(fixed_step_t *fs, f64 dt)
+{
+  assert(fs, "passed fixed step is a null pointer");
+
+  fs->accumulator += dt;
+
+  u32 steps = (u32)(fs->accumulator / fs->step);
+
+  // NOTE: the simulation is behind too much to catch up, the time
+  //       it's behind by is dropped
+  if (fs->max_steps && steps > fs->max_steps) {
+    steps = fs->max_steps;
+    fs->accumulator = fs->step * steps;
+  }
+
+  fs->accumulator -= fs->step * steps;
+
+  return steps;
+}
+
+f64 fixed_step_alpha(const fixed_step_t *fs)
+{
+  assert(fs, "passed fixed step is a null pointer");
+
+  return fs->accumulator / fs->step;
 }
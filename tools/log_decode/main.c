@@ -0,0 +1,171 @@
+/**
+ * @file main.c
+ * @brief Renders a binary oe log to text.
+ *
+ * Usage: oe_log_decode <path>
+ *
+ * Lines are written to the standard output in the same form as the
+ * text log files, with microsecond timestamps.
+ */
+#include <time.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include <oe.h>
+
+#include "log_format.h"
+
+static const char *s_level_names[] = {
+  "TRACE", "DEBUG", "INFO ", "WARN ", "ERROR", "FATAL",
+};
+
+static char **s_formats;
+static u32 s_format_count;
+
+#define READ(var) (fread(&(var), sizeof(var), 1, fd) == 1)
+
+static i32 _header_read(FILE *fd, _log_binary_header_t *header)
+{
+  if (!READ(*header)) {
+    fprintf(stderr, "failed to read the header\n");
+    return 0;
+  }
+
+  if (memcmp(header->magic, LOG_BINARY_MAGIC, sizeof(header->magic))) {
+    fprintf(stderr, "not an oe binary log\n");
+    return 0;
+  }
+
+  if (header->version != LOG_BINARY_VERSION) {
+    fprintf(stderr, "unsupported version: %u\n", header->version);
+    return 0;
+  }
+
+  // NOTE: captured arguments are raw host values
+  if (
+    header->endian != LOG_BINARY_ENDIAN ||
+    header->ptr_size != sizeof(void*) ||
+    header->ldbl_size != sizeof(long double)
+  ) {
+    fprintf(stderr, "the log was written on an incompatible host\n");
+    return 0;
+  }
+
+  return 1;
+}
+
+static i32 _format_read(FILE *fd)
+{
+  u32 id;
+  u16 len;
+  if (!READ(id) || !READ(len))
+    return 0;
+
+  // ids go one by one starting from 1
+  if (id != s_format_count + 1)
+    return 0;
+
+  char *fmt = malloc(len + 1);
+  char **formats = realloc(s_formats, sizeof(char*) * id);
+  if (!fmt || !formats) {
+    free(fmt);
+    return 0;
+  }
+  s_formats = formats;
+
+  if (fread(fmt, 1, len, fd) != len) {
+    free(fmt);
+    return 0;
+  }
+  fmt[len] = '\0';
+
+  s_formats[s_format_count++] = fmt;
+
+  return 1;
+}
+
+static i32 _message_read(FILE *fd, const _log_binary_header_t *header)
+{
+  u64 time;
+  u8  level;
+  u32 id;
+  u16 size;
+  if (!READ(time) || !READ(level) || !READ(id) || !READ(size))
+    return 0;
+
+  if (level > LOG_LEVEL_FATAL || id > s_format_count)
+    return 0;
+
+  static u8 data[UINT16_MAX + 1];
+  if (fread(data, 1, size, fd) != size)
+    return 0;
+
+  char formatted[LOG_MAX_MSG];
+  const char *msg = formatted;
+
+  // messages without a format are written as text, which might be
+  // longer than a formatted message
+  if (id) {
+    _log_format(s_formats[id - 1], data, size, formatted);
+  } else {
+    data[size] = '\0';
+    msg = (const char*)data;
+  }
+
+  const u64 real = header->start_real + (time - header->start_time);
+  const time_t seconds = (time_t)(real / 1000000000ull);
+  const u32 us = (u32)(real % 1000000000ull / 1000);
+
+  char stamp[32];
+  strftime(stamp, sizeof(stamp), "%d.%m.%y %H:%M:%S",
+           localtime(&seconds));
+
+  printf("[%s.%06u] %s | %s\n", stamp, us, s_level_names[level], msg);
+
+  return 1;
+}
+
+int main(int argc, char **argv)
+{
+  if (argc != 2) {
+    fprintf(stderr, "usage: %s <path>\n", argv[0]);
+    return 1;
+  }
+
+  FILE *fd = fopen(argv[1], "rb");
+  if (!fd) {
+    fprintf(stderr, "failed to open \"%s\"\n", argv[1]);
+    return 1;
+  }
+
+  _log_binary_header_t header;
+  if (!_header_read(fd, &header)) {
+    fclose(fd);
+    return 1;
+  }
+
+  i32 ok = 1;
+  u8 tag;
+
+  while (ok && READ(tag)) {
+    switch (tag) {
+    case LOG_BINARY_FORMAT:  ok = _format_read(fd);           break;
+    case LOG_BINARY_MESSAGE: ok = _message_read(fd, &header); break;
+    default:                 ok = 0;                          break;
+    }
+  }
+
+  // NOTE: the log of a crashed program might end in a middle of
+  //       a record, everything before it is still decoded
+  if (!ok)
+    fprintf(stderr, "corrupted record at %ld\n", ftell(fd));
+
+  for (u32 i = 0; i < s_format_count; ++i)
+    free(s_formats[i]);
+  free(s_formats);
+
+  fclose(fd);
+
+  return !ok;
+}
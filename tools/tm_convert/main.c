@@ -0,0 +1,52 @@
+/**
+ * @file main.c
+ * @brief Converts tilemaps of the original format to the chunked one.
+ *
+ * Usage: oe_tm_convert <input> <output>
+ *
+ * The input keeps int width and height in the host byte order followed
+ * by raw cells, the output is described in tilemap_format.h.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <oe.h>
+
+#include "core/tilemap_format.h"
+
+int main(int argc, char **argv)
+{
+  if (argc != 3) {
+    fprintf(stderr, "usage: %s <input> <output>\n", argv[0]);
+    return 1;
+  }
+
+  tilemap_t tilemap;
+  if (!tilemap_file_load_legacy(argv[1], &tilemap)) {
+    fprintf(stderr, "failed to read \"%s\"\n", argv[1]);
+    return 1;
+  }
+
+  u32 size;
+  u8 *data = tilemap_file_encode(&tilemap, &size);
+  if (!data) {
+    fprintf(stderr, "out of memory\n");
+    free(tilemap.cells);
+    return 1;
+  }
+
+  FILE *fd = fopen(argv[2], "wb");
+  const int ok = fd && fwrite(data, 1, size, fd) == size;
+  if (fd)
+    fclose(fd);
+
+  if (ok)
+    printf("%dx%d cells, %u bytes\n", tilemap.width, tilemap.height, size);
+  else
+    fprintf(stderr, "failed to write \"%s\"\n", argv[2]);
+
+  free(data);
+  free(tilemap.cells);
+
+  return !ok;
+}